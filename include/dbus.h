@@ -33,6 +33,8 @@
 #define NFC_DEVICE_INTERFACE		NFC_SERVICE ".Device"
 #define NFC_TAG_INTERFACE		NFC_SERVICE ".Tag"
 #define NFC_RECORD_INTERFACE		NFC_SERVICE ".Record"
+#define NFC_TAG_EVENTS_INTERFACE	NFC_SERVICE ".TagEvents"
+#define NFC_TRACE_INTERFACE		NFC_SERVICE ".Trace"
 
 #define SEEL_SERVICE     "org.neard.se"
 #define SEEL_PATH       "/org/neard/se"
@@ -19,6 +19,8 @@
  *
  */
 
+#include <stdint.h>
+
 void near_info(const char *format, ...)
 				__attribute__((format(printf, 1, 2)));
 void near_warn(const char *format, ...)
@@ -36,6 +38,13 @@ struct near_debug_desc {
 	unsigned int flags;
 } __attribute__((aligned(8)));
 
+#ifdef NEAR_DEBUG_DISABLED
+#define DBG(fmt, arg...) do { \
+	if (0) \
+		near_debug("%s:%s() " fmt, \
+					__FILE__, __FUNCTION__ , ## arg); \
+} while (0)
+#else
 #define DBG(fmt, arg...) do { \
 	static struct near_debug_desc __near_debug_desc \
 	__attribute__((used, section("__debug"), aligned(8))) = { \
@@ -45,3 +54,35 @@ struct near_debug_desc {
 		near_debug("%s:%s() " fmt, \
 					__FILE__, __FUNCTION__ , ## arg); \
 } while (0)
+#endif
+
+struct near_trace_desc {
+	const char *file;
+	const char *function;
+	const char *format;
+	unsigned int line;
+#define NEAR_TRACE_FLAG_DEFAULT (0)
+#define NEAR_TRACE_FLAG_ENABLED (1 << 0)
+	unsigned int flags;
+} __attribute__((aligned(8)));
+
+void near_trace(const struct near_trace_desc *desc, const uint64_t *args);
+
+/*
+ * Binary trace point, for hot paths. Up to four integer arguments are
+ * stored in the trace file along with a timestamp and the call site,
+ * the format is only applied when decoding the file. Only call sites
+ * built into neard are recorded, those of external plugins never are.
+ */
+#define TRACE(fmt, arg...) do { \
+	static struct near_trace_desc __near_trace_desc \
+	__attribute__((used, section("__trace"), aligned(8))) = { \
+		.file = __FILE__, .function = __FUNCTION__, \
+		.format = fmt, .line = __LINE__, \
+		.flags = NEAR_TRACE_FLAG_DEFAULT, \
+	}; \
+	if (__near_trace_desc.flags & NEAR_TRACE_FLAG_ENABLED) { \
+		uint64_t __near_trace_args[4] = { arg }; \
+		near_trace(&__near_trace_desc, __near_trace_args); \
+	} \
+} while (0)
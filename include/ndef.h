@@ -40,6 +40,26 @@ int near_ndef_count_records(uint8_t *ndef_in, size_t ndef_in_length,
 
 int near_ndef_record_length(uint8_t *ndef_in, size_t ndef_in_length);
 
+/*
+ * A handover message being received: the Hr (or Hs) record, followed by
+ * one configuration record per alternative carrier. records_left must be
+ * set to -1 before the first near_ndef_scan_handover() call, and
+ * cfg_offsets freed once done.
+ */
+struct near_ndef_ho_scan {
+	size_t scan;			/* start of the next record */
+	int records_left;		/* -1 until the Hr record is read */
+	size_t *cfg_offsets;
+	unsigned int cfg_count;
+};
+
+int near_ndef_scan_handover(struct near_ndef_ho_scan *ho, uint8_t *data,
+								size_t len);
+
+int near_ndef_process_handover(uint8_t *ndef_data, size_t ndef_length,
+				const size_t *cfg_offsets, unsigned int cfg_count,
+				struct near_ndef_message **reply);
+
 GList *near_ndef_parse_msg(uint8_t *ndef_data, size_t ndef_length,
 					struct near_ndef_message **reply);
 
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 
 #include <linux/socket.h>
 
@@ -42,39 +43,23 @@
 
 #include "p2p.h"
 
-#define NDEF_HR_MSG_MIN_LENGTH 0x06
-#define HR_HEADER_SIZE	6		/* header (1) + type len (1) +
-					*  payload len (1) + rec type (2) 'Hx'
-					*  + version (1)
-					*/
-
-#define RECORD_TYPE_WKT_ALTERNATIVE_CARRIER 0x0a
-#define FRAME_TYPE_OFFSET	3
-
-enum loop_stage_flag {
-	STATE_MAIN_NDEF		= 0x00,
-	STATE_CFG_RECORD	= 0x01,
-};
+#define HANDOVER_READ_SIZE	128
+#define HANDOVER_MAX_SIZE	0xffff
 
 static GHashTable *hr_ndef_hash = NULL;
 
-struct extra_ndef {
-	uint8_t	*ndef;
-	uint8_t	length;
-};
-
+/*
+ * A handover message being received. Records are located as bytes come
+ * in, so that the complete message is never parsed twice.
+ */
 struct hr_ndef {
 	uint8_t *ndef;
-	uint16_t cur_ptr;
-	int cur_record_len;
-	int missing_bytes;
+	size_t len;			/* bytes received */
+	size_t size;			/* bytes allocated */
+	struct near_ndef_ho_scan ho;
 	uint32_t adapter_idx;
 	uint32_t target_idx;
 	near_tag_io_cb cb;
-	int extra_ndef_count;
-	int block_free_size;
-	bool cfg_record_state;
-	bool in_extra_read;
 };
 
 struct hr_push_client {
@@ -89,8 +74,10 @@ static void free_hr_ndef(gpointer data)
 {
 	struct hr_ndef *ndef = data;
 
-	if (ndef)
+	if (ndef) {
 		g_free(ndef->ndef);
+		g_free(ndef->ho.cfg_offsets);
+	}
 
 	g_free(ndef);
 }
@@ -108,38 +95,25 @@ static void handover_close(int client_fd, int err, gpointer data)
 	g_hash_table_remove(hr_ndef_hash, GINT_TO_POINTER(client_fd));
 }
 
-/* Parse an incoming handover buffer*/
+/* Process a complete handover message and send the Hs back for a Hr */
 static int handover_ndef_parse(int client_fd, struct hr_ndef *ndef)
 {
 	int err;
-	GList *records;
 	struct near_ndef_message *msg = NULL;
 
 	DBG("");
 
-	if ((!ndef->ndef) ||
-			(ndef->cur_ptr < NDEF_HR_MSG_MIN_LENGTH)) {
-		err = -EINVAL;
-		goto fail;
-	}
-
-	/* call the global parse function */
-	records = near_ndef_parse_msg(ndef->ndef, ndef->cur_ptr, &msg);
-	if (!records) {
-		err = -ENOMEM;
+	err = near_ndef_process_handover(ndef->ndef, ndef->ho.scan,
+					ndef->ho.cfg_offsets, ndef->ho.cfg_count,
+					&msg);
+	if (err < 0)
 		goto fail;
-	}
-
-	near_ndef_records_free(records);
 
 	if (msg) {
 		near_info("Send Hs frame");
 		err = send(client_fd, msg->data, msg->length, MSG_DONTWAIT);
 
-		g_free(msg->data);
-		g_free(msg);
-	} else {
-		err = 0;
+		near_ndef_msg_free(msg);
 	}
 
 	return err;
@@ -152,252 +126,101 @@ fail:
 	return err;
 }
 
-static bool handover_recv_error(void)
+/* Read everything the socket holds, growing the buffer geometrically */
+static int handover_recv(int client_fd, struct hr_ndef *ndef)
 {
-	near_error("%s", strerror(errno));
-
-	if (errno == EAGAIN)
-		return true;
-
-	return false;
-}
-
-/* Add extra records right after the end of the "Hr" ndef record */
-static bool handover_read_cfg_records(int client_fd,
-				uint32_t adapter_idx, uint32_t target_idx,
-				near_tag_io_cb cb)
-{
-	struct hr_ndef *ndef;
 	uint8_t *new_ndef;
-	int bytes_recv;
-	int ndef_size;
-	int err;
+	size_t new_size;
+	ssize_t bytes_recv;
+	int avail;
 
-	ndef = g_hash_table_lookup(hr_ndef_hash, GINT_TO_POINTER(client_fd));
-	if (!ndef) {
-		near_error("hr_ndef should exist");
-		return false;
-	}
+	if (ioctl(client_fd, FIONREAD, &avail) < 0 || avail <= 0)
+		avail = HANDOVER_READ_SIZE;
 
-	if (ndef->in_extra_read) {
-		/* Next prepare read to complete the Hr */
-		new_ndef = g_try_realloc(ndef->ndef, ndef->cur_record_len +
-				NDEF_HR_MSG_MIN_LENGTH);
-		if (!new_ndef)
-			return false;
-
-		ndef->ndef = new_ndef;
-
-		/* Read header bytes */
-		bytes_recv = recv(client_fd, ndef->ndef + ndef->cur_ptr,
-				NDEF_HR_MSG_MIN_LENGTH, MSG_DONTWAIT);
-		if (bytes_recv < 0)
-			return handover_recv_error();
+	if (ndef->len + avail > ndef->size) {
+		if (ndef->size >= HANDOVER_MAX_SIZE)
+			return -EMSGSIZE;
 
-		/* Now, check the ndef payload size plus header bytes */
-		ndef_size = near_ndef_record_length(ndef->ndef + ndef->cur_ptr,
-								bytes_recv);
-		if (ndef_size < 0)
-			goto fail;
+		new_size = ndef->size ? ndef->size : HANDOVER_READ_SIZE;
+		while (new_size < ndef->len + avail)
+			new_size *= 2;
 
-		ndef->cur_ptr += bytes_recv;
-		ndef->missing_bytes = ndef_size - bytes_recv;
+		new_size = MIN(new_size, HANDOVER_MAX_SIZE);
 
-		/* Next prepare read to complete the NDEF */
-		new_ndef = g_try_realloc(ndef->ndef, ndef->cur_record_len
-								+ ndef_size);
+		new_ndef = g_try_realloc(ndef->ndef, new_size);
 		if (!new_ndef)
-			return false;
+			return -ENOMEM;
 
 		ndef->ndef = new_ndef;
-
-		ndef->cur_record_len += ndef_size;
-		ndef->in_extra_read = false;
-
-		return true;
+		ndef->size = new_size;
 	}
 
-	/* Read remaining bytes */
-	bytes_recv = recv(client_fd, ndef->ndef + ndef->cur_ptr,
-					ndef->missing_bytes, MSG_DONTWAIT);
+	bytes_recv = recv(client_fd, ndef->ndef + ndef->len,
+				ndef->size - ndef->len, MSG_DONTWAIT);
 	if (bytes_recv < 0)
-		return handover_recv_error();
-
-	ndef->cur_ptr += bytes_recv;
-	ndef->missing_bytes -= bytes_recv;
-
-	/* Is the NDEF read complete ? */
-	if (ndef->missing_bytes)
-		return true;	/* more bytes to come... */
+		return -errno;
 
-	if (ndef->extra_ndef_count > 0)
-		ndef->extra_ndef_count--;
+	if (bytes_recv == 0)
+		return -ECONNRESET;
 
-	ndef->in_extra_read = true;
-
-	if (ndef->extra_ndef_count == 0) {
-		/* All the bytes are read so now, parse the frame */
-		err = handover_ndef_parse(client_fd, ndef);
-		if (err > 0) {
-			/* clean memory */
-			handover_close(client_fd, 0, NULL);
-			return true;
-		}
-
-		return false;
-	}
+	ndef->len += bytes_recv;
 
-	/* Process the next NDEF */
-	return true;
-
-fail:
-	near_error("Handover read NDEFs failed");
-	return false;
+	return 0;
 }
 
-static bool handover_read_hr(int client_fd,
-		uint32_t adapter_idx, uint32_t target_idx, near_tag_io_cb cb)
+/* Read Hr/Hs messages and their configuration records */
+static bool handover_read(int client_fd,
+		uint32_t adapter_idx, uint32_t target_idx,
+		near_tag_io_cb cb,
+		gpointer data)
 {
-	int bytes_recv;
-	int extra_ndefs;
 	struct hr_ndef *ndef;
-
-	DBG("");
+	int err;
 
 	ndef = g_hash_table_lookup(hr_ndef_hash, GINT_TO_POINTER(client_fd));
-	if (!ndef)
-		return false;
-
-	/* Read remaining bytes */
-	bytes_recv = recv(client_fd, ndef->ndef + ndef->cur_ptr,
-			ndef->missing_bytes, MSG_DONTWAIT);
-	if (bytes_recv < 0)
-		return handover_recv_error();
-
-	ndef->cur_ptr += bytes_recv;
-	ndef->missing_bytes -= bytes_recv;
-
-	/* Is the ndef "Hr" read complete or should we loop */
-	if (ndef->missing_bytes)
-		return true;
-
-	/*
-	 * The first NDEF frame is read. We now should determine how many
-	 * extra records follow the NDEF frame.
-	 * We skip the first 6 bytes (Hr header) to jump on the first record
-	 */
-	extra_ndefs = near_ndef_count_records(ndef->ndef + HR_HEADER_SIZE,
-			ndef->cur_record_len - HR_HEADER_SIZE,
-			RECORD_TYPE_WKT_ALTERNATIVE_CARRIER);
-	if (extra_ndefs < 0)
-		goto fail;
-
-	/* There's still some extra ndefs to read */
-	ndef->extra_ndef_count = extra_ndefs;
+	if (!ndef) {
+		ndef = g_try_malloc0(sizeof(struct hr_ndef));
+		if (!ndef)
+			return false;
 
-	/* End of Handover message - now process extra records */
-	ndef->in_extra_read = true;
-	ndef->cfg_record_state = true;
+		ndef->ho.records_left = -1;
+		ndef->adapter_idx = adapter_idx;
+		ndef->target_idx = target_idx;
+		ndef->cb = cb;
 
-	/* But, if there's no ac record, we jump to the parsing */
-	if (ndef->extra_ndef_count == 0) {
-		handover_ndef_parse(client_fd, ndef);
-		return false;
+		g_hash_table_insert(hr_ndef_hash, GINT_TO_POINTER(client_fd),
+									ndef);
 	}
 
-	return true;
-
-fail:
-	near_error("Handover read failed");
-	return false;
-}
-
-static bool handover_read_initialize(int client_fd,
-		uint32_t adapter_idx, uint32_t target_idx, near_tag_io_cb cb)
-{
-	int bytes_recv;
-	struct hr_ndef *ndef;
-
-	DBG("");
-
-	/* Allocate the ndef structure */
-	ndef = g_try_malloc0(sizeof(struct hr_ndef));
-	if (!ndef)
-		goto fail;
-
-	/* Allocate and read frame header (6 bytes) */
-	ndef->ndef = g_try_malloc0(NDEF_HR_MSG_MIN_LENGTH);
-	if (!ndef->ndef)
+	err = handover_recv(client_fd, ndef);
+	if (err == -EAGAIN)
+		return true;
+	if (err < 0)
 		goto fail;
 
-	/* Initialize default values */
-	ndef->cur_ptr = 0;
-	ndef->cur_record_len = -1;
-	ndef->adapter_idx = adapter_idx;
-	ndef->target_idx = target_idx;
-	ndef->cb = cb;
-	ndef->cfg_record_state = false;
-
-	g_hash_table_insert(hr_ndef_hash, GINT_TO_POINTER(client_fd), ndef);
-
-	/* Read header bytes (6) */
-	bytes_recv = recv(client_fd, ndef->ndef,
-				NDEF_HR_MSG_MIN_LENGTH, MSG_DONTWAIT);
-	if (bytes_recv < 0)
-		return handover_recv_error();
-
-	/* Now, check the ndef payload size plus header bytes */
-	ndef->cur_record_len = near_ndef_record_length(ndef->ndef, bytes_recv);
-	if (ndef->cur_record_len < 0)
+	err = near_ndef_scan_handover(&ndef->ho, ndef->ndef, ndef->len);
+	if (err < 0)
 		goto fail;
 
-	ndef->cur_ptr += bytes_recv;
-	ndef->missing_bytes = ndef->cur_record_len - bytes_recv;
+	/* more bytes to come... */
+	if (err == 0)
+		return true;
 
-	if (ndef->cur_record_len == NDEF_HR_MSG_MIN_LENGTH) {
-		handover_ndef_parse(client_fd, ndef);
-		return false;
-	}
+	DBG("Handover message complete, %zu bytes", ndef->ho.scan);
 
-	DBG("Handover frame size is %d", ndef->cur_ptr);
+	err = handover_ndef_parse(client_fd, ndef);
 
-	/* Next prepare read to complete the read */
-	ndef->ndef = g_try_realloc(ndef->ndef, ndef->cur_record_len);
-	if (!ndef->ndef)
-		goto fail;
+	/* clean memory, a new message may follow once the Hs is sent */
+	handover_close(client_fd, 0, NULL);
 
-	return true;
+	return err > 0;
 
 fail:
-	free_hr_ndef(ndef);
+	near_error("Handover read failed %d", err);
 
-	return false;
-}
-
-/*
- * This function is a "dispatcher", to read Hr/Hs messages,
- * and/or additional NDEF messages
- */
-static bool handover_read(int client_fd,
-		uint32_t adapter_idx, uint32_t target_idx,
-		near_tag_io_cb cb,
-		gpointer data)
-{
-	struct hr_ndef *ndef;
-
-	ndef = g_hash_table_lookup(hr_ndef_hash, GINT_TO_POINTER(client_fd));
-	if (!ndef) {
-		/* First call: allocate and read header bytes */
-		return handover_read_initialize(client_fd, adapter_idx,
-						target_idx, cb);
-	}
-
-	if (ndef->cfg_record_state) {
-		return handover_read_cfg_records(client_fd, adapter_idx,
-							target_idx, cb);
-	}
+	handover_close(client_fd, 0, NULL);
 
-	return handover_read_hr(client_fd, adapter_idx, target_idx, cb);
+	return false;
 }
 
 static void free_hr_push_client(struct hr_push_client *client, int status)
@@ -137,7 +137,7 @@ static int data_recv(uint8_t *resp, int length, void *data)
 	uint32_t adapter_idx, target_idx;
 	int read_blocks;
 
-	DBG("%d", length);
+	TRACE("length: %d", length);
 
 	if (length < 0) {
 		g_free(tag);
@@ -200,7 +200,7 @@ static int ISO_send_cmd(uint8_t class,
 	uint8_t total_cmd_length;
 	int err;
 
-	DBG("CLA-%02x INS-%02x P1-%02x P2-%02x",
+	TRACE("CLA-%02x INS-%02x P1-%02x P2-%02x",
 			class, instruction, param1, param2);
 
 	if (!le) {
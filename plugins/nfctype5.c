@@ -382,7 +382,7 @@ static int t5_read_resp(uint8_t *resp, int length, void *data)
 	uint8_t blk_size = near_tag_get_blk_size(tag);
 	int err;
 
-	DBG("length: %d", length);
+	TRACE("length: %d", length);
 
 	err = t5_check_resp(resp, length);
 	if (err)
@@ -470,7 +470,7 @@ static int t5_write_resp(uint8_t *resp, int length, void *data)
 	uint8_t blk_size = near_tag_get_blk_size(tag);
 	int err;
 
-	DBG("length: %d", length);
+	TRACE("length: %d", length);
 
 	err = t5_check_resp(resp, length);
 	if (err)
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -56,12 +57,14 @@ uint8_t gp_aid[] = {0xA0, 0x00, 0x00, 0x01,
 #define GET_REFRESH_DATA_CMD_LEN 2
 #define GET_REFRESH_DATA_TAG_LEN 1
 #define GET_REFRESH_TAG_LEN 8
+#define GET_CPLC_DATA_CMD_LEN 2
 
-/* if ((APDU_header & rule->mask) == rule->header) then APDU is allowed */
-struct seel_ace_apdu_rule {
-	uint32_t header;
-	uint32_t mask;
-};
+#define ACE_STORAGE_DIR  STORAGEDIR "/se"
+#define ACE_STORAGE_FILE ACE_STORAGE_DIR "/ace"
+
+/* APDU-AR-DO filters are a 4 bytes APDU header followed by a 4 bytes mask */
+#define APDU_FILTER_LEN 8
+#define APDU_HEADER_LEN 4
 
 struct seel_ace_rule {
 	uint8_t aid[MAX_AID_LEN];
@@ -70,8 +73,14 @@ struct seel_ace_rule {
 	uint8_t hash[APP_HASH_LEN];
 	size_t hash_len;
 
-	uint8_t *apdu_rules;
-	size_t apdu_rules_len;
+	/*
+	 * if ((APDU_header & apdu_masks[i]) == apdu_headers[i]) then
+	 * APDU is allowed. Both are stored as big endian values.
+	 */
+	bool apdu_always;
+	uint32_t *apdu_headers;
+	uint32_t *apdu_masks;
+	size_t apdu_filters;
 
 	bool nfc_rule;
 };
@@ -85,18 +94,66 @@ struct seel_ace {
 
 	uint8_t rules_tag[8];
 
+	/* Card identity the rules belong to, NULL if unknown */
+	char *card;
+
 	GSList *rules;
+
+	/* struct ace_key -> first matching struct seel_ace_rule */
+	GHashTable *index;
+};
+
+/*
+ * Rule index keys. A specific rule is indexed under its (AID, hash),
+ * and once more under (AID, ACE_ANY_HASH) so that the existence of
+ * a specific rule for another hash can be checked in one lookup.
+ * Generic rules use a zero AID and/or hash length.
+ */
+#define ACE_ANY_HASH 0xff
+
+struct ace_key {
+	uint8_t aid_len;
+	uint8_t hash_len;
+	uint8_t aid[MAX_AID_LEN];
+	uint8_t hash[APP_HASH_LEN];
+};
+
+/*
+ * Access decision for one caller on one channel: the union of the rules
+ * matching any of the caller's application hashes.
+ */
+struct ace_decision {
+	unsigned int generation;
+
+	bool allow_all;
+	uint32_t *headers;
+	uint32_t *masks;
+	size_t n_filters;
+};
+
+/* Cached APDU access decisions for one channel, keyed by caller */
+struct seel_ace_cache {
+	GHashTable *decisions;
 };
 
 GHashTable *ace_hash;
 
+/* struct seel_se -> card identity, a SHA-256 of its CPLC data */
+static GHashTable *card_hash;
+
+/* Bumped whenever a rule set is replaced, invalidating channel caches */
+static unsigned int ace_generation;
+
+static void dump_ace(struct seel_ace *ace);
+
 static void free_rule(gpointer data)
 {
 	struct seel_ace_rule *rule = data;
 
 	DBG("%p", rule);
 
-	g_free(rule->apdu_rules);
+	g_free(rule->apdu_headers);
+	g_free(rule->apdu_masks);
 	g_free(rule);
 }
 
@@ -106,14 +163,127 @@ static void free_ace(gpointer data)
 
 	DBG("%p %p", ace, ace->rules);
 
+	if (ace->index)
+		g_hash_table_destroy(ace->index);
+
 	g_slist_free_full(ace->rules, free_rule);
+	g_free(ace->card);
 	g_free(ace);
 }
 
+static guint ace_key_hash(gconstpointer data)
+{
+	const uint8_t *key = data;
+	guint h = 5381;
+	size_t i;
+
+	for (i = 0; i < sizeof(struct ace_key); i++)
+		h = (h << 5) + h + key[i];
+
+	return h;
+}
+
+static gboolean ace_key_equal(gconstpointer a, gconstpointer b)
+{
+	return !memcmp(a, b, sizeof(struct ace_key));
+}
+
+static void ace_key_set(struct ace_key *key, uint8_t *aid, size_t aid_len,
+				uint8_t *hash, size_t hash_len)
+{
+	memset(key, 0, sizeof(*key));
+
+	key->aid_len = aid_len;
+	if (aid_len)
+		memcpy(key->aid, aid, aid_len);
+
+	key->hash_len = hash_len;
+	if (hash && hash_len <= APP_HASH_LEN)
+		memcpy(key->hash, hash, hash_len);
+}
+
+static struct seel_ace_rule *ace_index_lookup(struct seel_ace *ace,
+					uint8_t *aid, size_t aid_len,
+					uint8_t *hash, size_t hash_len)
+{
+	struct ace_key key;
+
+	ace_key_set(&key, aid, aid_len, hash, hash_len);
+
+	return g_hash_table_lookup(ace->index, &key);
+}
+
+static int ace_index_add(struct seel_ace *ace, struct seel_ace_rule *rule,
+							size_t hash_len)
+{
+	struct ace_key *key;
+
+	key = g_try_malloc0(sizeof(*key));
+	if (!key)
+		return -ENOMEM;
+
+	ace_key_set(key, rule->aid, rule->aid_len, rule->hash, hash_len);
+
+	/* First rule in ARA-M order wins, as with the old linear search */
+	if (g_hash_table_lookup(ace->index, key)) {
+		g_free(key);
+		return 0;
+	}
+
+	g_hash_table_insert(ace->index, key, rule);
+
+	return 0;
+}
+
+static int build_ace_index(struct seel_ace *ace)
+{
+	GSList *list;
+	int err;
+
+	ace->index = g_hash_table_new_full(ace_key_hash, ace_key_equal,
+								g_free, NULL);
+
+	for (list = ace->rules; list; list = list->next) {
+		struct seel_ace_rule *rule = list->data;
+
+		/* Partial hashes never match anything */
+		if (rule->hash_len && rule->hash_len != APP_HASH_LEN)
+			continue;
+
+		err = ace_index_add(ace, rule, rule->hash_len);
+		if (err < 0)
+			return err;
+
+		if (rule->aid_len && rule->hash_len) {
+			err = ace_index_add(ace, rule, ACE_ANY_HASH);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	DBG("%u rules indexed under %u keys", g_slist_length(ace->rules),
+					g_hash_table_size(ace->index));
+
+	return 0;
+}
+
+static void ace_publish(struct seel_ace *ace)
+{
+	if (build_ace_index(ace) < 0) {
+		near_error("Could not index ACE rules");
+		free_ace(ace);
+		return;
+	}
+
+	dump_ace(ace);
+
+	ace_generation++;
+	g_hash_table_replace(ace_hash, ace->se, ace);
+}
+
 static void dump_rule(gpointer data, gpointer user_data)
 {
 	struct seel_ace_rule *rule = data;
-	struct seel_ace_apdu_rule *apdu_rule;
 	char aid[3 * MAX_AID_LEN + 1];
 	char hash[3 * APP_HASH_LEN + 1];
 	size_t i;
@@ -138,37 +308,13 @@ static void dump_rule(gpointer data, gpointer user_data)
 		DBG("  Hash [%zu]: %s", rule->hash_len, hash);
 	}
 
-	if (rule->apdu_rules_len == 1) {
-		DBG("  APDU: %s", rule->apdu_rules[0] ? "Always" : "Never");
+	if (rule->apdu_always || !rule->apdu_filters) {
+		DBG("  APDU: %s", rule->apdu_always ? "Always" : "Never");
 	} else {
-		uint8_t *header, *mask;
-		size_t n_rules;
-
-		/*
-		 * (void *) to silence -Wcast-align. Code should be safe
-		 * (assuming platform handles unaliagned access) as iterations
-		 * go up to n_rules.
-		 *
-		 * TODO: Fix the problem instead of silencing with cast, so
-		 * the code would be porable.
-		 */
-		if (rule->apdu_rules_len % sizeof(struct seel_ace_apdu_rule *)) {
-			DBG("  APDU: wrong alignment (Bug, code needs fixing)");
-		}
-		apdu_rule = (struct seel_ace_apdu_rule *)(void *)rule->apdu_rules;
-		n_rules = rule->apdu_rules_len /
-				sizeof(struct seel_ace_apdu_rule);
-
-		DBG("  APDU rules (%zu)", n_rules);
-		for (i = 0; i < n_rules; i++) {
-			header = (uint8_t *)&apdu_rule->header;
-			mask = (uint8_t *)&apdu_rule->mask;
-			DBG("    header 0x%02x:0x%02x:0x%02x:0x%02x "
-			    "mask 0x%02x:0x%02x:0x%02x:0x%02x",
-				header[0], header[1], header[2], header[3],
-				mask[0], mask[1], mask[2], mask[3]);
-			apdu_rule++;
-		}
+		DBG("  APDU rules (%zu)", rule->apdu_filters);
+		for (i = 0; i < rule->apdu_filters; i++)
+			DBG("    header 0x%08x mask 0x%08x",
+				rule->apdu_headers[i], rule->apdu_masks[i]);
 	}
 
 	DBG("  NFC: %s", rule->nfc_rule ? "Always" : "Never");
@@ -241,11 +387,60 @@ static int build_ref(struct seel_ace_rule *ace_rule,
 	return 0;
 }
 
+static uint32_t get_be32(const uint8_t *data)
+{
+	return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+			(uint32_t)data[2] << 8 | data[3];
+}
+
+static int build_apdu_filters(struct seel_ace_rule *ace_rule,
+					uint8_t *filters, size_t length)
+{
+	size_t i, n_filters;
+
+	g_free(ace_rule->apdu_headers);
+	g_free(ace_rule->apdu_masks);
+	ace_rule->apdu_headers = NULL;
+	ace_rule->apdu_masks = NULL;
+	ace_rule->apdu_filters = 0;
+
+	/* A single byte means always (non zero) or never */
+	if (length == 1) {
+		ace_rule->apdu_always = !!filters[0];
+		return 0;
+	}
+
+	ace_rule->apdu_always = false;
+
+	if (length % APDU_FILTER_LEN)
+		DBG("Ignoring %zu trailing bytes", length % APDU_FILTER_LEN);
+
+	n_filters = length / APDU_FILTER_LEN;
+	if (!n_filters)
+		return 0;
+
+	ace_rule->apdu_headers = g_try_new(uint32_t, n_filters);
+	ace_rule->apdu_masks = g_try_new(uint32_t, n_filters);
+	if (!ace_rule->apdu_headers || !ace_rule->apdu_masks)
+		return -ENOMEM;
+
+	for (i = 0; i < n_filters; i++) {
+		ace_rule->apdu_headers[i] = get_be32(filters);
+		ace_rule->apdu_masks[i] = get_be32(filters + APDU_HEADER_LEN);
+		filters += APDU_FILTER_LEN;
+	}
+
+	ace_rule->apdu_filters = n_filters;
+
+	return 0;
+}
+
 static int build_ar(struct seel_ace_rule *ace_rule,
 			uint8_t *rule, size_t rule_length)
 {
 	uint8_t *rule_ptr;
 	size_t remaining, do_length;
+	int err;
 
 	remaining = rule_length;
 	rule_ptr = rule;
@@ -260,12 +455,9 @@ static int build_ar(struct seel_ace_rule *ace_rule,
 			if (remaining < do_length)
 				return -EINVAL;
 
-			ace_rule->apdu_rules = g_try_malloc0(do_length);
-			if (!ace_rule->apdu_rules)
-				return -ENOMEM;
-
-			memcpy(ace_rule->apdu_rules, rule_ptr, do_length);
-			ace_rule->apdu_rules_len = do_length;
+			err = build_apdu_filters(ace_rule, rule_ptr, do_length);
+			if (err < 0)
+				return err;
 
 			remaining -= do_length + 2;
 			rule_ptr += do_length;
@@ -432,6 +624,163 @@ static int ace_rule_length(uint8_t *apdu, size_t apdu_length,
 	return length;
 }
 
+/*
+ * Rule sets are stored raw, as received from the ARA-M, in one group per
+ * card. They are reused as long as the ARA-M refresh tag does not change,
+ * which saves the GET DATA [All] round trips. Cards are told apart by
+ * their CPLC data, as a swapped card may come with the same refresh tag.
+ * Rules of cards we can't identify are not stored.
+ */
+static char *ace_storage_group(struct seel_ace *ace)
+{
+	if (!ace->card)
+		return NULL;
+
+	return g_strdup_printf("Card %s", ace->card);
+}
+
+static char *bytes_to_hex(const uint8_t *data, size_t length)
+{
+	char *str;
+	size_t i;
+
+	str = g_try_malloc0(2 * length + 1);
+	if (!str)
+		return NULL;
+
+	for (i = 0; i < length; i++)
+		sprintf(str + 2 * i, "%02x", data[i]);
+
+	return str;
+}
+
+static uint8_t *hex_to_bytes(const char *str, size_t *length)
+{
+	uint8_t *data;
+	size_t i, len;
+	unsigned int byte;
+
+	len = strlen(str);
+	if (!len || len % 2)
+		return NULL;
+
+	data = g_try_malloc(len / 2);
+	if (!data)
+		return NULL;
+
+	for (i = 0; i < len / 2; i++) {
+		if (sscanf(str + 2 * i, "%2x", &byte) != 1) {
+			g_free(data);
+			return NULL;
+		}
+
+		data[i] = byte;
+	}
+
+	*length = len / 2;
+
+	return data;
+}
+
+static GKeyFile *ace_storage_load(void)
+{
+	GKeyFile *keyfile;
+
+	keyfile = g_key_file_new();
+
+	/* A missing file just means nothing was stored yet */
+	g_key_file_load_from_file(keyfile, ACE_STORAGE_FILE, 0, NULL);
+
+	return keyfile;
+}
+
+static void ace_store(struct seel_ace *ace, uint8_t *rules, size_t length)
+{
+	GKeyFile *keyfile;
+	char *group, *tag, *payload, *data;
+	gsize data_length;
+
+	group = ace_storage_group(ace);
+	if (!group)
+		return;
+
+	tag = bytes_to_hex(ace->rules_tag, GET_REFRESH_TAG_LEN);
+	payload = bytes_to_hex(rules, length);
+	if (!tag || !payload)
+		goto out;
+
+	keyfile = ace_storage_load();
+
+	g_key_file_set_string(keyfile, group, "RefreshTag", tag);
+	g_key_file_set_string(keyfile, group, "Rules", payload);
+
+	data = g_key_file_to_data(keyfile, &data_length, NULL);
+
+	if (g_mkdir_with_parents(ACE_STORAGE_DIR, S_IRWXU) < 0 ||
+			!g_file_set_contents(ACE_STORAGE_FILE, data,
+							data_length, NULL))
+		near_error("Could not store ACE rules for %s", group);
+
+	g_free(data);
+	g_key_file_free(keyfile);
+
+out:
+	g_free(payload);
+	g_free(tag);
+	g_free(group);
+}
+
+/* Builds the rules from storage if they match the current refresh tag */
+static int ace_restore(struct seel_ace *ace)
+{
+	GKeyFile *keyfile;
+	char *group, *tag, *payload = NULL;
+	uint8_t *rules = NULL, *stored_tag = NULL;
+	size_t length, tag_length;
+	int err = -ENOENT;
+
+	group = ace_storage_group(ace);
+	if (!group)
+		return -ENOENT;
+
+	keyfile = ace_storage_load();
+
+	tag = g_key_file_get_string(keyfile, group, "RefreshTag", NULL);
+	if (!tag)
+		goto out;
+
+	stored_tag = hex_to_bytes(tag, &tag_length);
+	if (!stored_tag || tag_length != GET_REFRESH_TAG_LEN ||
+			memcmp(stored_tag, ace->rules_tag, GET_REFRESH_TAG_LEN))
+		goto out;
+
+	payload = g_key_file_get_string(keyfile, group, "Rules", NULL);
+	if (!payload)
+		goto out;
+
+	rules = hex_to_bytes(payload, &length);
+	if (!rules)
+		goto out;
+
+	err = build_ace_rules(ace, rules, length);
+	if (err < 0) {
+		g_slist_free_full(ace->rules, free_rule);
+		ace->rules = NULL;
+	}
+
+out:
+	DBG("%s %d", group, err);
+
+	g_free(rules);
+	g_free(payload);
+	g_free(stored_tag);
+	g_free(tag);
+	g_key_file_free(keyfile);
+	g_free(group);
+
+	return err;
+}
+
 static void get_next_gp_data(struct seel_ace *ace);
 
 static void get_next_gp_data_cb(void *context,
@@ -462,12 +811,18 @@ static void get_next_gp_data_cb(void *context,
 	if (build_ace_rules(ace, ace->rules_payload, ace->rules_length))
 		goto out;
 
-	dump_ace(ace);
+	ace_store(ace, ace->rules_payload, ace->rules_length);
 
-	g_hash_table_replace(ace_hash, ace->se, ace);
+	g_free(ace->rules_payload);
+	ace->rules_payload = NULL;
+
+	ace_publish(ace);
+
+	return;
 
 out:
 	g_free(ace->rules_payload);
+	ace->rules_payload = NULL;
 
 	return;
 }
@@ -543,9 +898,10 @@ static void get_all_gp_data_cb(void *context,
 								payload_length))
 		return;
 
-	dump_ace(ace);
+	ace_store(ace, apdu + GET_ALL_DATA_CMD_LEN + length_length,
+							payload_length);
 
-	g_hash_table_replace(ace_hash, ace->se, ace);
+	ace_publish(ace);
 
 	return;
 }
@@ -555,7 +911,7 @@ static void get_refresh_gp_data_cb(void *context,
 			int err)
 {
 	struct seel_se *se = context;
-	struct seel_ace *ace;
+	struct seel_ace *ace, *current;
 	struct seel_apdu *get_all_gp_data;
 
 	DBG("");
@@ -575,10 +931,27 @@ static void get_refresh_gp_data_cb(void *context,
 		return;
 
 	ace->se = se;
+	ace->card = g_strdup(g_hash_table_lookup(card_hash, se));
 
 	memcpy(ace->rules_tag, apdu + GET_REFRESH_DATA_CMD_LEN
 			+ GET_REFRESH_DATA_TAG_LEN, GET_REFRESH_TAG_LEN);
 
+	/* Rules did not change since we last fetched them */
+	current = g_hash_table_lookup(ace_hash, se);
+	if (current && current->card && !g_strcmp0(current->card, ace->card) &&
+			!memcmp(current->rules_tag, ace->rules_tag,
+						GET_REFRESH_TAG_LEN)) {
+		DBG("ACE rules up to date");
+		free_ace(ace);
+		return;
+	}
+
+	if (ace_restore(ace) == 0) {
+		DBG("ACE rules restored from storage");
+		ace_publish(ace);
+		return;
+	}
+
 	get_all_gp_data = __seel_apdu_get_all_gp_data();
 	if (!get_all_gp_data)
 		return;
@@ -617,238 +990,234 @@ static void select_gp_aid_cb(void *context,
 	return ;
 }
 
-gboolean __seel_ace_add(gpointer user_data)
+static void select_gp_aid(struct seel_se *se)
 {
-	struct seel_se *se = user_data;
 	struct seel_apdu *select_gp_aid;
 	int err;
 
-	DBG("");
-
 	select_gp_aid = __seel_apdu_select_aid(0, gp_aid, GP_AID_LEN);
 	if (!select_gp_aid)
-		return FALSE;
+		return;
 
 	/* Send the GP AID selection APDU */
 	err = __seel_se_queue_io(se, select_gp_aid, select_gp_aid_cb, se);
-	if (err < 0) {
+	if (err < 0)
 		near_error("GP AID err %d", err);
-		return FALSE;
-	}
-
-	return FALSE;
 }
 
-int __seel_ace_remove(struct seel_se *se)
+/* CPLC data, tag 9F7F, answered by the issuer security domain */
+static void get_cplc_data_cb(void *context,
+			uint8_t *apdu, size_t apdu_length,
+			int err)
 {
-	DBG("%p", se);
+	struct seel_se *se = context;
+	char *card;
 
-	if (!g_hash_table_remove(ace_hash, se))
-		return -ENODEV;
+	DBG("");
 
-	return 0;
-}
+	g_hash_table_remove(card_hash, se);
 
-static struct seel_ace_rule *find_specific_rule(struct seel_ace *ace,
-						uint8_t *aid, size_t aid_len,
-						uint8_t *hash)
-{
-	GSList *list;
+	if (err || apdu_length < GET_CPLC_DATA_CMD_LEN + 1 + APDU_STATUS_LEN ||
+			apdu[0] != 0x9F || apdu[1] != 0x7F ||
+			apdu_length != GET_CPLC_DATA_CMD_LEN + 1 + apdu[2] +
+							APDU_STATUS_LEN ||
+			!apdu[2]) {
+		DBG("No CPLC data, ACE rules won't be stored");
+		goto out;
+	}
 
-	DBG("%zu", aid_len);
+	card = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+					apdu + GET_CPLC_DATA_CMD_LEN + 1,
+					apdu[2]);
+	if (!card)
+		goto out;
 
-	if (!hash || !aid)
-		return false;
+	DBG("card %s", card);
 
-	for (list = ace->rules; list; list = list->next) {
-		struct seel_ace_rule *rule = list->data;
+	g_hash_table_replace(card_hash, se, card);
 
-		if (rule->aid_len != aid_len)
-			continue;
+out:
+	select_gp_aid(se);
+}
 
-		if (rule->hash_len != APP_HASH_LEN)
-			continue;
+gboolean __seel_ace_add(gpointer user_data)
+{
+	struct seel_se *se = user_data;
+	struct seel_apdu *get_cplc_data;
+	int err;
 
-		if (!memcmp(rule->aid, aid, aid_len) &&
-				!memcmp(rule->hash, hash, APP_HASH_LEN)) {
-			dump_rule(rule, NULL);
-			return rule;
-		}
+	DBG("");
+
+	/* Before selecting the ARA-M, while the ISD is still selected */
+	get_cplc_data = __seel_apdu_get_cplc_data();
+	if (!get_cplc_data) {
+		select_gp_aid(se);
+		return FALSE;
 	}
 
-	return NULL;
+	err = __seel_se_queue_io(se, get_cplc_data, get_cplc_data_cb, se);
+	if (err < 0)
+		near_error("GET CPLC DATA err %d", err);
+
+	return FALSE;
 }
 
-static bool find_specific_rule_for_aid(struct seel_ace *ace,
-					uint8_t *aid, size_t aid_len)
+int __seel_ace_remove(struct seel_se *se)
 {
-	GSList *list;
-
-	DBG("%zu", aid_len);
-
-	if (!aid)
-		return false;
-
-	for (list = ace->rules; list; list = list->next) {
-		struct seel_ace_rule *rule = list->data;
+	DBG("%p", se);
 
-		if (rule->aid_len != aid_len)
-			continue;
+	g_hash_table_remove(card_hash, se);
 
-		if (rule->hash_len != APP_HASH_LEN)
-			continue;
+	if (!g_hash_table_remove(ace_hash, se))
+		return -ENODEV;
 
-		if (!memcmp(rule->aid, aid, aid_len)) {
-			dump_rule(rule, NULL);
-			return true;
-		}
-	}
+	ace_generation++;
 
-	return false;
+	return 0;
 }
 
-static struct seel_ace_rule *find_generic_rule_for_aid(struct seel_ace *ace,
-						uint8_t *aid, size_t aid_len)
-
+/*
+ * Returns the rule deciding access for an application hash on an AID,
+ * NULL if access is denied.
+ */
+static struct seel_ace_rule *ace_resolve(struct seel_ace *ace,
+					uint8_t *aid, size_t aid_len,
+					uint8_t *hash)
 {
-	GSList *list;
+	struct seel_ace_rule *rule;
 
 	DBG("%zu", aid_len);
 
-	if (!aid)
-		return false;
-
-	for (list = ace->rules; list; list = list->next) {
-		struct seel_ace_rule *rule = list->data;
-
-		if (rule->aid_len != aid_len)
-			continue;
-
-		/* This is a specific rule */
-		if (rule->hash_len)
-			continue;
-
-		if (!memcmp(rule->aid, aid, aid_len)) {
-			dump_rule(rule, NULL);
-			return rule;
-		}
+	/* a) Try to find a specific rule */
+	if (hash) {
+		rule = ace_index_lookup(ace, aid, aid_len, hash, APP_HASH_LEN);
+		if (rule)
+			goto found;
 	}
 
-	return NULL;
-}
-
-static struct seel_ace_rule *find_generic_rule_for_hash(struct seel_ace *ace,
-								uint8_t *hash)
-{
-	GSList *list;
+	/*
+	 * a') Try to find a specific rule for another hash
+	 * If there is such a rule, then access is denied for the
+	 * current hash: Specific rule precedence over generic ones.
+	 */
+	rule = ace_index_lookup(ace, aid, aid_len, NULL, ACE_ANY_HASH);
+	if (rule) {
+		dump_rule(rule, NULL);
+		return NULL;
+	}
 
-	DBG("");
+	/* b) Search for a generic rule for this specific AID */
+	rule = ace_index_lookup(ace, aid, aid_len, NULL, 0);
+	if (rule)
+		goto found;
 
-	if (!hash)
-		return false;
+	/* c) Search for a generic rule for this specific hash */
+	if (hash) {
+		rule = ace_index_lookup(ace, NULL, 0, hash, APP_HASH_LEN);
+		if (rule)
+			goto found;
+	}
 
-	for (list = ace->rules; list; list = list->next) {
-		struct seel_ace_rule *rule = list->data;
+	/* d) Search for a generic rule: All apps, all AIDs */
+	rule = ace_index_lookup(ace, NULL, 0, NULL, 0);
+	if (!rule)
+		return NULL;
 
-		/* This is a generic hash rule */
-		if (rule->hash_len != APP_HASH_LEN)
-			continue;
+found:
+	dump_rule(rule, NULL);
 
-		/* This is a specific AID rule */
-		if (rule->aid_len)
-			continue;
+	return rule;
+}
 
-		if (!memcmp(rule->hash, hash, APP_HASH_LEN)) {
-			dump_rule(rule, NULL);
-			return rule;
-		}
-	}
+static void free_decision(gpointer data)
+{
+	struct ace_decision *decision = data;
 
-	return NULL;
+	g_free(decision->headers);
+	g_free(decision->masks);
+	g_free(decision);
 }
 
-static struct seel_ace_rule *find_generic_rule(struct seel_ace *ace)
+static int decision_add_rule(struct ace_decision *decision,
+					struct seel_ace_rule *rule)
 {
-	GSList *list;
-
-	DBG("");
+	uint32_t *headers, *masks;
+	size_t n_filters;
 
-	for (list = ace->rules; list; list = list->next) {
-		struct seel_ace_rule *rule = list->data;
+	if (rule->apdu_always) {
+		decision->allow_all = true;
+		return 0;
+	}
 
-		if (rule->hash_len || rule->aid_len)
-			continue;
+	if (!rule->apdu_filters)
+		return 0;
 
-		dump_rule(rule, NULL);
-		return rule;
-	}
+	n_filters = decision->n_filters + rule->apdu_filters;
 
-	return NULL;
-}
+	headers = g_try_renew(uint32_t, decision->headers, n_filters);
+	if (!headers)
+		return -ENOMEM;
 
-static bool apdu_allowed(struct seel_ace_rule *rule,
-				uint8_t *apdu, size_t apdu_len)
-{
-	size_t i, n_rules;
-	uint32_t apdu_header;
-	struct seel_ace_apdu_rule *apdu_rule;
+	decision->headers = headers;
 
-	if (rule->apdu_rules_len == 1)
-		return rule->apdu_rules[0] ? true : false;
+	masks = g_try_renew(uint32_t, decision->masks, n_filters);
+	if (!masks)
+		return -ENOMEM;
 
-	n_rules = rule->apdu_rules_len /
-				sizeof(struct seel_ace_apdu_rule);
-	/*
-	 * FIXME: apdu comes from message and where is checking for apdu_len?
-	 * The (void *) is to fix -Wcast-align but the actual problem is
-	 * whether the apdu contains enough of data.
-	 */
-	apdu_header = *((uint32_t *)(void *) apdu);
-	/*
-	 * (void *) to silence -Wcast-align. Code should be safe
-	 * (assuming platform handles unaliagned access) as iterations
-	 * go up to n_rules.
-	 *
-	 * TODO: Fix the problem instead of silencing with cast, so
-	 * the code would be porable.
-	 */
-	apdu_rule = (struct seel_ace_apdu_rule *)(void *)rule->apdu_rules;
+	decision->masks = masks;
 
-	for (i = 0; i < n_rules; i++) {
-		if ((apdu_header & apdu_rule->mask) == apdu_rule->header)
-			return true;
+	memcpy(headers + decision->n_filters, rule->apdu_headers,
+				rule->apdu_filters * sizeof(uint32_t));
+	memcpy(masks + decision->n_filters, rule->apdu_masks,
+				rule->apdu_filters * sizeof(uint32_t));
 
-		apdu_rule++;
-	}
+	decision->n_filters = n_filters;
 
-	return false;
+	return 0;
 }
 
-bool __seel_ace_apdu_allowed(struct seel_channel *channel, uint8_t *hash,
-				uint8_t *apdu, size_t apdu_len)
+static struct ace_decision *resolve_decision(struct seel_channel *channel,
+							const char *owner)
 {
+	struct ace_decision *decision;
+	struct seel_ace_rule *rule;
+	const GSList *hashes, *list;
 	struct seel_se *se;
 	struct seel_ace *ace;
-	struct seel_ace_rule *rule;
 	uint8_t *aid;
 	size_t aid_len;
 
-	DBG("%zu", apdu_len);
+	DBG("%s", owner);
 
-	/* XXX Do we need to do some filtering on the basic channel ?*/
-	if (__seel_channel_is_basic(channel))
-	   return true;
+	decision = g_try_malloc0(sizeof(struct ace_decision));
+	if (!decision)
+		return NULL;
+
+	decision->generation = ace_generation;
 
 	se = __seel_channel_get_se(channel);
 	if (!se)
-		return false;
+		return decision;
 
-	ace = g_hash_table_lookup(ace_hash, se);
-	if (!ace)
-		return false;
+	/* Not known yet, nothing to decide on */
+	if (!__seel_cert_lookup(owner, &hashes)) {
+		g_free(decision);
+		return NULL;
+	}
 
-	if (!ace->rules)
-		return false;
+	/* Callers without any application hash are never granted access */
+	if (!hashes)
+		return decision;
+
+	/* XXX Do we need to do some filtering on the basic channel ?*/
+	if (__seel_channel_is_basic(channel)) {
+		decision->allow_all = true;
+		return decision;
+	}
+
+	ace = g_hash_table_lookup(ace_hash, se);
+	if (!ace || !ace->rules)
+		return decision;
 
 	/* Ref. GP SE Access Control specification, Chapter 4: Device Interface
 	 * If the secure element is a uicc, a device application can access an SE
@@ -866,38 +1235,118 @@ bool __seel_ace_apdu_allowed(struct seel_channel *channel, uint8_t *hash,
 	 * access.
 	 */
 	aid = __seel_channel_get_aid(channel, &aid_len);
-	if (!aid)
-		return __seel_se_get_type(se) != SEEL_SE_UICC;
+	if (!aid) {
+		decision->allow_all = __seel_se_get_type(se) != SEEL_SE_UICC;
+		return decision;
+	}
 
-	/* a) Try to find a specific rule */
-	rule = find_specific_rule(ace, aid, aid_len, hash);
-	if (rule)
-		return apdu_allowed(rule, apdu, apdu_len) ? true : false;
+	for (list = hashes; list; list = list->next) {
+		rule = ace_resolve(ace, aid, aid_len, list->data);
+		if (!rule)
+			continue;
 
-	/*
-	 * a') Try to find a specific rule for another hash
-	 * If there is such a rule, then access is denied for the
-	 * current hash: Specific rule precedence over generic ones.
-	 */
-	if (find_specific_rule_for_aid(ace, aid, aid_len))
-		return false;
+		if (decision_add_rule(decision, rule) < 0) {
+			free_decision(decision);
+			return NULL;
+		}
 
-	/* b) Search for a generic rule for this specific AID */
-	rule = find_generic_rule_for_aid(ace, aid, aid_len);
-	if (rule)
-		return apdu_allowed(rule, apdu, apdu_len) ? true : false;
+		if (decision->allow_all)
+			break;
+	}
 
-	/* c) Search for a generic rule for this specific hash */
-	rule = find_generic_rule_for_hash(ace, hash);
-	if (rule)
-		return apdu_allowed(rule, apdu, apdu_len) ? true : false;
+	return decision;
+}
 
-	/* d) Search for a generic rule: All apps, all AIDs */
-	rule = find_generic_rule(ace);
-	if (rule)
-		return apdu_allowed(rule, apdu, apdu_len) ? true : false;
+static struct ace_decision *lookup_decision(struct seel_channel *channel,
+							const char *owner)
+{
+	struct seel_ace_cache *cache;
+	struct ace_decision *decision;
+
+	cache = __seel_channel_get_ace_cache(channel);
+	if (!cache || !owner)
+		return NULL;
+
+	decision = g_hash_table_lookup(cache->decisions, owner);
+	if (decision && decision->generation == ace_generation)
+		return decision;
+
+	decision = resolve_decision(channel, owner);
+	if (!decision)
+		return NULL;
+
+	g_hash_table_replace(cache->decisions, g_strdup(owner), decision);
+
+	return decision;
+}
+
+struct seel_ace_cache *__seel_ace_cache_new(void)
+{
+	struct seel_ace_cache *cache;
+
+	cache = g_try_malloc0(sizeof(struct seel_ace_cache));
+	if (!cache)
+		return NULL;
+
+	cache->decisions = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, free_decision);
+
+	return cache;
+}
+
+void __seel_ace_cache_free(struct seel_ace_cache *cache)
+{
+	if (!cache)
+		return;
 
-	return false;
+	g_hash_table_destroy(cache->decisions);
+	g_free(cache);
+}
+
+/*
+ * Resolve the access decision of a channel opener up front, so that
+ * its APDUs only go through the filter match. Callers must have had
+ * their hashes resolved, see __seel_cert_get_hashes().
+ */
+void __seel_ace_resolve(struct seel_channel *channel, const char *owner)
+{
+	lookup_decision(channel, owner);
+}
+
+/*
+ * Branch free on purpose: the filters are packed in two arrays and
+ * every one of them is checked, which compilers turn into SIMD code.
+ */
+static bool match_filters(const uint32_t *headers, const uint32_t *masks,
+					size_t n_filters, uint32_t apdu_header)
+{
+	uint32_t match = 0;
+	size_t i;
+
+	for (i = 0; i < n_filters; i++)
+		match |= (apdu_header & masks[i]) == headers[i];
+
+	return match != 0;
+}
+
+bool __seel_ace_apdu_allowed(struct seel_channel *channel, const char *owner,
+				uint8_t *apdu, size_t apdu_len)
+{
+	struct ace_decision *decision;
+
+	decision = lookup_decision(channel, owner);
+	if (!decision)
+		return false;
+
+	if (decision->allow_all)
+		return true;
+
+	/* Filters need at least CLA, INS, P1 and P2 */
+	if (!apdu || apdu_len < APDU_HEADER_LEN)
+		return false;
+
+	return match_filters(decision->headers, decision->masks,
+				decision->n_filters, get_be32(apdu));
 }
 
 int __seel_ace_init(void)
@@ -906,6 +1355,8 @@ int __seel_ace_init(void)
 
 	ace_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
 							NULL, free_ace);
+	card_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+							NULL, g_free);
 	return 0;
 }
 
@@ -915,4 +1366,7 @@ void __seel_ace_cleanup(void)
 
 	g_hash_table_destroy(ace_hash);
 	ace_hash = NULL;
+
+	g_hash_table_destroy(card_hash);
+	card_hash = NULL;
 }
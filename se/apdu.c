@@ -40,10 +40,23 @@ struct iso7816_apdu_resp {
 	uint8_t sw2;
 } __attribute__((packed));
 
+/*
+ * Short APDUs (CLA INS P1 P2 Lc, up to 255 data bytes, Le) fit in a
+ * pooled buffer. Longer ones fall back to the heap.
+ */
+#define APDU_SHORT_MAX_LENGTH (4 + 1 + 255 + 1)
+
+/* Enough for a full command queue on every channel of a few SEs */
+#define APDU_POOL_SIZE 64
+
 struct seel_apdu {
 	struct iso7816_apdu *apdu;
 	size_t length;
-} __attribute__((packed));
+
+	bool pooled;
+	struct seel_apdu *next;	/* free list link */
+	uint8_t buf[APDU_SHORT_MAX_LENGTH];
+};
 
 #define MAX_AID_LENGTH 16
 #define MIN_AID_LENGTH 5
@@ -63,54 +76,85 @@ struct seel_apdu {
 
 #define CLA_CHANNEL_MASK 0xFF
 
-static struct seel_apdu *alloc_apdu(uint8_t class, uint8_t channel,
-				uint8_t instruction,
-				uint8_t param1, uint8_t param2,
-				uint8_t data_length, uint8_t *data,
-				int resp_length)
+/* Internal commands, variable bytes get patched after the copy */
+static const uint8_t open_channel_tmpl[] = {
+	CLA_CHANNEL_STANDARD, INS_MANAGE_CHANNEL, 0x00, 0x00, 0x01
+};
+
+static const uint8_t close_channel_tmpl[] = {
+	CLA_CHANNEL_STANDARD, INS_MANAGE_CHANNEL, 0x80, 0x00
+};
+
+static const uint8_t select_aid_tmpl[] = {
+	CLA_CHANNEL_STANDARD, INS_SELECT_FILE, P1_SELECT_FILE_DF_NAME, 0x00,
+	0x00
+};
+
+static const uint8_t get_all_gp_data_tmpl[] = {
+	CLA_PROPRIETARY_CMD, INS_GET_GP_DATA, 0xFF, 0x40, 0x00
+};
+
+static const uint8_t get_next_gp_data_tmpl[] = {
+	CLA_PROPRIETARY_CMD, INS_GET_GP_DATA, 0xFF, 0x60, 0x00
+};
+
+static const uint8_t get_refresh_gp_data_tmpl[] = {
+	CLA_PROPRIETARY_CMD, INS_GET_GP_DATA, 0xDF, 0x20, 0x0B
+};
+
+static const uint8_t get_cplc_data_tmpl[] = {
+	CLA_PROPRIETARY_CMD, INS_GET_GP_DATA, 0x9F, 0x7F, 0x00
+};
+
+static struct seel_apdu apdu_pool[APDU_POOL_SIZE];
+static struct seel_apdu *apdu_free_list;
+static unsigned int apdu_pool_used;
+
+static struct seel_apdu *apdu_get(size_t length)
 {
 	struct seel_apdu *apdu;
-	struct iso7816_apdu *iso_apdu;
-	size_t iso_apdu_length;
-	uint32_t body_ptr;
 
-	if (channel > 3)
-		return NULL;
+	if (length <= APDU_SHORT_MAX_LENGTH && apdu_free_list) {
+		apdu = apdu_free_list;
+		apdu_free_list = apdu->next;
+		apdu_pool_used++;
+	} else {
+		DBG("Pool miss, length %zu used %u", length, apdu_pool_used);
 
-	apdu = g_try_malloc(sizeof(struct seel_apdu));
-	if (apdu == NULL)
-		return apdu;
+		apdu = g_try_malloc(sizeof(struct seel_apdu));
+		if (!apdu)
+			return NULL;
+
+		apdu->pooled = false;
+	}
 
-	iso_apdu_length = sizeof(struct iso7816_apdu);
-	if (data_length > 0)
-		iso_apdu_length += 1 + data_length;
+	apdu->next = NULL;
+	apdu->length = length;
 
-	if (resp_length >= 0)
-		iso_apdu_length += 1;
+	if (length <= APDU_SHORT_MAX_LENGTH) {
+		apdu->apdu = (struct iso7816_apdu *) apdu->buf;
+		return apdu;
+	}
 
-	apdu->apdu = g_try_malloc(iso_apdu_length);
-	if (apdu->apdu == NULL) {
-		g_free(apdu);
+	apdu->apdu = g_try_malloc(length);
+	if (!apdu->apdu) {
+		__seel_apdu_free(apdu);
 		return NULL;
 	}
 
-	iso_apdu = apdu->apdu;
-	iso_apdu->class = class | channel;
-	iso_apdu->instruction = instruction;
-	iso_apdu->param1 = param1;
-	iso_apdu->param2 = param2;
-
-	body_ptr = 0;
-	if (data_length > 0) {
-		iso_apdu->body[0] = data_length;
-		memcpy(&iso_apdu->body[1], data, data_length);
-		body_ptr += data_length + 1;
-	}
+	return apdu;
+}
 
-	if (resp_length >= 0)
-		iso_apdu->body[body_ptr] = resp_length;
+static struct seel_apdu *apdu_from_template(const uint8_t *tmpl,
+							size_t length)
+{
+	struct seel_apdu *apdu;
 
-	apdu->length = iso_apdu_length;
+	apdu = apdu_get(length);
+	if (!apdu)
+		return NULL;
+
+	memcpy(apdu->apdu, tmpl, length);
 
 	return apdu;
 }
@@ -120,29 +164,23 @@ struct seel_apdu *__seel_apdu_build(uint8_t *apdu, size_t length, uint8_t channe
 	struct seel_apdu *_apdu;
 	struct iso7816_apdu *iso_apdu;
 
-	_apdu = g_try_malloc(sizeof(struct seel_apdu));
+	_apdu = apdu_get(length);
 	if (!_apdu)
 		return NULL;
 
-	_apdu->apdu = g_try_malloc(length);
-	if (_apdu->apdu == NULL) {
-		g_free(_apdu);
-		return NULL;
-	}
-
 	if (channel > 3) {
 		DBG("Invalid channel number %u", channel);
 		channel = 0;
 	}
 
-	iso_apdu = (struct iso7816_apdu *) apdu;
+	/* The caller buffer is left untouched */
+	memcpy(_apdu->apdu, apdu, length);
+
+	iso_apdu = _apdu->apdu;
 	/* We add the channel iff CLA is not PPS */
 	if ((iso_apdu->class & CLA_PPS_CMD) != CLA_PPS_CMD)
 		iso_apdu->class |= channel;
 
-	_apdu->length = length;
-	memcpy(_apdu->apdu, apdu, length);
-
 	return _apdu;
 }
 
@@ -166,8 +204,17 @@ void __seel_apdu_dump(uint8_t *apdu, size_t length)
 
 void __seel_apdu_free(struct seel_apdu *apdu)
 {
-	g_free(apdu->apdu);
-	g_free(apdu);
+	if ((uint8_t *) apdu->apdu != apdu->buf)
+		g_free(apdu->apdu);
+
+	if (!apdu->pooled) {
+		g_free(apdu);
+		return;
+	}
+
+	apdu->next = apdu_free_list;
+	apdu_free_list = apdu;
+	apdu_pool_used--;
 }
 
 size_t __seel_apdu_length(struct seel_apdu *apdu)
@@ -182,54 +229,108 @@ uint8_t *__seel_apdu_data(struct seel_apdu *apdu)
 
 struct seel_apdu *__seel_apdu_open_logical_channel(void)
 {
-	return alloc_apdu(CLA_CHANNEL_STANDARD, 0, INS_MANAGE_CHANNEL, 0, 0,
-								0, NULL, 1);
+	return apdu_from_template(open_channel_tmpl,
+					sizeof(open_channel_tmpl));
 }
 
 struct seel_apdu *__seel_apdu_close_logical_channel(uint8_t channel)
 {
+	struct seel_apdu *apdu;
+
 	DBG("%u", channel);
 
-	return alloc_apdu(CLA_CHANNEL_STANDARD, 0, INS_MANAGE_CHANNEL, 0x80,
-							channel, 0, NULL, -1);
+	apdu = apdu_from_template(close_channel_tmpl,
+					sizeof(close_channel_tmpl));
+	if (apdu)
+		apdu->apdu->param2 = channel;
+
+	return apdu;
 }
 
 struct seel_apdu *__seel_apdu_select_aid(uint8_t channel,
 						uint8_t *aid, size_t aid_length)
 {
+	struct seel_apdu *apdu;
+
 	DBG("%zu", aid_length);
 
 	if (aid_length < MIN_AID_LENGTH ||
 			aid_length > MAX_AID_LENGTH)
 		return NULL;
 
-	return alloc_apdu(CLA_CHANNEL_STANDARD, channel, INS_SELECT_FILE,
-					P1_SELECT_FILE_DF_NAME, 0,
-					aid_length, aid, -1);
+	if (channel > 3)
+		return NULL;
+
+	apdu = apdu_get(sizeof(select_aid_tmpl) + aid_length);
+	if (!apdu)
+		return NULL;
+
+	memcpy(apdu->apdu, select_aid_tmpl, sizeof(select_aid_tmpl));
+	memcpy(apdu->apdu->body + 1, aid, aid_length);
+	apdu->apdu->class |= channel;
+	apdu->apdu->body[0] = aid_length;
+
+	return apdu;
 }
 
 struct seel_apdu *__seel_apdu_get_all_gp_data(void)
 {
 	DBG("");
 
-	return alloc_apdu(CLA_PROPRIETARY_CMD, 0, INS_GET_GP_DATA,
-						0xFF, 0x40, 0, NULL, 0);
+	return apdu_from_template(get_all_gp_data_tmpl,
+					sizeof(get_all_gp_data_tmpl));
 }
 
 struct seel_apdu *__seel_apdu_get_next_gp_data(size_t length)
 {
+	struct seel_apdu *apdu;
+
 	DBG("");
 
-	return alloc_apdu(CLA_PROPRIETARY_CMD, 0, INS_GET_GP_DATA,
-						0xFF, 0x60, 0, NULL, length);
+	apdu = apdu_from_template(get_next_gp_data_tmpl,
+					sizeof(get_next_gp_data_tmpl));
+	if (apdu)
+		apdu->apdu->body[0] = length;
+
+	return apdu;
 }
 
 struct seel_apdu *__seel_apdu_get_refresh_gp_data(void)
 {
 	DBG("");
 
-	return alloc_apdu(CLA_PROPRIETARY_CMD, 0, INS_GET_GP_DATA,
-						0xDF, 0x20, 0, NULL, 0xB);
+	return apdu_from_template(get_refresh_gp_data_tmpl,
+					sizeof(get_refresh_gp_data_tmpl));
+}
+
+struct seel_apdu *__seel_apdu_get_cplc_data(void)
+{
+	DBG("");
+
+	return apdu_from_template(get_cplc_data_tmpl,
+					sizeof(get_cplc_data_tmpl));
+}
+
+int __seel_apdu_init(void)
+{
+	int i;
+
+	DBG("");
+
+	for (i = APDU_POOL_SIZE - 1; i >= 0; i--) {
+		apdu_pool[i].pooled = true;
+		apdu_pool[i].next = apdu_free_list;
+		apdu_free_list = &apdu_pool[i];
+	}
+
+	return 0;
+}
+
+void __seel_apdu_cleanup(void)
+{
+	DBG("%u pooled APDUs in use", apdu_pool_used);
+
+	apdu_free_list = NULL;
 }
 
 static int apdu_trailer_status(struct iso7816_apdu_resp *trailer)
@@ -0,0 +1,309 @@
+/*
+ *
+ *  seeld - Secure Element Manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <gdbus.h>
+
+#include "driver.h"
+#include "seel.h"
+
+/*
+ * Application certificate hashes of D-Bus callers, keyed by unique name.
+ * Unique names are never reused, so an entry stays valid until its owner
+ * leaves the bus.
+ */
+struct cert_entry {
+	char *owner;
+	bool resolved;
+	const GSList *hashes;	/* owned by the cert driver */
+
+	DBusPendingCall *call;
+	bool hashing;
+	guint watch;
+
+	GSList *waiters;
+};
+
+struct cert_waiter {
+	seel_cert_cb_t cb;
+	void *user_data;
+};
+
+static DBusConnection *connection;
+static GHashTable *cert_hash;
+
+static void cert_entry_cancel(struct cert_entry *entry)
+{
+	struct seel_cert_driver *driver;
+
+	if (entry->call) {
+		dbus_pending_call_cancel(entry->call);
+		dbus_pending_call_unref(entry->call);
+		entry->call = NULL;
+	}
+
+	if (entry->hashing) {
+		driver = __seel_driver_cert_get();
+		if (driver && driver->cancel_hashes)
+			driver->cancel_hashes(entry);
+
+		entry->hashing = false;
+	}
+}
+
+static void cert_entry_free(gpointer data)
+{
+	struct cert_entry *entry = data;
+
+	DBG("%s", entry->owner);
+
+	cert_entry_cancel(entry);
+
+	if (entry->watch)
+		g_dbus_remove_watch(connection, entry->watch);
+
+	g_slist_free_full(entry->waiters, g_free);
+	g_free(entry->owner);
+	g_free(entry);
+}
+
+static void cert_entry_resolved(struct cert_entry *entry,
+						const GSList *hashes)
+{
+	GSList *waiters, *list;
+
+	DBG("%s %u hashes", entry->owner, g_slist_length((GSList *) hashes));
+
+	entry->hashes = hashes;
+	entry->resolved = true;
+
+	/* Callbacks may look the entry up again */
+	waiters = entry->waiters;
+	entry->waiters = NULL;
+
+	for (list = waiters; list; list = list->next) {
+		struct cert_waiter *waiter = list->data;
+
+		waiter->cb(entry->owner, entry->hashes, waiter->user_data);
+	}
+
+	g_slist_free_full(waiters, g_free);
+}
+
+static void cert_hashes_cb(const GSList *hashes, void *user_data)
+{
+	struct cert_entry *entry = user_data;
+
+	entry->hashing = false;
+
+	cert_entry_resolved(entry, hashes);
+}
+
+static void cert_entry_hash(struct cert_entry *entry, pid_t pid)
+{
+	struct seel_cert_driver *driver;
+
+	DBG("%s pid %d", entry->owner, pid);
+
+	driver = __seel_driver_cert_get();
+	if (!driver || pid <= 0) {
+		cert_entry_resolved(entry, NULL);
+		return;
+	}
+
+	/* Drivers may answer from their cache before returning */
+	entry->hashing = true;
+
+	if (driver->get_hashes(pid, cert_hashes_cb, entry) < 0) {
+		entry->hashing = false;
+		cert_entry_resolved(entry, NULL);
+	}
+}
+
+static void get_pid_reply(DBusPendingCall *call, void *user_data)
+{
+	struct cert_entry *entry = user_data;
+	DBusMessage *reply;
+	DBusError error;
+	dbus_uint32_t pid = 0;
+
+	reply = dbus_pending_call_steal_reply(call);
+
+	dbus_pending_call_unref(entry->call);
+	entry->call = NULL;
+
+	dbus_error_init(&error);
+
+	if (dbus_set_error_from_message(&error, reply)) {
+		near_error("%s: %s", entry->owner, error.message);
+		dbus_error_free(&error);
+	} else if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &pid,
+							DBUS_TYPE_INVALID)) {
+		pid = 0;
+	}
+
+	dbus_message_unref(reply);
+
+	cert_entry_hash(entry, pid);
+}
+
+static void owner_disconnect(DBusConnection *conn, void *user_data)
+{
+	struct cert_entry *entry = user_data;
+
+	DBG("%s", entry->owner);
+
+	/* The watch goes away by itself */
+	entry->watch = 0;
+
+	/* Let pending requests fail instead of leaking them */
+	if (!entry->resolved) {
+		cert_entry_cancel(entry);
+		cert_entry_resolved(entry, NULL);
+	}
+
+	g_hash_table_remove(cert_hash, entry->owner);
+}
+
+static int cert_entry_resolve(struct cert_entry *entry)
+{
+	DBusMessage *msg;
+
+	msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+						DBUS_INTERFACE_DBUS,
+						"GetConnectionUnixProcessID");
+	if (!msg)
+		return -ENOMEM;
+
+	dbus_message_append_args(msg, DBUS_TYPE_STRING, &entry->owner,
+							DBUS_TYPE_INVALID);
+
+	if (!dbus_connection_send_with_reply(connection, msg,
+						&entry->call, -1) ||
+							!entry->call) {
+		dbus_message_unref(msg);
+		return -EIO;
+	}
+
+	dbus_pending_call_set_notify(entry->call, get_pid_reply, entry, NULL);
+
+	dbus_message_unref(msg);
+
+	return 0;
+}
+
+bool __seel_cert_lookup(const char *owner, const GSList **hashes)
+{
+	struct cert_entry *entry;
+
+	if (!owner)
+		return false;
+
+	entry = g_hash_table_lookup(cert_hash, owner);
+	if (!entry || !entry->resolved)
+		return false;
+
+	*hashes = entry->hashes;
+
+	return true;
+}
+
+int __seel_cert_get_hashes(const char *owner, seel_cert_cb_t cb,
+							void *user_data)
+{
+	struct cert_entry *entry;
+	struct cert_waiter *waiter;
+	int err;
+
+	if (!owner)
+		return -EINVAL;
+
+	entry = g_hash_table_lookup(cert_hash, owner);
+	if (entry && entry->resolved) {
+		if (cb)
+			cb(owner, entry->hashes, user_data);
+
+		return 0;
+	}
+
+	if (!entry) {
+		entry = g_try_malloc0(sizeof(struct cert_entry));
+		if (!entry)
+			return -ENOMEM;
+
+		entry->owner = g_strdup(owner);
+
+		err = cert_entry_resolve(entry);
+		if (err < 0) {
+			g_free(entry->owner);
+			g_free(entry);
+			return err;
+		}
+
+		entry->watch = g_dbus_add_disconnect_watch(connection, owner,
+						owner_disconnect, entry, NULL);
+
+		g_hash_table_replace(cert_hash, entry->owner, entry);
+	}
+
+	if (!cb)
+		return 0;
+
+	waiter = g_try_malloc0(sizeof(struct cert_waiter));
+	if (!waiter)
+		return -ENOMEM;
+
+	waiter->cb = cb;
+	waiter->user_data = user_data;
+
+	entry->waiters = g_slist_append(entry->waiters, waiter);
+
+	return 0;
+}
+
+int __seel_cert_init(DBusConnection *conn)
+{
+	DBG("");
+
+	connection = dbus_connection_ref(conn);
+
+	cert_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+							NULL, cert_entry_free);
+
+	return 0;
+}
+
+void __seel_cert_cleanup(void)
+{
+	DBG("");
+
+	g_hash_table_destroy(cert_hash);
+	cert_hash = NULL;
+
+	dbus_connection_unref(connection);
+}
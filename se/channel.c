@@ -40,14 +40,74 @@ struct seel_channel {
 	uint8_t *aid;
 	size_t aid_len;
 	bool basic;
+	char *owner;	/* OpenChannel() caller, NULL for the basic channel */
+	enum seel_io_priority priority;
+
+	struct seel_ace_cache *ace_cache;
+
+	/* Held by requests waiting for the caller hashes */
+	int refcount;
+	bool removed;
 };
 
+static struct seel_channel *channel_ref(struct seel_channel *channel)
+{
+	channel->refcount++;
+
+	return channel;
+}
+
+static void channel_unref(struct seel_channel *channel)
+{
+	if (--channel->refcount > 0)
+		return;
+
+	__seel_ace_cache_free(channel->ace_cache);
+
+	g_free(channel->path);
+	g_free(channel->aid);
+	g_free(channel->owner);
+	g_free(channel);
+}
+
+static const char *priority_to_string(enum seel_io_priority priority)
+{
+	switch (priority) {
+	case SEEL_IO_PRIORITY_HIGH:
+		return "high";
+	case SEEL_IO_PRIORITY_LOW:
+		return "low";
+	case SEEL_IO_PRIORITY_NORMAL:
+	case SEEL_IO_PRIORITY_CONTROL:
+	case SEEL_IO_PRIORITY_MAX:
+		break;
+	}
+
+	return "normal";
+}
+
+static int string_to_priority(const char *str,
+					enum seel_io_priority *priority)
+{
+	if (g_str_equal(str, "high"))
+		*priority = SEEL_IO_PRIORITY_HIGH;
+	else if (g_str_equal(str, "normal"))
+		*priority = SEEL_IO_PRIORITY_NORMAL;
+	else if (g_str_equal(str, "low"))
+		*priority = SEEL_IO_PRIORITY_LOW;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
 static DBusMessage *get_properties(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
 	struct seel_channel *channel = data;
 	DBusMessage *reply;
 	DBusMessageIter array, dict;
+	const char *priority;
 
 	DBG("conn %p", conn);
 
@@ -65,11 +125,68 @@ static DBusMessage *get_properties(DBusConnection *conn,
 	near_dbus_dict_append_fixed_array(&dict, "AID", DBUS_TYPE_BYTE,
 						&channel->aid, channel->aid_len);
 
+	priority = priority_to_string(channel->priority);
+	near_dbus_dict_append_basic(&dict, "Priority",
+					DBUS_TYPE_STRING, &priority);
+
 	near_dbus_dict_close(&array, &dict);
 
 	return reply;
 }
 
+static DBusMessage *set_property(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct seel_channel *channel = data;
+	DBusMessageIter iter, value;
+	enum seel_io_priority priority;
+	const char *name, *str;
+	int type;
+
+	DBG("conn %p", conn);
+
+	/* Only the channel owner may change it, the basic one is shared */
+	if (!channel->owner || g_strcmp0(channel->owner,
+					dbus_message_get_sender(msg)) != 0)
+		return __near_error_permission_denied(msg);
+
+	if (dbus_message_iter_init(msg, &iter) == FALSE)
+		return __near_error_invalid_arguments(msg);
+
+	dbus_message_iter_get_basic(&iter, &name);
+	dbus_message_iter_next(&iter);
+	dbus_message_iter_recurse(&iter, &value);
+
+	type = dbus_message_iter_get_arg_type(&value);
+
+	if (g_str_equal(name, "Priority") == TRUE) {
+		if (type != DBUS_TYPE_STRING)
+			return __near_error_invalid_arguments(msg);
+
+		dbus_message_iter_get_basic(&value, &str);
+
+		if (string_to_priority(str, &priority) < 0)
+			return __near_error_invalid_arguments(msg);
+
+		/* Also applies to the APDUs already queued */
+		if (channel->priority != priority) {
+			channel->priority = priority;
+
+			__seel_se_set_lane(channel->se, channel->channel,
+								priority);
+
+			near_dbus_property_changed_basic(channel->path,
+						SEEL_CHANNEL_INTERFACE,
+						"Priority", DBUS_TYPE_STRING,
+						&str);
+		}
+	} else {
+		return __near_error_invalid_property(msg);
+	}
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
+}
+
 static void send_apdu_cb(void *context,
 			uint8_t *apdu, size_t apdu_length,
 			int err)
@@ -100,16 +217,90 @@ static void send_apdu_cb(void *context,
 	DBG("");
 }
 
+/*
+ * Requests wait for the caller certificate hashes before going through
+ * the access control, see __seel_cert_get_hashes().
+ */
+struct channel_request {
+	struct seel_channel *channel;
+	DBusMessage *msg;
+	void *data;
+};
+
+static struct channel_request *channel_request_new(
+					struct seel_channel *channel,
+					DBusMessage *msg, void *data)
+{
+	struct channel_request *req;
+
+	req = g_try_malloc0(sizeof(struct channel_request));
+	if (!req)
+		return NULL;
+
+	req->channel = channel_ref(channel);
+	req->msg = dbus_message_ref(msg);
+	req->data = data;
+
+	return req;
+}
+
+static void channel_request_free(struct channel_request *req)
+{
+	dbus_message_unref(req->msg);
+	channel_unref(req->channel);
+	g_free(req);
+}
+
+static void channel_request_error(struct channel_request *req,
+							DBusMessage *reply)
+{
+	g_dbus_send_message(near_dbus_get_connection(), reply);
+	channel_request_free(req);
+}
+
+static void send_apdu_hashes_cb(const char *owner, const GSList *hashes,
+							void *user_data)
+{
+	struct channel_request *req = user_data;
+	struct seel_channel *channel = req->channel;
+	struct seel_apdu *send_apdu;
+	uint8_t *apdu;
+	size_t apdu_len;
+	int err;
+
+	if (channel->removed)
+		return channel_request_error(req,
+				__near_error_failed(req->msg, ENODEV));
+
+	dbus_message_get_args(req->msg, NULL, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE,
+					&apdu, &apdu_len, DBUS_TYPE_INVALID);
+
+	if (!__seel_ace_apdu_allowed(channel, owner, apdu, apdu_len)) {
+		near_error("*** APDU not allowed ***");
+		return channel_request_error(req,
+				__near_error_permission_denied(req->msg));
+	}
+
+	send_apdu = __seel_apdu_build(apdu, apdu_len, channel->channel);
+	if (!send_apdu)
+		return channel_request_error(req,
+				__near_error_out_of_memory(req->msg));
+
+	err = __seel_se_queue_channel_io(channel, send_apdu,
+				send_apdu_cb, dbus_message_ref(req->msg));
+	if (err < 0)
+		near_error("send apdu error %d", err);
+
+	channel_request_free(req);
+}
+
 static DBusMessage *send_apdu(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
 	struct seel_channel *channel = data;
-	DBusMessage *pending_msg;
-	struct seel_apdu *send_apdu;
-	uint8_t *apdu, *app_hash;
-	const GSList *app_hashes, *list;
+	struct channel_request *req;
+	uint8_t *apdu;
 	size_t apdu_len;
-	const char *sender;
 	int err;
 
 	DBG("conn %p", conn);
@@ -118,46 +309,348 @@ static DBusMessage *send_apdu(DBusConnection *conn,
 					&apdu, &apdu_len, DBUS_TYPE_INVALID))
 		return __near_error_invalid_arguments(msg);
 
-	sender = dbus_message_get_sender(msg);
-	app_hashes = __seel_se_get_hashes(channel->se, sender);
+	req = channel_request_new(channel, msg, NULL);
+	if (!req)
+		return __near_error_out_of_memory(msg);
+
+	err = __seel_cert_get_hashes(dbus_message_get_sender(msg),
+						send_apdu_hashes_cb, req);
+	if (err < 0) {
+		channel_request_free(req);
+		return __near_error_failed(msg, -err);
+	}
+
+	return NULL;
+}
+
+#define BATCH_MAX_APDUS		255
+#define APDU_SW_LEN		2
+
+struct apdu_batch_entry {
+	uint8_t *data;
+	size_t length;
+};
+
+/*
+ * The batch holds a channel reference, and stops as soon as the channel
+ * is closed so that no APDU goes to a reused logical channel.
+ */
+struct apdu_batch {
+	DBusMessage *msg;
+	struct seel_channel *channel;
+
+	uint16_t sw_expected;
+	uint16_t sw_mask;
+
+	/* APDUs point into msg, responses are ours */
+	struct apdu_batch_entry *apdus;
+	struct apdu_batch_entry *resps;
+	size_t count;
+	size_t current;
+};
+
+static void apdu_batch_free(struct apdu_batch *batch)
+{
+	size_t i;
+
+	for (i = 0; i < batch->current; i++)
+		g_free(batch->resps[i].data);
+
+	if (batch->channel)
+		channel_unref(batch->channel);
+
+	dbus_message_unref(batch->msg);
+	g_free(batch->apdus);
+	g_free(batch->resps);
+	g_free(batch);
+}
+
+static void apdu_batch_reply(struct apdu_batch *batch)
+{
+	DBusMessageIter iter, array, resp;
+	DBusMessage *reply;
+	size_t i;
+
+	DBG("%zu/%zu", batch->current, batch->count);
+
+	reply = dbus_message_new_method_return(batch->msg);
+	if (!reply)
+		goto out;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_ARRAY_AS_STRING
+					DBUS_TYPE_BYTE_AS_STRING, &array);
+
+	for (i = 0; i < batch->current; i++) {
+		dbus_message_iter_open_container(&array, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_BYTE_AS_STRING, &resp);
+		dbus_message_iter_append_fixed_array(&resp, DBUS_TYPE_BYTE,
+					&batch->resps[i].data,
+					batch->resps[i].length);
+		dbus_message_iter_close_container(&array, &resp);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	g_dbus_send_message(near_dbus_get_connection(), reply);
+
+out:
+	apdu_batch_free(batch);
+}
+
+static void apdu_batch_next(struct apdu_batch *batch);
+
+static void apdu_batch_cb(void *context,
+			uint8_t *apdu, size_t apdu_length,
+			int err)
+{
+	struct apdu_batch *batch = context;
+	struct apdu_batch_entry *resp;
+	uint16_t sw;
+
+	/* Non 9000 status words are checked against the batch options */
+	if (!apdu || apdu_length < APDU_SW_LEN) {
+		if (!err)
+			err = -EIO;
+
+		g_dbus_send_message(near_dbus_get_connection(),
+				__near_error_failed(batch->msg, -err));
+		apdu_batch_free(batch);
+		return;
+	}
+
+	resp = &batch->resps[batch->current];
+	resp->data = g_try_malloc(apdu_length);
+	if (!resp->data) {
+		g_dbus_send_message(near_dbus_get_connection(),
+				__near_error_failed(batch->msg, ENOMEM));
+		apdu_batch_free(batch);
+		return;
+	}
+
+	memcpy(resp->data, apdu, apdu_length);
+	resp->length = apdu_length;
+	batch->current++;
+
+	sw = apdu[apdu_length - 2] << 8 | apdu[apdu_length - 1];
+	if ((sw & batch->sw_mask) != (batch->sw_expected & batch->sw_mask)) {
+		DBG("Stopping on SW 0x%04x", sw);
+		apdu_batch_reply(batch);
+		return;
+	}
+
+	if (batch->current == batch->count) {
+		apdu_batch_reply(batch);
+		return;
+	}
+
+	apdu_batch_next(batch);
+}
+
+/* Failures end up in apdu_batch_cb(), which replies */
+static void apdu_batch_next(struct apdu_batch *batch)
+{
+	struct apdu_batch_entry *entry = &batch->apdus[batch->current];
+	struct seel_apdu *apdu;
+
+	if (batch->channel->removed) {
+		DBG("Channel closed after %zu APDUs", batch->current);
+		apdu_batch_cb(batch, NULL, 0, -ENODEV);
+		return;
+	}
+
+	apdu = __seel_apdu_build(entry->data, entry->length,
+						batch->channel->channel);
+	if (!apdu) {
+		apdu_batch_cb(batch, NULL, 0, -ENOMEM);
+		return;
+	}
+
+	__seel_se_queue_channel_io(batch->channel, apdu, apdu_batch_cb, batch);
+}
+
+static int parse_batch_options(DBusMessageIter *iter,
+					struct apdu_batch *batch)
+{
+	DBusMessageIter dict;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		if (dbus_message_iter_get_arg_type(&value) != DBUS_TYPE_UINT16)
+			return -EINVAL;
+
+		if (g_str_equal(key, "ExpectedStatus"))
+			dbus_message_iter_get_basic(&value,
+							&batch->sw_expected);
+		else if (g_str_equal(key, "StatusMask"))
+			dbus_message_iter_get_basic(&value, &batch->sw_mask);
+		else
+			return -EINVAL;
+
+		dbus_message_iter_next(&dict);
+	}
+
+	return 0;
+}
+
+static void send_apdu_batch_hashes_cb(const char *owner,
+					const GSList *hashes, void *user_data)
+{
+	struct channel_request *req = user_data;
+	struct seel_channel *channel = req->channel;
+	struct apdu_batch *batch = req->data;
+	size_t i;
+
+	if (channel->removed) {
+		channel_request_error(req,
+				__near_error_failed(req->msg, ENODEV));
+		apdu_batch_free(batch);
+		return;
+	}
+
+	/* Either the whole batch is allowed, or none of it */
+	for (i = 0; i < batch->count; i++) {
+		if (__seel_ace_apdu_allowed(channel, owner,
+						batch->apdus[i].data,
+						batch->apdus[i].length))
+			continue;
+
+		near_error("*** APDU %zu not allowed ***", i);
+		channel_request_error(req,
+				__near_error_permission_denied(req->msg));
+		apdu_batch_free(batch);
+		return;
+	}
+
+	batch->channel = channel_ref(channel);
+
+	channel_request_free(req);
+
+	DBG("%zu APDUs", batch->count);
+
+	apdu_batch_next(batch);
+}
+
+static DBusMessage *send_apdu_batch(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct seel_channel *channel = data;
+	DBusMessageIter iter, array, apdu;
+	struct channel_request *req;
+	struct apdu_batch *batch;
+	size_t count;
+	int length, err;
+
+	DBG("conn %p", conn);
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __near_error_invalid_arguments(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
+		dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_ARRAY)
+		return __near_error_invalid_arguments(msg);
 
-	for (list = app_hashes; list; list = list->next) {
-		app_hash = list->data;
+	batch = g_try_malloc0(sizeof(struct apdu_batch));
+	if (!batch)
+		return __near_error_out_of_memory(msg);
 
-		if (__seel_ace_apdu_allowed(channel, app_hash, apdu, apdu_len))
-			goto send_data;
+	batch->apdus = g_try_new0(struct apdu_batch_entry, BATCH_MAX_APDUS);
+	if (!batch->apdus) {
+		g_free(batch);
+		return __near_error_out_of_memory(msg);
 	}
 
-	near_error("*** APDU not allowed ***");
-	return __near_error_permission_denied(msg);
+	dbus_message_iter_recurse(&iter, &array);
 
-send_data:
-	pending_msg = dbus_message_ref(msg);
+	for (count = 0; dbus_message_iter_get_arg_type(&array) ==
+					DBUS_TYPE_ARRAY; count++) {
+		if (count == BATCH_MAX_APDUS)
+			goto invalid;
 
-	send_apdu = __seel_apdu_build(apdu, apdu_len, channel->channel);
-	if (!send_apdu) {
-		dbus_message_unref(pending_msg);
+		dbus_message_iter_recurse(&array, &apdu);
+		dbus_message_iter_get_fixed_array(&apdu,
+					&batch->apdus[count].data, &length);
+		batch->apdus[count].length = length;
+
+		/* CLA, INS, P1 and P2 at least */
+		if (length < 4)
+			goto invalid;
+
+		dbus_message_iter_next(&array);
+	}
+
+	if (!count)
+		goto invalid;
+
+	batch->sw_expected = 0x9000;
+	batch->sw_mask = 0xffff;
+
+	dbus_message_iter_next(&iter);
+	if (parse_batch_options(&iter, batch) < 0)
+		goto invalid;
+
+	batch->resps = g_try_new0(struct apdu_batch_entry, count);
+	if (!batch->resps) {
+		g_free(batch->apdus);
+		g_free(batch);
+		return __near_error_out_of_memory(msg);
+	}
+
+	batch->msg = dbus_message_ref(msg);
+	batch->count = count;
+
+	req = channel_request_new(channel, msg, batch);
+	if (!req) {
+		apdu_batch_free(batch);
 		return __near_error_out_of_memory(msg);
 	}
 
-	err = __seel_se_queue_io(channel->se, send_apdu,
-					send_apdu_cb, pending_msg);
+	err = __seel_cert_get_hashes(dbus_message_get_sender(msg),
+					send_apdu_batch_hashes_cb, req);
 	if (err < 0) {
-		near_error("send apdu error %d", err);
-		return NULL;
+		channel_request_free(req);
+		apdu_batch_free(batch);
+		return __near_error_failed(msg, -err);
 	}
 
 	return NULL;
+
+invalid:
+	g_free(batch->apdus);
+	g_free(batch);
+
+	return __near_error_invalid_arguments(msg);
 }
 
 static const GDBusMethodTable channel_methods[] = {
 	{ GDBUS_METHOD("GetProperties",
 				NULL, GDBUS_ARGS({"properties", "a{sv}"}),
 				get_properties) },
+	{ GDBUS_METHOD("SetProperty",
+				GDBUS_ARGS({"name", "s"}, {"value", "v"}),
+				NULL, set_property) },
 	{ GDBUS_ASYNC_METHOD("SendAPDU",
 				GDBUS_ARGS({"apdu", "ay"}),
 				GDBUS_ARGS({"resp", "ay"}),
 				send_apdu) },
+	{ GDBUS_ASYNC_METHOD("SendAPDUBatch",
+				GDBUS_ARGS({"apdus", "aay"},
+					{"options", "a{sv}"}),
+				GDBUS_ARGS({"resps", "aay"}),
+				send_apdu_batch) },
 	{ },
 };
 
@@ -168,7 +661,8 @@ static const GDBusSignalTable channel_signals[] = {
 };
 
 struct seel_channel *__seel_channel_add(struct seel_se *se, uint8_t chn,
-				uint8_t *aid, size_t aid_len, bool basic)
+				uint8_t *aid, size_t aid_len, bool basic,
+				const char *owner)
 {
 	struct seel_channel *channel;
 	const char *se_path;
@@ -212,7 +706,11 @@ struct seel_channel *__seel_channel_add(struct seel_se *se, uint8_t chn,
 	channel->se = se;
 	channel->path = path;
 	channel->basic = basic;
+	channel->owner = g_strdup(owner);
 	channel->channel = chn;
+	channel->priority = SEEL_IO_PRIORITY_NORMAL;
+	channel->ace_cache = __seel_ace_cache_new();
+	channel->refcount = 1;
 
 	g_dbus_register_interface(conn, channel->path,
 					SEEL_CHANNEL_INTERFACE,
@@ -233,9 +731,8 @@ void __seel_channel_remove(struct seel_channel *channel)
 	g_dbus_unregister_interface(conn, channel->path,
 						SEEL_CHANNEL_INTERFACE);
 
-	g_free(channel->path);
-	g_free(channel->aid);
-	g_free(channel);
+	channel->removed = true;
+	channel_unref(channel);
 }
 
 char *__seel_channel_get_path(struct seel_channel *channel)
@@ -267,3 +764,15 @@ bool __seel_channel_is_basic(struct seel_channel *channel)
 {
 	return channel->basic;
 }
+
+struct seel_ace_cache *__seel_channel_get_ace_cache(
+					struct seel_channel *channel)
+{
+	return channel->ace_cache;
+}
+
+enum seel_io_priority __seel_channel_get_priority(
+					struct seel_channel *channel)
+{
+	return channel->priority;
+}
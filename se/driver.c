@@ -114,7 +114,8 @@ void seel_cert_driver_unregister(struct seel_cert_driver *driver)
 {
 	DBG("");
 
-	cert_driver = NULL;
+	if (cert_driver == driver)
+		cert_driver = NULL;
 }
 
 struct seel_ctrl_driver *
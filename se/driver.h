@@ -27,6 +27,7 @@ enum seel_controller_type {
 	SEEL_CONTROLLER_MODEM,
 	SEEL_CONTROLLER_ASSD,
 	SEEL_CONTROLLER_PCSC,
+	SEEL_CONTROLLER_EMULATOR,
 	SEEL_CONTROLLER_UNKNOWN = 0xff
 };
 
@@ -35,6 +36,7 @@ enum seel_se_type {
 	SEEL_SE_ASSD, /* Advanced Security SD SE */
 	SEEL_SE_PCSC, /* PCSC compatible SE */
 	SEEL_SE_UICC, /* SIM card SE */
+	SEEL_SE_EMULATOR, /* In-process emulated SE */
 	SEEL_SE_UNKNOWN = 0xff
 };
 
@@ -58,8 +60,19 @@ struct seel_io_driver {
 			  transceive_cb_t cb, void *context);
 };
 
+/*
+ * get_hashes() calls cb once with the hashes, which the driver keeps
+ * owning, or NULL. It may do so before returning. When it returns an
+ * error, cb is not called. cancel_hashes() drops the pending calls
+ * for user_data, drivers that always answer right away can omit it.
+ */
+typedef void (*seel_cert_hashes_cb_t)(const GSList *hashes,
+							void *user_data);
+
 struct seel_cert_driver {
-	GSList * (*get_hashes)(pid_t pid);
+	int (*get_hashes)(pid_t pid, seel_cert_hashes_cb_t cb,
+							void *user_data);
+	void (*cancel_hashes)(void *user_data);
 };
 
 int seel_io_driver_register(struct seel_io_driver *driver);
@@ -190,7 +190,9 @@ int main(int argc, char *argv[])
 	__near_log_init(option_debug, option_detach);
 	__near_dbus_init(conn);
 	__seel_manager_init(conn);
+	__seel_apdu_init();
 	__seel_ace_init();
+	__seel_cert_init(conn);
 	__seel_se_init(conn);
 
 	__near_plugin_init(option_plugin, option_noplugin);
@@ -209,7 +211,9 @@ int main(int argc, char *argv[])
 	__near_plugin_cleanup();
 
 	__seel_se_cleanup();
+	__seel_cert_cleanup();
 	__seel_ace_cleanup();
+	__seel_apdu_cleanup();
 	__seel_manager_cleanup();
 	__near_dbus_cleanup();
 	__near_log_cleanup();
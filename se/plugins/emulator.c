@@ -0,0 +1,717 @@
+/*
+ *
+ *  seeld - Secure Element Manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+
+#include <near/log.h>
+#include <near/plugin.h>
+
+#include "../manager.h"
+#include "../driver.h"
+
+/*
+ * In-process secure element emulator, for testing and benchmarking
+ * seeld without any hardware. The applets are described in
+ * CONFIGDIR/se-emulator.conf, see se/emulator.conf for the format.
+ *
+ * The emulator implements MANAGE CHANNEL, SELECT by DF name, GET DATA
+ * CPLC when no applet is selected and, for the ARA-M applet, the GET
+ * DATA commands seeld uses to fetch access rules. Other commands go to
+ * the applet selected on the channel.
+ */
+
+#define EMU_CONFIG_FILE		CONFIGDIR "/se-emulator.conf"
+
+#define EMU_MAX_SE		16
+#define EMU_MAX_CHANNELS	4	/* basic channel included */
+#define EMU_MAX_RESPONSE	256
+#define EMU_REFRESH_TAG_LEN	8
+#define EMU_MAX_CPLC		0x7f
+
+#define CLA_CHANNEL_MASK	0x03
+
+#define INS_MANAGE_CHANNEL	0x70
+#define INS_SELECT_FILE		0xA4
+#define INS_GET_DATA		0xCA
+
+#define P1_SELECT_FILE_DF_NAME	0x04
+#define P1_CLOSE_CHANNEL	0x80
+
+#define SW_OK			0x9000
+#define SW_WRONG_LENGTH		0x6700
+#define SW_CHANNEL_UNSUPPORTED	0x6881
+#define SW_NOT_ALLOWED		0x6985
+#define SW_NOT_FOUND		0x6A82
+#define SW_NO_CHANNEL		0x6A81
+#define SW_DATA_NOT_FOUND	0x6A88
+#define SW_INS_UNSUPPORTED	0x6D00
+
+enum emu_applet_type {
+	EMU_APPLET_ECHO,
+	EMU_APPLET_STATIC,
+	EMU_APPLET_ARAM,
+};
+
+struct emu_applet {
+	char *name;
+	enum emu_applet_type type;
+	uint8_t *aid;
+	size_t aid_len;
+	guint latency;		/* ms */
+
+	/* Static applet response, without status word */
+	uint8_t *response;
+	size_t response_len;
+
+	/* ARA-M GET DATA [ALL] payload, i.e. a list of REF-AR-DOs */
+	uint8_t *rules;
+	size_t rules_len;
+	uint8_t refresh_tag[EMU_REFRESH_TAG_LEN];
+};
+
+struct emu_se {
+	uint32_t se_idx;
+	bool enabled;
+
+	bool opened[EMU_MAX_CHANNELS];
+	struct emu_applet *selected[EMU_MAX_CHANNELS];
+
+	/* Rules bytes already sent by GET DATA [ALL] / [NEXT] */
+	size_t rules_offset;
+
+	GSList *xfers;
+	uint64_t apdus;
+};
+
+struct emu_xfer {
+	struct emu_se *se;
+	uint8_t resp[EMU_MAX_RESPONSE + 2];
+	size_t resp_len;
+	transceive_cb_t cb;
+	void *context;
+	guint source;
+};
+
+static GSList *applets;
+static struct emu_se *emu_ses[EMU_MAX_SE];
+static unsigned int emu_se_count;
+static guint emu_latency;
+
+/* CPLC data of the first SE, the last byte is bumped for the next ones */
+static uint8_t *emu_cplc;
+static size_t emu_cplc_len;
+
+static void put_sw(struct emu_xfer *xfer, uint16_t sw)
+{
+	xfer->resp[xfer->resp_len++] = sw >> 8;
+	xfer->resp[xfer->resp_len++] = sw & 0xff;
+}
+
+static void put_data(struct emu_xfer *xfer, const uint8_t *data, size_t len)
+{
+	len = MIN(len, EMU_MAX_RESPONSE - xfer->resp_len);
+
+	memcpy(xfer->resp + xfer->resp_len, data, len);
+	xfer->resp_len += len;
+}
+
+static struct emu_applet *find_applet(uint8_t *aid, size_t aid_len)
+{
+	GSList *list;
+
+	for (list = applets; list; list = list->next) {
+		struct emu_applet *applet = list->data;
+
+		if (applet->aid_len == aid_len &&
+				!memcmp(applet->aid, aid, aid_len))
+			return applet;
+	}
+
+	return NULL;
+}
+
+static uint16_t manage_channel(struct emu_se *se, uint8_t *apdu,
+						struct emu_xfer *xfer)
+{
+	uint8_t chn;
+
+	if (apdu[2] == P1_CLOSE_CHANNEL) {
+		chn = apdu[3];
+		if (!chn || chn >= EMU_MAX_CHANNELS || !se->opened[chn])
+			return SW_CHANNEL_UNSUPPORTED;
+
+		se->opened[chn] = false;
+		se->selected[chn] = NULL;
+
+		return SW_OK;
+	}
+
+	for (chn = 1; chn < EMU_MAX_CHANNELS; chn++) {
+		if (se->opened[chn])
+			continue;
+
+		se->opened[chn] = true;
+		se->selected[chn] = NULL;
+		put_data(xfer, &chn, 1);
+
+		return SW_OK;
+	}
+
+	return SW_NO_CHANNEL;
+}
+
+static uint16_t select_applet(struct emu_se *se, uint8_t chn,
+				uint8_t *apdu, size_t len)
+{
+	struct emu_applet *applet;
+
+	if (apdu[2] != P1_SELECT_FILE_DF_NAME)
+		return SW_NOT_FOUND;
+
+	if (len < 5 || len < 5 + (size_t) apdu[4])
+		return SW_WRONG_LENGTH;
+
+	applet = find_applet(apdu + 5, apdu[4]);
+	if (!applet)
+		return SW_NOT_FOUND;
+
+	DBG("se%u channel %u selected %s", se->se_idx, chn, applet->name);
+
+	se->selected[chn] = applet;
+	if (applet->type == EMU_APPLET_ARAM)
+		se->rules_offset = 0;
+
+	return SW_OK;
+}
+
+/* GET DATA, as described in the GlobalPlatform SE Access Control spec */
+static uint16_t aram_get_data(struct emu_se *se, struct emu_applet *applet,
+						uint8_t *apdu, struct emu_xfer *xfer)
+{
+	uint16_t tag = apdu[2] << 8 | apdu[3];
+	uint8_t header[5];
+	size_t header_len = 0;
+
+	switch (tag) {
+	case 0xDF20:
+		header[0] = 0xDF;
+		header[1] = 0x20;
+		header[2] = EMU_REFRESH_TAG_LEN;
+		put_data(xfer, header, 3);
+		put_data(xfer, applet->refresh_tag, EMU_REFRESH_TAG_LEN);
+
+		return SW_OK;
+
+	case 0xFF40:
+		header[header_len++] = 0xFF;
+		header[header_len++] = 0x40;
+
+		if (applet->rules_len < 0x80) {
+			header[header_len++] = applet->rules_len;
+		} else if (applet->rules_len <= 0xff) {
+			header[header_len++] = 0x81;
+			header[header_len++] = applet->rules_len;
+		} else {
+			header[header_len++] = 0x82;
+			header[header_len++] = applet->rules_len >> 8;
+			header[header_len++] = applet->rules_len & 0xff;
+		}
+
+		put_data(xfer, header, header_len);
+		se->rules_offset = 0;
+
+		/* fall through */
+	case 0xFF60:
+		if (tag == 0xFF60 && se->rules_offset >= applet->rules_len)
+			return SW_DATA_NOT_FOUND;
+
+		put_data(xfer, applet->rules + se->rules_offset,
+				applet->rules_len - se->rules_offset);
+		se->rules_offset += xfer->resp_len - header_len;
+
+		return SW_OK;
+	}
+
+	return SW_DATA_NOT_FOUND;
+}
+
+static uint16_t applet_process(struct emu_se *se, struct emu_applet *applet,
+					uint8_t *apdu, size_t len,
+					struct emu_xfer *xfer)
+{
+	switch (applet->type) {
+	case EMU_APPLET_ECHO:
+		/* Case 3 and 4 commands get their data field back */
+		if (len > 5 && len >= 5 + (size_t) apdu[4])
+			put_data(xfer, apdu + 5, apdu[4]);
+
+		return SW_OK;
+
+	case EMU_APPLET_STATIC:
+		put_data(xfer, applet->response, applet->response_len);
+
+		return SW_OK;
+
+	case EMU_APPLET_ARAM:
+		if (apdu[1] != INS_GET_DATA)
+			return SW_INS_UNSUPPORTED;
+
+		return aram_get_data(se, applet, apdu, xfer);
+	}
+
+	return SW_INS_UNSUPPORTED;
+}
+
+/* GET DATA CPLC, as if the card issuer security domain was selected */
+static uint16_t isd_process(struct emu_se *se, uint8_t *apdu,
+						struct emu_xfer *xfer)
+{
+	uint8_t header[3];
+
+	if (apdu[1] != INS_GET_DATA || apdu[2] != 0x9F || apdu[3] != 0x7F)
+		return SW_NOT_ALLOWED;
+
+	if (!emu_cplc_len)
+		return SW_DATA_NOT_FOUND;
+
+	header[0] = 0x9F;
+	header[1] = 0x7F;
+	header[2] = emu_cplc_len;
+	put_data(xfer, header, sizeof(header));
+	put_data(xfer, emu_cplc, emu_cplc_len);
+
+	xfer->resp[xfer->resp_len - 1] += se->se_idx;
+
+	return SW_OK;
+}
+
+/* Returns the latency of the command, in ms */
+static guint emu_process(struct emu_se *se, uint8_t *apdu, size_t len,
+						struct emu_xfer *xfer)
+{
+	struct emu_applet *applet;
+	uint16_t sw;
+	uint8_t chn;
+
+	if (len < 4) {
+		put_sw(xfer, SW_WRONG_LENGTH);
+		return emu_latency;
+	}
+
+	chn = apdu[0] & CLA_CHANNEL_MASK;
+	if (chn && !se->opened[chn]) {
+		put_sw(xfer, SW_CHANNEL_UNSUPPORTED);
+		return emu_latency;
+	}
+
+	switch (apdu[1]) {
+	case INS_MANAGE_CHANNEL:
+		sw = manage_channel(se, apdu, xfer);
+		break;
+
+	case INS_SELECT_FILE:
+		sw = select_applet(se, chn, apdu, len);
+		break;
+
+	default:
+		applet = se->selected[chn];
+		if (!applet) {
+			sw = isd_process(se, apdu, xfer);
+			break;
+		}
+
+		sw = applet_process(se, applet, apdu, len, xfer);
+		put_sw(xfer, sw);
+
+		return applet->latency;
+	}
+
+	put_sw(xfer, sw);
+
+	return emu_latency;
+}
+
+static gboolean emu_complete(gpointer user_data)
+{
+	struct emu_xfer *xfer = user_data;
+	struct emu_se *se = xfer->se;
+
+	se->xfers = g_slist_remove(se->xfers, xfer);
+
+	xfer->cb(xfer->context, xfer->resp, xfer->resp_len, 0);
+
+	g_free(xfer);
+
+	return FALSE;
+}
+
+static struct emu_se *find_se(uint8_t ctrl_idx, uint32_t se_idx)
+{
+	if (ctrl_idx || se_idx >= emu_se_count)
+		return NULL;
+
+	return emu_ses[se_idx];
+}
+
+static int emu_transceive(uint8_t ctrl_idx, uint32_t se_idx,
+				uint8_t *apdu, size_t apdu_length,
+				transceive_cb_t cb, void *context)
+{
+	struct emu_xfer *xfer;
+	struct emu_se *se;
+	guint latency;
+
+	se = find_se(ctrl_idx, se_idx);
+	if (!se)
+		return -ENODEV;
+
+	if (!se->enabled)
+		return -ENONET;
+
+	xfer = g_try_malloc0(sizeof(struct emu_xfer));
+	if (!xfer)
+		return -ENOMEM;
+
+	xfer->se = se;
+	xfer->cb = cb;
+	xfer->context = context;
+
+	latency = emu_process(se, apdu, apdu_length, xfer);
+
+	se->apdus++;
+
+	/* Completions are always asynchronous, as with a real SE */
+	if (latency)
+		xfer->source = g_timeout_add(latency, emu_complete, xfer);
+	else
+		xfer->source = g_idle_add(emu_complete, xfer);
+
+	se->xfers = g_slist_prepend(se->xfers, xfer);
+
+	return 0;
+}
+
+static int emu_toggle_se(uint8_t ctrl_idx, uint32_t se_idx, bool enable)
+{
+	struct emu_se *se;
+	int i;
+
+	DBG("se%u %d", se_idx, enable);
+
+	se = find_se(ctrl_idx, se_idx);
+	if (!se)
+		return -ENODEV;
+
+	if (se->enabled == enable)
+		return -EALREADY;
+
+	se->enabled = enable;
+
+	/* A power cycle closes every logical channel */
+	for (i = 0; i < EMU_MAX_CHANNELS; i++) {
+		se->opened[i] = false;
+		se->selected[i] = NULL;
+	}
+
+	DBG("se%u handled %" G_GUINT64_FORMAT " APDUs", se_idx, se->apdus);
+
+	return 0;
+}
+
+static int emu_enable_se(uint8_t ctrl_idx, uint32_t se_idx)
+{
+	return emu_toggle_se(ctrl_idx, se_idx, true);
+}
+
+static int emu_disable_se(uint8_t ctrl_idx, uint32_t se_idx)
+{
+	return emu_toggle_se(ctrl_idx, se_idx, false);
+}
+
+static struct seel_ctrl_driver emu_ctrl_driver = {
+	.type = SEEL_CONTROLLER_EMULATOR,
+	.enable_se = emu_enable_se,
+	.disable_se = emu_disable_se,
+};
+
+static struct seel_io_driver emu_io_driver = {
+	.type = SEEL_SE_EMULATOR,
+	.transceive = emu_transceive,
+};
+
+static uint8_t *get_hex(GKeyFile *config, const char *group,
+					const char *key, size_t *len)
+{
+	char *str;
+	uint8_t *bytes;
+	size_t i, str_len;
+
+	*len = 0;
+
+	str = g_key_file_get_string(config, group, key, NULL);
+	if (!str)
+		return NULL;
+
+	str_len = strlen(str);
+	if (str_len % 2) {
+		g_free(str);
+		return NULL;
+	}
+
+	bytes = g_try_malloc0(str_len / 2 + 1);
+	if (!bytes) {
+		g_free(str);
+		return NULL;
+	}
+
+	for (i = 0; i < str_len / 2; i++) {
+		int high = g_ascii_xdigit_value(str[2 * i]);
+		int low = g_ascii_xdigit_value(str[2 * i + 1]);
+
+		if (high < 0 || low < 0) {
+			g_free(bytes);
+			g_free(str);
+			return NULL;
+		}
+
+		bytes[i] = high << 4 | low;
+	}
+
+	g_free(str);
+
+	*len = str_len / 2;
+
+	return bytes;
+}
+
+static void applet_free(gpointer data)
+{
+	struct emu_applet *applet = data;
+
+	g_free(applet->name);
+	g_free(applet->aid);
+	g_free(applet->response);
+	g_free(applet->rules);
+	g_free(applet);
+}
+
+static struct emu_applet *applet_load(GKeyFile *config, const char *group)
+{
+	struct emu_applet *applet;
+	uint8_t *tag;
+	size_t tag_len;
+	char *type;
+
+	applet = g_try_malloc0(sizeof(struct emu_applet));
+	if (!applet)
+		return NULL;
+
+	applet->name = g_strdup(group + strlen("Applet "));
+
+	applet->aid = get_hex(config, group, "AID", &applet->aid_len);
+	if (applet->aid_len < 5 || applet->aid_len > 16) {
+		near_error("%s: invalid AID", group);
+		goto fail;
+	}
+
+	type = g_key_file_get_string(config, group, "Type", NULL);
+	if (!type || g_str_equal(type, "echo")) {
+		applet->type = EMU_APPLET_ECHO;
+	} else if (g_str_equal(type, "static")) {
+		applet->type = EMU_APPLET_STATIC;
+	} else if (g_str_equal(type, "ara-m")) {
+		applet->type = EMU_APPLET_ARAM;
+	} else {
+		near_error("%s: unknown type %s", group, type);
+		g_free(type);
+		goto fail;
+	}
+
+	g_free(type);
+
+	applet->latency = g_key_file_get_integer(config, group,
+							"Latency", NULL);
+
+	applet->response = get_hex(config, group, "Response",
+						&applet->response_len);
+	if (applet->response_len > EMU_MAX_RESPONSE) {
+		near_error("%s: response too long", group);
+		goto fail;
+	}
+
+	applet->rules = get_hex(config, group, "Rules", &applet->rules_len);
+	if (applet->rules_len > 0xffff) {
+		near_error("%s: rules too long", group);
+		goto fail;
+	}
+
+	tag = get_hex(config, group, "RefreshTag", &tag_len);
+	if (tag && tag_len == EMU_REFRESH_TAG_LEN)
+		memcpy(applet->refresh_tag, tag, EMU_REFRESH_TAG_LEN);
+	g_free(tag);
+
+	DBG("%s type %d latency %u", applet->name, applet->type,
+							applet->latency);
+
+	return applet;
+
+fail:
+	applet_free(applet);
+
+	return NULL;
+}
+
+static int emu_load_config(void)
+{
+	GKeyFile *config;
+	char **groups;
+	int i, count;
+
+	config = g_key_file_new();
+
+	if (!g_key_file_load_from_file(config, EMU_CONFIG_FILE, 0, NULL)) {
+		g_key_file_free(config);
+		return -ENOENT;
+	}
+
+	count = g_key_file_get_integer(config, "General",
+					"SecureElements", NULL);
+	emu_se_count = CLAMP(count, 1, EMU_MAX_SE);
+
+	emu_latency = g_key_file_get_integer(config, "General",
+							"Latency", NULL);
+
+	emu_cplc = get_hex(config, "General", "CPLC", &emu_cplc_len);
+	if (emu_cplc_len > EMU_MAX_CPLC) {
+		near_error("CPLC too long");
+		g_free(emu_cplc);
+		emu_cplc = NULL;
+		emu_cplc_len = 0;
+	}
+
+	groups = g_key_file_get_groups(config, NULL);
+
+	for (i = 0; groups[i]; i++) {
+		struct emu_applet *applet;
+
+		if (!g_str_has_prefix(groups[i], "Applet "))
+			continue;
+
+		applet = applet_load(config, groups[i]);
+		if (applet)
+			applets = g_slist_append(applets, applet);
+	}
+
+	g_strfreev(groups);
+	g_key_file_free(config);
+
+	return 0;
+}
+
+static void emu_se_free(struct emu_se *se)
+{
+	GSList *list;
+
+	for (list = se->xfers; list; list = list->next) {
+		struct emu_xfer *xfer = list->data;
+
+		g_source_remove(xfer->source);
+		g_free(xfer);
+	}
+
+	g_slist_free(se->xfers);
+	g_free(se);
+}
+
+static int emulator_init(void)
+{
+	unsigned int i;
+	int err;
+
+	DBG("");
+
+	if (emu_load_config() < 0) {
+		DBG("No %s, emulator disabled", EMU_CONFIG_FILE);
+		return 0;
+	}
+
+	err = seel_ctrl_driver_register(&emu_ctrl_driver);
+	if (err < 0)
+		return err;
+
+	err = seel_io_driver_register(&emu_io_driver);
+	if (err < 0) {
+		seel_ctrl_driver_unregister(&emu_ctrl_driver);
+		return err;
+	}
+
+	for (i = 0; i < emu_se_count; i++) {
+		emu_ses[i] = g_try_malloc0(sizeof(struct emu_se));
+		if (!emu_ses[i])
+			break;
+
+		emu_ses[i]->se_idx = i;
+		emu_ses[i]->opened[0] = true;
+
+		seel_manager_se_add(i, 0, SEEL_SE_EMULATOR,
+						SEEL_CONTROLLER_EMULATOR);
+	}
+
+	emu_se_count = i;
+
+	return 0;
+}
+
+static void emulator_exit(void)
+{
+	unsigned int i;
+
+	DBG("");
+
+	for (i = 0; i < emu_se_count; i++) {
+		seel_manager_se_remove(i, 0, SEEL_CONTROLLER_EMULATOR);
+
+		emu_se_free(emu_ses[i]);
+		emu_ses[i] = NULL;
+	}
+
+	emu_se_count = 0;
+
+	seel_io_driver_unregister(&emu_io_driver);
+	seel_ctrl_driver_unregister(&emu_ctrl_driver);
+
+	g_slist_free_full(applets, applet_free);
+	applets = NULL;
+
+	g_free(emu_cplc);
+	emu_cplc = NULL;
+	emu_cplc_len = 0;
+}
+
+NEAR_PLUGIN_DEFINE(emulator, "SE emulator", VERSION,
+			NEAR_PLUGIN_PRIORITY_LOW, emulator_init, emulator_exit)
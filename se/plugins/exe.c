@@ -0,0 +1,325 @@
+/*
+ *
+ *  seeld - Secure Element Manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <near/log.h>
+#include <near/plugin.h>
+
+#include "../driver.h"
+
+/*
+ * Certificate driver for plain Linux hosts, where applications are not
+ * signed: the application hash is the SHA-1 of the caller executable.
+ * Only one certificate driver can be registered, this one has the lowest
+ * priority so that it is only a fallback for platform drivers.
+ *
+ * Hashes are cached per executable file, so that hashing only happens
+ * once per binary and not once per caller. The modification time is
+ * part of the key, an updated binary gets hashed again.
+ *
+ * Executables can be large, they are hashed one chunk per main loop
+ * iteration from an idle source. Callers of the same binary share the
+ * job hashing it.
+ */
+
+#define EXE_READ_SIZE	(64 * 1024)
+
+struct exe_waiter {
+	seel_cert_hashes_cb_t cb;
+	void *user_data;
+};
+
+struct exe_job {
+	char *key;
+	int fd;
+	GChecksum *checksum;
+	uint8_t *buf;
+	guint source;
+	GSList *waiters;
+};
+
+static GHashTable *exe_hash;
+static GHashTable *exe_jobs;
+
+static void exe_job_free(gpointer data)
+{
+	struct exe_job *job = data;
+
+	if (job->source > 0)
+		g_source_remove(job->source);
+
+	g_slist_free_full(job->waiters, g_free);
+	g_checksum_free(job->checksum);
+	g_free(job->buf);
+	close(job->fd);
+	g_free(job->key);
+	g_free(job);
+}
+
+static void exe_job_done(struct exe_job *job, GSList *hashes)
+{
+	GSList *list;
+
+	/* Callbacks may start or cancel lookups, detach the job first */
+	g_hash_table_steal(exe_jobs, job->key);
+
+	for (list = job->waiters; list; list = list->next) {
+		struct exe_waiter *waiter = list->data;
+
+		waiter->cb(hashes, waiter->user_data);
+	}
+
+	exe_job_free(job);
+}
+
+static gboolean exe_job_read(gpointer user_data)
+{
+	struct exe_job *job = user_data;
+	GSList *hashes;
+	uint8_t *hash;
+	gsize digest_len;
+	ssize_t len;
+
+	len = read(job->fd, job->buf, EXE_READ_SIZE);
+	if (len < 0 && (errno == EINTR || errno == EAGAIN))
+		return TRUE;
+
+	if (len > 0) {
+		g_checksum_update(job->checksum, job->buf, len);
+		return TRUE;
+	}
+
+	/* The source goes away when returning */
+	job->source = 0;
+
+	if (len < 0) {
+		near_error("Could not hash %s: %s", job->key, strerror(errno));
+		exe_job_done(job, NULL);
+		return FALSE;
+	}
+
+	digest_len = g_checksum_type_get_length(G_CHECKSUM_SHA1);
+	hash = g_try_malloc(digest_len);
+	if (!hash) {
+		exe_job_done(job, NULL);
+		return FALSE;
+	}
+
+	g_checksum_get_digest(job->checksum, hash, &digest_len);
+
+	DBG("Hashed %s", job->key);
+
+	hashes = g_slist_append(NULL, hash);
+
+	g_hash_table_replace(exe_hash, g_strdup(job->key), hashes);
+
+	exe_job_done(job, hashes);
+
+	return FALSE;
+}
+
+static struct exe_job *exe_job_new(char *key, int fd)
+{
+	struct exe_job *job;
+
+	job = g_try_malloc0(sizeof(struct exe_job));
+	if (!job)
+		return NULL;
+
+	job->buf = g_try_malloc(EXE_READ_SIZE);
+	if (!job->buf) {
+		g_free(job);
+		return NULL;
+	}
+
+	job->key = key;
+	job->fd = fd;
+	job->checksum = g_checksum_new(G_CHECKSUM_SHA1);
+	job->source = g_idle_add(exe_job_read, job);
+
+	g_hash_table_replace(exe_jobs, job->key, job);
+
+	return job;
+}
+
+static int exe_get_hashes(pid_t pid, seel_cert_hashes_cb_t cb,
+							void *user_data)
+{
+	struct exe_waiter *waiter;
+	struct exe_job *job;
+	GSList *hashes;
+	struct stat st;
+	char path[32], *key;
+	int fd, err;
+
+	DBG("pid %d", pid);
+
+	snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+		near_error("Could not open %s: %s", path, strerror(-err));
+		return err;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	key = g_strdup_printf("%llx:%llx:%lld",
+				(unsigned long long) st.st_dev,
+				(unsigned long long) st.st_ino,
+				(long long) st.st_mtime);
+
+	hashes = g_hash_table_lookup(exe_hash, key);
+	if (hashes) {
+		close(fd);
+		g_free(key);
+		cb(hashes, user_data);
+		return 0;
+	}
+
+	waiter = g_try_malloc0(sizeof(struct exe_waiter));
+	if (!waiter) {
+		close(fd);
+		g_free(key);
+		return -ENOMEM;
+	}
+
+	waiter->cb = cb;
+	waiter->user_data = user_data;
+
+	job = g_hash_table_lookup(exe_jobs, key);
+	if (job) {
+		close(fd);
+		g_free(key);
+	} else {
+		job = exe_job_new(key, fd);
+		if (!job) {
+			close(fd);
+			g_free(key);
+			g_free(waiter);
+			return -ENOMEM;
+		}
+	}
+
+	job->waiters = g_slist_append(job->waiters, waiter);
+
+	return 0;
+}
+
+static void exe_cancel_hashes(void *user_data)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GSList *list, *next;
+
+	g_hash_table_iter_init(&iter, exe_jobs);
+
+	/* Jobs left without waiters carry on, their hash gets cached */
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct exe_job *job = value;
+
+		for (list = job->waiters; list; list = next) {
+			struct exe_waiter *waiter = list->data;
+
+			next = list->next;
+
+			if (waiter->user_data != user_data)
+				continue;
+
+			job->waiters = g_slist_delete_link(job->waiters, list);
+			g_free(waiter);
+		}
+	}
+}
+
+static void free_hashes(gpointer data)
+{
+	g_slist_free_full(data, g_free);
+}
+
+static struct seel_cert_driver exe_cert_driver = {
+	.get_hashes = exe_get_hashes,
+	.cancel_hashes = exe_cancel_hashes,
+};
+
+static int exe_init(void)
+{
+	int err;
+
+	DBG("");
+
+	exe_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, free_hashes);
+	exe_jobs = g_hash_table_new_full(g_str_hash, g_str_equal,
+							NULL, exe_job_free);
+
+	err = seel_cert_driver_register(&exe_cert_driver);
+	if (err < 0) {
+		g_hash_table_destroy(exe_jobs);
+		exe_jobs = NULL;
+		g_hash_table_destroy(exe_hash);
+		exe_hash = NULL;
+	}
+
+	return err;
+}
+
+static void exe_exit(void)
+{
+	DBG("");
+
+	/* Don't leave lookups hanging */
+	while (g_hash_table_size(exe_jobs) > 0) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init(&iter, exe_jobs);
+		g_hash_table_iter_next(&iter, NULL, &value);
+
+		exe_job_done(value, NULL);
+	}
+
+	seel_cert_driver_unregister(&exe_cert_driver);
+
+	g_hash_table_destroy(exe_jobs);
+	exe_jobs = NULL;
+
+	g_hash_table_destroy(exe_hash);
+	exe_hash = NULL;
+}
+
+NEAR_PLUGIN_DEFINE(exe, "SE executable hash certificate support", VERSION,
+			NEAR_PLUGIN_PRIORITY_LOW, exe_init, exe_exit)
@@ -65,6 +65,8 @@ static inline void __nl_perror(int error, const char *s)
 #endif
 
 struct nfc_transceive_context {
+	uint32_t ctrl_idx;
+	uint32_t se_idx;
 	void *context;
 	uint8_t *apdu;
 	size_t apdu_length;
@@ -77,7 +79,8 @@ struct nlnfc_state {
 	int nfc_id;
 	int mcid;
 
-	struct nfc_transceive_context *ctx;
+	/* One pending SE_IO per secure element */
+	GSList *io_ctxs;
 };
 
 static struct nlnfc_state *nfc_state;
@@ -219,67 +222,121 @@ static int nfc_netlink_event_se(struct genlmsghdr *gnlh, bool add)
 	}
 }
 
+static struct nfc_transceive_context *find_io_ctx(uint32_t ctrl_idx,
+							uint32_t se_idx)
+{
+	GSList *list;
+
+	for (list = nfc_state->io_ctxs; list; list = list->next) {
+		struct nfc_transceive_context *ctx = list->data;
+
+		if (ctx->ctrl_idx == ctrl_idx && ctx->se_idx == se_idx)
+			return ctx;
+	}
+
+	return NULL;
+}
+
+static void io_ctx_done(struct nfc_transceive_context *ctx,
+				uint8_t *apdu, size_t apdu_len, int err)
+{
+	nfc_state->io_ctxs = g_slist_remove(nfc_state->io_ctxs, ctx);
+
+	ctx->cb(ctx->context, apdu, apdu_len, err);
+
+	g_free(ctx);
+}
+
+/*
+ * A response without a controller index can't be matched to its request,
+ * fail the requests to that SE rather than leaving them pending forever.
+ */
+static void fail_io_ctxs(uint32_t se_idx, int err)
+{
+	GSList *pending = NULL, *list, *next;
+
+	/* Callbacks may queue new requests, take ours out first */
+	for (list = nfc_state->io_ctxs; list; list = next) {
+		struct nfc_transceive_context *ctx = list->data;
+
+		next = list->next;
+
+		if (ctx->se_idx != se_idx)
+			continue;
+
+		nfc_state->io_ctxs = g_slist_delete_link(nfc_state->io_ctxs,
+									list);
+		pending = g_slist_prepend(pending, ctx);
+	}
+
+	for (list = pending; list; list = list->next) {
+		struct nfc_transceive_context *ctx = list->data;
+
+		ctx->cb(ctx->context, NULL, 0, err);
+		g_free(ctx);
+	}
+
+	g_slist_free(pending);
+}
+
 static int nfc_netlink_event_io(struct genlmsghdr *gnlh)
 {
 	struct nlattr *attrs[NFC_ATTR_MAX + 1];
+	struct nfc_transceive_context *ctx;
 	uint32_t nfc_idx, se_idx;
 	uint8_t *apdu;
 	size_t apdu_len;
-	int err;
 
 	DBG("");
 
-	if (!nfc_state->ctx)
+	if (!nfc_state->io_ctxs)
 		return -EINVAL;
 
 	nla_parse(attrs, NFC_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
 		  genlmsg_attrlen(gnlh, 0), NULL);
 
+	/* Not attributable to any request, leave them all alone */
+	if (!attrs[NFC_ATTR_SE_INDEX]) {
+		near_error("Missing NFC SE index");
+		return -ENODEV;
+	}
+
+	se_idx = nla_get_u32(attrs[NFC_ATTR_SE_INDEX]);
+
 	if (!attrs[NFC_ATTR_DEVICE_INDEX]) {
-		near_error("Missing NFC controller index");
-		err = -ENODEV;
-		goto out;
+		near_error("Missing NFC controller index for SE %u", se_idx);
+
+		fail_io_ctxs(se_idx, -ENODEV);
+
+		return -ENODEV;
 	}
 
-	if (!attrs[NFC_ATTR_SE_INDEX]) {
-		near_error("Missing NFC SE index");
-		err = -ENODEV;
-		goto out;
+	nfc_idx = nla_get_u32(attrs[NFC_ATTR_DEVICE_INDEX]);
+
+	ctx = find_io_ctx(nfc_idx, se_idx);
+	if (!ctx) {
+		DBG("No pending APDU for NFC %u SE %u", nfc_idx, se_idx);
+		return -EINVAL;
 	}
 
 	if (!attrs[NFC_ATTR_SE_APDU]) {
 		near_error("Missing SE APDU");
-		err = -EIO;
-		goto out;
+		io_ctx_done(ctx, NULL, 0, -EIO);
+		return -EIO;
 	}
 
-	nfc_idx = nla_get_u32(attrs[NFC_ATTR_DEVICE_INDEX]);
-	se_idx = nla_get_u32(attrs[NFC_ATTR_SE_INDEX]);
 	apdu_len = nla_len(attrs[NFC_ATTR_SE_APDU]);
-	if (!apdu_len) {
-		err = -EINVAL;
-		goto out;
-	}
-
 	apdu = nla_data(attrs[NFC_ATTR_SE_APDU]);
-	if (!apdu) {
-		err = -EINVAL;
-		goto out;
+	if (!apdu_len || !apdu) {
+		io_ctx_done(ctx, NULL, 0, -EINVAL);
+		return -EINVAL;
 	}
 
 	DBG("NFC %u SE %u APDU len %zu", nfc_idx, se_idx, apdu_len);
 
-	nfc_state->ctx->cb(nfc_state->ctx->context, apdu, apdu_len, 0);
+	io_ctx_done(ctx, apdu, apdu_len, 0);
 
-	err = 0;
-out:
-	if (err)
-		nfc_state->ctx->cb(nfc_state->ctx->context, NULL, 0, err);
-
-	g_free(nfc_state->ctx);
-	nfc_state->ctx = NULL;
-
-	return err;
+	return 0;
 }
 
 static int nfc_netlink_event(struct nl_msg *n, void *arg)
@@ -546,28 +603,36 @@ static int nfc_transceive(uint8_t ctrl_idx, uint32_t se_idx,
 			  uint8_t *apdu, size_t apdu_length,
 			  transceive_cb_t cb, void *context)
 {
+	struct nfc_transceive_context *ctx;
 	struct nl_msg *msg;
 	void *hdr;
 	int err;
 
 	DBG("%zu APDU %p", apdu_length, apdu);
 
-	if (nfc_state->ctx)
+	/* The kernel handles one APDU at a time per SE, seeld queues them */
+	if (find_io_ctx(ctrl_idx, se_idx))
 		return -EALREADY;
 
-	nfc_state->ctx = g_try_malloc0(sizeof(struct nfc_transceive_context));
-	if (!nfc_state->ctx) {
+	ctx = g_try_malloc0(sizeof(struct nfc_transceive_context));
+	if (!ctx) {
 		cb(context, NULL, 0, -ENOMEM);
 
 		return -ENOMEM;
 	}
 
-	nfc_state->ctx->context = context;
-	nfc_state->ctx->cb = cb;
+	ctx->ctrl_idx = ctrl_idx;
+	ctx->se_idx = se_idx;
+	ctx->context = context;
+	ctx->cb = cb;
+
+	nfc_state->io_ctxs = g_slist_prepend(nfc_state->io_ctxs, ctx);
 
 	msg = nlmsg_alloc();
-	if (msg == NULL)
-		return -ENOMEM;
+	if (msg == NULL) {
+		err = -ENOMEM;
+		goto fail;
+	}
 
 	hdr = genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, nfc_state->nfc_id, 0,
 			NLM_F_REQUEST, NFC_CMD_SE_IO, NFC_GENL_VERSION);
@@ -587,6 +652,12 @@ static int nfc_transceive(uint8_t ctrl_idx, uint32_t se_idx,
 nla_put_failure:
 	nlmsg_free(msg);
 
+	if (err >= 0)
+		return err;
+
+fail:
+	io_ctx_done(ctx, NULL, 0, err);
+
 	return err;
 }
 
@@ -715,6 +786,7 @@ static void nfc_exit(void)
 	nl_socket_free(nfc_state->cmd_sock);
 	nl_socket_free(nfc_state->event_sock);
 
+	g_slist_free_full(nfc_state->io_ctxs, g_free);
 	g_free(nfc_state);
 
 	DBG("");
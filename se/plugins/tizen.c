@@ -500,7 +500,7 @@ static uint8_t *digest_cert(const char *cert, int length)
 	return hash;
 }
 
-static GSList *tizen_get_hashes(pid_t pid)
+static GSList *tizen_lookup_hashes(pid_t pid)
 {
 	char pkg_name[256] = { 0, };
 	pkgmgrinfo_appinfo_h appinfo;
@@ -565,6 +565,14 @@ destroy_appinfo:
 	return cert_list;
 }
 
+static int tizen_get_hashes(pid_t pid, seel_cert_hashes_cb_t cb,
+							void *user_data)
+{
+	cb(tizen_lookup_hashes(pid), user_data);
+
+	return 0;
+}
+
 static struct seel_cert_driver tizen_cert_driver = {
 	.get_hashes = tizen_get_hashes,
 };
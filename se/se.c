@@ -37,6 +37,27 @@ static DBusConnection *connection;
 
 static GHashTable *se_hash;
 
+/* ISO7816-4 allows up to 20 logical channels, the last queue is ours */
+#define SE_MAX_CHANNELS		20
+#define SE_CONTROL_QUEUE	SE_MAX_CHANNELS
+
+/*
+ * Pending APDUs of one logical channel. Channels with pending APDUs are
+ * served round robin within their priority lane.
+ */
+struct seel_se_ioq {
+	GQueue reqs;
+	enum seel_io_priority lane;
+	bool active;
+};
+
+/* Share of the link each lane gets when all of them are busy */
+static const unsigned int lane_weight[SEEL_IO_PRIORITY_MAX] = {
+	[SEEL_IO_PRIORITY_HIGH]		= 4,
+	[SEEL_IO_PRIORITY_NORMAL]	= 2,
+	[SEEL_IO_PRIORITY_LOW]		= 1,
+};
+
 struct seel_se {
 	char *path;
 
@@ -48,10 +69,12 @@ struct seel_se {
 
 	struct seel_ctrl_driver *ctrl_driver;
 	struct seel_io_driver *io_driver;
-	struct seel_cert_driver *cert_driver;
 
-	bool ioreq_pending;
-	GList *ioreq_list;
+	struct seel_se_ioreq *ioreq_inflight;
+	bool ioreq_dispatching;
+	struct seel_se_ioq ioq[SE_MAX_CHANNELS + 1];
+	GList *lanes[SEEL_IO_PRIORITY_MAX];
+	unsigned int lane_credit[SEEL_IO_PRIORITY_MAX];
 
 	struct seel_channel *basic_channel;
 	GHashTable *channel_hash;
@@ -66,7 +89,7 @@ struct seel_se_ioreq {
 	transceive_cb_t cb;
 };
 
-static int send_io(struct seel_se *se);
+static void ioreq_dispatch(struct seel_se *se);
 
 static void se_free(gpointer data)
 {
@@ -101,82 +124,146 @@ void __seel_se_list(DBusMessageIter *iter, void *user_data)
 	g_hash_table_foreach(se_hash, append_path, iter);
 }
 
-static gboolean send_io_bh(gpointer user_data)
-{
-	struct seel_se *se = user_data;
-
-	send_io(se);
-
-	return FALSE;
-}
-
 static void io_cb(void *context,
 			uint8_t *apdu, size_t apdu_length, int err)
 {
 	struct seel_se_ioreq *req = context;
 	struct seel_se *se = req->se;
+	bool dispatching;
 
 	DBG("%zu %d", apdu_length, err);
 
+	se->ioreq_inflight = NULL;
+
 	/* Check response status */
 	if (!err)
 		err = __seel_apdu_resp_status(apdu, apdu_length);
 
+	/*
+	 * Requests queued from the callback must not be sent before
+	 * it is completely done, otherwise we may hit callback
+	 * reentrance issues.
+	 */
+	dispatching = se->ioreq_dispatching;
+	se->ioreq_dispatching = true;
+
 	if (req->cb)
 		req->cb(req->context, apdu, apdu_length, err);
 
 	__seel_apdu_free(req->apdu);
 	g_free(req);
 
-	se->ioreq_pending = false;
+	se->ioreq_dispatching = dispatching;
 
-	/*
-	 * Process the next request after the callback is
-	 * completely done, otherwise we may hit callback
-	 * reentrance issue whenever the callback queues
-	 * some request as well.
-	 */
-	g_idle_add(send_io_bh, se);
+	/* No main loop round trip, the SE link is idle until then */
+	ioreq_dispatch(se);
 }
 
-static int send_io(struct seel_se *se)
+static struct seel_se_ioreq *lane_pop(struct seel_se *se,
+					enum seel_io_priority lane)
 {
+	struct seel_se_ioreq *req;
+	struct seel_se_ioq *ioq;
 	GList *first;
+
+	first = se->lanes[lane];
+	if (!first)
+		return NULL;
+
+	ioq = first->data;
+	req = g_queue_pop_head(&ioq->reqs);
+
+	se->lanes[lane] = g_list_delete_link(se->lanes[lane], first);
+
+	if (g_queue_is_empty(&ioq->reqs))
+		ioq->active = false;
+	else
+		se->lanes[lane] = g_list_append(se->lanes[lane], ioq);
+
+	return req;
+}
+
+static struct seel_se_ioreq *ioreq_next(struct seel_se *se)
+{
 	struct seel_se_ioreq *req;
+	enum seel_io_priority lane;
+	int round;
 
-	DBG("");
+	/* Channel management and ACE traffic is never held back */
+	req = lane_pop(se, SEEL_IO_PRIORITY_CONTROL);
+	if (req)
+		return req;
+
+	/* Weighted round robin, idle lanes give their share away */
+	for (round = 0; round < 2; round++) {
+		for (lane = SEEL_IO_PRIORITY_HIGH;
+				lane < SEEL_IO_PRIORITY_MAX; lane++) {
+			if (!se->lanes[lane] || !se->lane_credit[lane])
+				continue;
 
-	se->ioreq_pending = true;
+			se->lane_credit[lane]--;
 
-	first = g_list_first(se->ioreq_list);
-	if (first == NULL) {
-		DBG("No more pending requests");
-		se->ioreq_pending = false;
-		return -EIO;
+			return lane_pop(se, lane);
+		}
+
+		for (lane = SEEL_IO_PRIORITY_HIGH;
+				lane < SEEL_IO_PRIORITY_MAX; lane++)
+			se->lane_credit[lane] = lane_weight[lane];
 	}
 
-	req = first->data;
+	return NULL;
+}
+
+static void ioreq_dispatch(struct seel_se *se)
+{
+	struct seel_se_ioreq *req;
+	int err;
+
+	if (se->ioreq_inflight || se->ioreq_dispatching)
+		return;
+
+	se->ioreq_dispatching = true;
+
+	/* The SE link carries one command at a time */
+	while (!se->ioreq_inflight) {
+		req = ioreq_next(se);
+		if (!req) {
+			DBG("No more pending requests");
+			break;
+		}
+
+		se->ioreq_inflight = req;
 
-	se->ioreq_list = g_list_remove(se->ioreq_list, req);
+		__seel_apdu_dump(__seel_apdu_data(req->apdu),
+					__seel_apdu_length(req->apdu));
 
-	__seel_apdu_dump(__seel_apdu_data(req->apdu),
-				__seel_apdu_length(req->apdu));
+		if (!se->io_driver || !se->io_driver->transceive) {
+			io_cb(req, NULL, 0, -EIO);
+			continue;
+		}
 
-	if (se->io_driver && se->io_driver->transceive)
-		return se->io_driver->transceive(se->ctrl_idx, se->se_idx,
+		err = se->io_driver->transceive(se->ctrl_idx, se->se_idx,
 						__seel_apdu_data(req->apdu),
 						__seel_apdu_length(req->apdu),
 						io_cb, req);
 
-	return -EIO;
+		/* Drivers should complete failed requests themselves */
+		if (err < 0 && se->ioreq_inflight == req)
+			io_cb(req, NULL, 0, err);
+	}
+
+	se->ioreq_dispatching = false;
 }
 
-int __seel_se_queue_io(struct seel_se *se, struct seel_apdu *apdu,
-					transceive_cb_t cb, void *context)
+static int queue_io(struct seel_se *se, unsigned int queue,
+				enum seel_io_priority lane,
+				struct seel_apdu *apdu,
+				transceive_cb_t cb, void *context)
 {
 	struct seel_se_ioreq *req;
+	struct seel_se_ioq *ioq;
 
-	DBG("Pending req %d", se->ioreq_pending);
+	DBG("queue %u lane %d inflight %p", queue, lane, se->ioreq_inflight);
 
 	req = g_try_malloc0(sizeof(struct seel_se_ioreq));
 	if (req == NULL) {
@@ -190,12 +277,66 @@ int __seel_se_queue_io(struct seel_se *se, struct seel_apdu *apdu,
 	req->context = context;
 	req->cb = cb;
 
-	se->ioreq_list = g_list_append(se->ioreq_list, req);
+	ioq = &se->ioq[queue];
+	g_queue_push_tail(&ioq->reqs, req);
+
+	if (!ioq->active) {
+		ioq->active = true;
+		ioq->lane = lane;
+		se->lanes[lane] = g_list_append(se->lanes[lane], ioq);
+	}
+
+	ioreq_dispatch(se);
+
+	return 0;
+}
+
+int __seel_se_queue_io(struct seel_se *se, struct seel_apdu *apdu,
+					transceive_cb_t cb, void *context)
+{
+	return queue_io(se, SE_CONTROL_QUEUE, SEEL_IO_PRIORITY_CONTROL,
+							apdu, cb, context);
+}
+
+int __seel_se_queue_lane_io(struct seel_se *se, uint8_t chn,
+					enum seel_io_priority priority,
+					struct seel_apdu *apdu,
+					transceive_cb_t cb, void *context)
+{
+	if (chn >= SE_MAX_CHANNELS)
+		return __seel_se_queue_io(se, apdu, cb, context);
+
+	return queue_io(se, chn, priority, apdu, cb, context);
+}
+
+/* Move the pending APDUs of a channel to its new priority lane */
+void __seel_se_set_lane(struct seel_se *se, uint8_t chn,
+					enum seel_io_priority lane)
+{
+	struct seel_se_ioq *ioq;
+
+	if (chn >= SE_MAX_CHANNELS)
+		return;
+
+	ioq = &se->ioq[chn];
+	if (!ioq->active || ioq->lane == lane)
+		return;
+
+	DBG("channel %u lane %d -> %d", chn, ioq->lane, lane);
 
-	if (se->ioreq_pending == true)
-		return 0;
+	se->lanes[ioq->lane] = g_list_remove(se->lanes[ioq->lane], ioq);
+	se->lanes[lane] = g_list_append(se->lanes[lane], ioq);
+	ioq->lane = lane;
+}
 
-	return send_io(se);
+int __seel_se_queue_channel_io(struct seel_channel *channel,
+					struct seel_apdu *apdu,
+					transceive_cb_t cb, void *context)
+{
+	return __seel_se_queue_lane_io(__seel_channel_get_se(channel),
+				__seel_channel_get_channel(channel),
+				__seel_channel_get_priority(channel),
+				apdu, cb, context);
 }
 
 static char *ctrl_to_string(enum seel_controller_type ctrl_type)
@@ -209,6 +350,8 @@ static char *ctrl_to_string(enum seel_controller_type ctrl_type)
 		return "assd";
 	case SEEL_CONTROLLER_PCSC:
 		return "pcsc";
+	case SEEL_CONTROLLER_EMULATOR:
+		return "emu";
 	case SEEL_CONTROLLER_UNKNOWN:
 		return NULL;
 	}
@@ -227,6 +370,8 @@ static char *se_to_string(enum seel_se_type se_type)
 		return "pcsc";
 	case SEEL_SE_UICC:
 		return "uicc";
+	case SEEL_SE_EMULATOR:
+		return "emu";
 	case SEEL_SE_UNKNOWN:
 		return NULL;
 	}
@@ -281,24 +426,6 @@ uint8_t __seel_se_get_type(struct seel_se *se)
 	return se->se_type;
 }
 
-const GSList *__seel_se_get_hashes(struct seel_se *se, const char *owner)
-{
-	pid_t pid;
-
-	if (se->cert_driver == NULL)
-		return NULL;
-
-//	pid = g_dbus_get_pid_sync(connection, owner);
-	pid = 0;
-
-	DBG("app pid %d", pid);
-
-	if (pid < 0)
-		return NULL;
-
-	return se->cert_driver->get_hashes(pid);
-}
-
 static int se_toggle(struct seel_se *se, bool enable)
 {
 	DBG("");
@@ -495,7 +622,8 @@ static void select_aid_cb(void *context,
 	}
 
 	channel = __seel_channel_add(ctx->se, ctx->channel,
-					ctx->aid, ctx->aid_len, false);
+					ctx->aid, ctx->aid_len, false,
+					dbus_message_get_sender(ctx->msg));
 	if (!channel) {
 		err = -ENOMEM;
 		goto err;
@@ -504,6 +632,8 @@ static void select_aid_cb(void *context,
 	path = __seel_channel_get_path(channel);
 	g_hash_table_replace(ctx->se->channel_hash, path, channel);
 
+	__seel_ace_resolve(channel, dbus_message_get_sender(ctx->msg));
+
 	g_dbus_send_reply(conn, ctx->msg,
 				DBUS_TYPE_OBJECT_PATH, &path,
 				DBUS_TYPE_INVALID);
@@ -587,6 +717,9 @@ static DBusMessage *open_channel(DBusConnection *conn,
 	ctx->aid = aid;
 	ctx->aid_len = aid_len;
 
+	/* Ready by the time the channel is open, see __seel_ace_resolve() */
+	__seel_cert_get_hashes(dbus_message_get_sender(msg), NULL, NULL);
+
 	err = __seel_se_queue_io(se, open_channel, open_channel_cb, ctx);
 	if (err < 0) {
 		near_error("open channel error %d", err);
@@ -688,7 +821,9 @@ static DBusMessage *close_channel(DBusConnection *conn,
 
 	ctx->msg = dbus_message_ref(msg);
 
-	err = __seel_se_queue_io(se, close_channel, close_channel_cb, ctx);
+	/* Behind the APDUs already queued on that channel */
+	err = __seel_se_queue_channel_io(ctx->channel, close_channel,
+						close_channel_cb, ctx);
 	if (err < 0) {
 		near_error("close channel error %d", err);
 		return NULL;
@@ -724,6 +859,7 @@ char *__seel_se_add(uint32_t se_idx, uint8_t ctrl_idx,
 		    uint8_t se_type, uint8_t ctrl_type)
 {
 	struct seel_se *se;
+	int i;
 
 	se = g_try_malloc0(sizeof(struct seel_se));
 	if (se == NULL)
@@ -739,9 +875,14 @@ char *__seel_se_add(uint32_t se_idx, uint8_t ctrl_idx,
 	se->ctrl_type = ctrl_type;
 	se->ctrl_driver = __seel_driver_ctrl_find(ctrl_type);
 	se->io_driver = __seel_driver_io_find(se_type);
-	se->ioreq_pending = false;
-	se->cert_driver = __seel_driver_cert_get();
-	se->basic_channel = __seel_channel_add(se, 0, NULL, 0, true);
+
+	for (i = 0; i <= SE_MAX_CHANNELS; i++)
+		g_queue_init(&se->ioq[i].reqs);
+
+	for (i = 0; i < SEEL_IO_PRIORITY_MAX; i++)
+		se->lane_credit[i] = lane_weight[i];
+
+	se->basic_channel = __seel_channel_add(se, 0, NULL, 0, true, NULL);
 	se->channel_hash = g_hash_table_new_full(g_str_hash, g_str_equal,
 							NULL, se_channel_free);
 	se->enabled = false;
@@ -23,6 +23,7 @@ enum seel_controller_type {
 	SEEL_CONTROLLER_MODEM,
 	SEEL_CONTROLLER_ASSD,
 	SEEL_CONTROLLER_PCSC,
+	SEEL_CONTROLLER_EMULATOR,
 	SEEL_CONTROLLER_UNKNOWN = 0xff
 };
 
@@ -31,6 +32,7 @@ enum seel_se_type {
 	SEEL_SE_ASSD, /* Advanced Security SD SE */
 	SEEL_SE_PCSC, /* PCSC compatible SE */
 	SEEL_SE_UICC, /* SIM card SE */
+	SEEL_SE_EMULATOR, /* In-process emulated SE */
 	SEEL_SE_UNKNOWN = 0xff
 };
 
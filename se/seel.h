@@ -28,8 +28,17 @@
 struct seel_se;
 struct seel_channel;
 struct seel_ace;
+struct seel_ace_cache;
 struct seel_apdu;
 
+enum seel_io_priority {
+	SEEL_IO_PRIORITY_CONTROL = 0,
+	SEEL_IO_PRIORITY_HIGH,
+	SEEL_IO_PRIORITY_NORMAL,
+	SEEL_IO_PRIORITY_LOW,
+	SEEL_IO_PRIORITY_MAX,
+};
+
 int __seel_manager_init(DBusConnection *conn);
 void __seel_manager_cleanup(void);
 
@@ -43,9 +52,17 @@ struct seel_se *__seel_se_get(uint32_t se_idx, uint8_t ctrl_idx,
 			      uint8_t ctrl_type);
 const char *__seel_se_get_path(struct seel_se *se);
 uint8_t __seel_se_get_type(struct seel_se *se);
-const GSList *__seel_se_get_hashes(struct seel_se *se, const char *owner);
 int __seel_se_queue_io(struct seel_se *se, struct seel_apdu *apdu,
 		       transceive_cb_t cb, void *context);
+int __seel_se_queue_lane_io(struct seel_se *se, uint8_t chn,
+			    enum seel_io_priority priority,
+			    struct seel_apdu *apdu,
+			    transceive_cb_t cb, void *context);
+int __seel_se_queue_channel_io(struct seel_channel *channel,
+			       struct seel_apdu *apdu,
+			       transceive_cb_t cb, void *context);
+void __seel_se_set_lane(struct seel_se *se, uint8_t chn,
+			enum seel_io_priority lane);
 void __seel_se_list(DBusMessageIter *iter, void *user_data);
 char *__seel_se_add(uint32_t se_idx, uint8_t ctrl_idx,
 		    uint8_t se_type, uint8_t ctrl_type);
@@ -65,22 +82,41 @@ struct seel_apdu *__seel_apdu_select_aid(uint8_t channel, uint8_t *aid, size_t a
 struct seel_apdu *__seel_apdu_get_all_gp_data(void);
 struct seel_apdu *__seel_apdu_get_next_gp_data(size_t length);
 struct seel_apdu *__seel_apdu_get_refresh_gp_data(void);
+struct seel_apdu *__seel_apdu_get_cplc_data(void);
 int __seel_apdu_resp_status(uint8_t *apdu, size_t apdu_length);
+int __seel_apdu_init(void);
+void __seel_apdu_cleanup(void);
 
 struct seel_channel *__seel_channel_add(struct seel_se *se,
 					uint8_t channel,
 					unsigned char *aid, size_t aid_len,
-					bool basic);
+					bool basic, const char *owner);
 void __seel_channel_remove(struct seel_channel *channel);
 char *__seel_channel_get_path(struct seel_channel *channel);
 uint8_t __seel_channel_get_channel(struct seel_channel *channel);
 uint8_t *__seel_channel_get_aid(struct seel_channel *channel, size_t *aid_len);
 struct seel_se *__seel_channel_get_se(struct seel_channel *channel);
 bool __seel_channel_is_basic(struct seel_channel *channel);
+enum seel_io_priority __seel_channel_get_priority(
+					struct seel_channel *channel);
+struct seel_ace_cache *__seel_channel_get_ace_cache(
+					struct seel_channel *channel);
 
 gboolean __seel_ace_add(gpointer user_data);
 int __seel_ace_remove(struct seel_se *se);
-bool __seel_ace_apdu_allowed(struct seel_channel *channel, uint8_t *app_hash,
+bool __seel_ace_apdu_allowed(struct seel_channel *channel, const char *owner,
 			     uint8_t *apdu, size_t apdu_len);
+void __seel_ace_resolve(struct seel_channel *channel, const char *owner);
+struct seel_ace_cache *__seel_ace_cache_new(void);
+void __seel_ace_cache_free(struct seel_ace_cache *cache);
 int __seel_ace_init(void);
 void __seel_ace_cleanup(void);
+
+typedef void (*seel_cert_cb_t)(const char *owner, const GSList *hashes,
+							void *user_data);
+
+bool __seel_cert_lookup(const char *owner, const GSList **hashes);
+int __seel_cert_get_hashes(const char *owner, seel_cert_cb_t cb,
+							void *user_data);
+int __seel_cert_init(DBusConnection *conn);
+void __seel_cert_cleanup(void);
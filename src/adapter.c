@@ -80,6 +80,10 @@ struct near_adapter {
 
 	guint presence_timeout;
 	guint dep_timer;
+
+	/* WriteNDEFBatch() payload, written to the tags found until timeout */
+	struct near_ndef_message *batch_ndef;
+	guint batch_timer;
 };
 
 struct near_adapter_ioreq {
@@ -105,6 +109,11 @@ static void free_adapter(gpointer data)
 	if (adapter->dep_timer > 0)
 		g_source_remove(adapter->dep_timer);
 
+	if (adapter->batch_timer > 0)
+		g_source_remove(adapter->batch_timer);
+
+	near_ndef_msg_free(adapter->batch_ndef);
+
 	g_free(adapter->name);
 	g_free(adapter->path);
 	g_hash_table_destroy(adapter->tags);
@@ -515,13 +524,66 @@ void __near_adapter_stop_check_presence(uint32_t adapter_idx,
 	}
 }
 
+static gboolean batch_timeout(gpointer user_data)
+{
+	struct near_adapter *adapter = user_data;
+
+	DBG("%s", adapter->path);
+
+	near_ndef_msg_free(adapter->batch_ndef);
+	adapter->batch_ndef = NULL;
+	adapter->batch_timer = 0;
+
+	return FALSE;
+}
+
+static DBusMessage *write_ndef_batch(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct near_adapter *adapter = data;
+	DBusMessageIter iter;
+	uint32_t window;
+
+	DBG("conn %p", conn);
+
+	if (!dbus_message_iter_init(msg, &iter) ||
+			dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_UINT32)
+		return __near_error_invalid_arguments(msg);
+
+	dbus_message_iter_get_basic(&iter, &window);
+	if (window == 0)
+		return __near_error_invalid_arguments(msg);
+
+	if (adapter->batch_ndef)
+		return __near_error_in_progress(msg);
+
+	/* Built once, only framed for each tag type when written */
+	adapter->batch_ndef = __ndef_build_from_message(msg);
+	if (!adapter->batch_ndef)
+		return __near_error_failed(msg, EINVAL);
+
+	adapter->batch_timer = g_timeout_add_seconds(window, batch_timeout,
+								adapter);
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
+}
+
 static const GDBusMethodTable adapter_methods[] = {
 	{ GDBUS_METHOD("StartPollLoop", GDBUS_ARGS({"name", "s"}), NULL,
 							start_poll_loop) },
 	{ GDBUS_METHOD("StopPollLoop", NULL, NULL, stop_poll_loop) },
+	{ GDBUS_METHOD("WriteNDEFBatch",
+			GDBUS_ARGS({"window", "u"}, {"attributes", "a{sv}"}),
+			NULL, write_ndef_batch) },
 	{ },
 };
 
+static const GDBusSignalTable adapter_signals[] = {
+	{ GDBUS_SIGNAL("TagWritten",
+			GDBUS_ARGS({"tag", "o"}, {"status", "i"})) },
+	{ }
+};
+
 static const GDBusPropertyTable adapter_properties[] = {
 	{ "Mode", "s", property_get_mode },
 	{ "Powered", "b", property_get_powered, property_set_powered },
@@ -664,7 +726,7 @@ int __near_adapter_add(struct near_adapter *adapter)
 
 	g_dbus_register_interface(connection, adapter->path,
 					NFC_ADAPTER_INTERFACE,
-					adapter_methods, NULL,
+					adapter_methods, adapter_signals,
 					adapter_properties, adapter, NULL);
 
 	return 0;
@@ -680,6 +742,53 @@ void __near_adapter_remove(struct near_adapter *adapter)
 	g_hash_table_remove(adapter_hash, GINT_TO_POINTER(adapter->idx));
 }
 
+static void batch_write_cb(uint32_t adapter_idx, uint32_t target_idx,
+								int status)
+{
+	struct near_adapter *adapter;
+	char *path;
+	int32_t result = status;
+
+	DBG("status %d", status);
+
+	adapter = g_hash_table_lookup(adapter_hash,
+					GINT_TO_POINTER(adapter_idx));
+	if (!adapter)
+		return;
+
+	path = g_strdup_printf("%s/tag%u", adapter->path, target_idx);
+	if (!path)
+		return;
+
+	g_dbus_emit_signal(connection, adapter->path,
+			NFC_ADAPTER_INTERFACE, "TagWritten",
+			DBUS_TYPE_OBJECT_PATH, &path,
+			DBUS_TYPE_INT32, &result,
+			DBUS_TYPE_INVALID);
+
+	g_free(path);
+}
+
+static int adapter_batch_write(struct near_adapter *adapter,
+						uint32_t target_idx)
+{
+	struct near_tag *tag;
+	int err;
+
+	DBG("target %u", target_idx);
+
+	tag = g_hash_table_lookup(adapter->tags, GINT_TO_POINTER(target_idx));
+	if (!tag)
+		return -ENODEV;
+
+	err = __near_tag_queue_write(tag, adapter->batch_ndef,
+							batch_write_cb);
+	if (err < 0)
+		batch_write_cb(adapter->idx, target_idx, err);
+
+	return err;
+}
+
 static void tag_read_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 {
 	struct near_adapter *adapter;
@@ -699,6 +808,11 @@ static void tag_read_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 		return;
 	}
 
+	/* Check presence is restarted once the write is done */
+	if (adapter->batch_ndef &&
+			adapter_batch_write(adapter, target_idx) == 0)
+		return;
+
 	adapter->presence_timeout =
 		g_timeout_add_seconds(CHECK_PRESENCE_PERIOD,
 					check_presence, adapter);
@@ -834,6 +948,14 @@ int __near_adapter_add_target(uint32_t idx, uint32_t target_idx,
 	adapter->rf_mode = NEAR_ADAPTER_RF_MODE_INITIATOR;
 	rf_mode_changed(adapter);
 
+	/* Published first, reading the tag may complete synchronously */
+	if (nfcid_len > 0)
+		__near_ring_target_found(idx, target_idx, protocols,
+						nfcid, nfcid_len);
+	else
+		__near_ring_target_found(idx, target_idx, protocols,
+					iso15693_uid, iso15693_uid_len);
+
 	if (protocols & NFC_PROTO_NFC_DEP_MASK)
 		ret = adapter_add_device(adapter, target_idx,
 						nfcid, nfcid_len);
@@ -843,6 +965,9 @@ int __near_adapter_add_target(uint32_t idx, uint32_t target_idx,
 					iso15693_dsfid,
 					iso15693_uid_len, iso15693_uid);
 
+	if (ret < 0)
+		__near_ring_target_lost(idx, target_idx);
+
 	if (ret < 0 && adapter->constant_poll)
 		__near_adapter_start_poll(adapter);
 
@@ -862,6 +987,8 @@ int __near_adapter_remove_target(uint32_t idx, uint32_t target_idx)
 	adapter->rf_mode = NEAR_ADAPTER_RF_MODE_IDLE;
 	rf_mode_changed(adapter);
 
+	__near_ring_target_lost(idx, target_idx);
+
 	if (g_hash_table_remove(adapter->tags, GINT_TO_POINTER(target_idx)))
 		return 0;
 
@@ -28,6 +28,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <glib.h>
 
@@ -39,17 +41,144 @@
 #define DBUS_TIMEOUT_USE_DEFAULT (-1)
 #endif
 
+#define NDEF_AGENT_WILDCARD		'*'
+#define NDEF_AGENT_BATCH_MAX		64
+#define NDEF_AGENT_BATCH_TIMEOUT	500	/* ms */
+
 static DBusConnection *connection = NULL;
 static GHashTable *ndef_app_hash;
+static GSList *ndef_prefix_agents;
 static GHashTable *ho_agent_hash;
 
+/* Serialized NDEF, shared by all agent deliveries of one tap */
+struct ndef_blob {
+	int refcount;
+	size_t length;
+	uint8_t data[];
+};
+
+struct ndef_agent_options {
+	unsigned int batch_size;
+	unsigned int batch_timeout;
+	int channel_fd;
+};
+
+/*
+ * Fast channel frame header, all fields little endian. It is followed by
+ * uid_len bytes of UID and ndef_len bytes of raw NDEF.
+ */
+struct ndef_channel_header {
+	uint32_t frame_len;
+	uint32_t adapter_idx;
+	uint32_t target_idx;
+	uint32_t ndef_len;
+	uint8_t protocol;
+	uint8_t uid_len;
+	uint8_t reserved[2];
+} __attribute__((packed));
+
+struct ndef_batch_entry {
+	char *record_path;
+	uint8_t *payload;
+	size_t payload_len;
+	struct ndef_blob *ndef;
+};
+
 struct near_ndef_agent {
 	char *sender;
 	char *path;
 	char *record_type;
+	size_t prefix_len;	/* non zero for "type*" registrations */
 	guint watch;
+
+	unsigned int batch_size;
+	unsigned int batch_timeout;
+	GSList *batch;		/* most recent entry first */
+	unsigned int batch_len;
+	guint batch_timer;
+
+	GIOChannel *channel;	/* fast channel, replaces D-Bus delivery */
+	guint channel_watch;
+	unsigned int channel_serial;	/* last tap sent on the channel */
 };
 
+static unsigned int ndef_tap_serial;
+
+static struct ndef_blob *ndef_blob_new(GList *records)
+{
+	struct ndef_blob *blob;
+	GList *list;
+	size_t length = 0;
+
+	for (list = records; list; list = list->next) {
+		size_t data_len;
+
+		if (__near_ndef_record_get_data(list->data, &data_len))
+			length += data_len;
+	}
+
+	blob = g_try_malloc(sizeof(*blob) + length);
+	if (!blob)
+		return NULL;
+
+	blob->refcount = 1;
+	blob->length = 0;
+
+	for (list = records; list; list = list->next) {
+		uint8_t *data;
+		size_t data_len;
+
+		data = __near_ndef_record_get_data(list->data, &data_len);
+		if (!data)
+			continue;
+
+		memcpy(blob->data + blob->length, data, data_len);
+		blob->length += data_len;
+	}
+
+	return blob;
+}
+
+static struct ndef_blob *ndef_blob_ref(struct ndef_blob *blob)
+{
+	blob->refcount++;
+
+	return blob;
+}
+
+static void ndef_blob_unref(struct ndef_blob *blob)
+{
+	if (!blob)
+		return;
+
+	if (--blob->refcount > 0)
+		return;
+
+	g_free(blob);
+}
+
+static void ndef_batch_entry_free(gpointer data)
+{
+	struct ndef_batch_entry *entry = data;
+
+	g_free(entry->record_path);
+	g_free(entry->payload);
+	ndef_blob_unref(entry->ndef);
+	g_free(entry);
+}
+
+static void ndef_agent_batch_clear(struct near_ndef_agent *agent)
+{
+	if (agent->batch_timer > 0) {
+		g_source_remove(agent->batch_timer);
+		agent->batch_timer = 0;
+	}
+
+	g_slist_free_full(agent->batch, ndef_batch_entry_free);
+	agent->batch = NULL;
+	agent->batch_len = 0;
+}
+
 struct near_handover_agent {
 	enum ho_agent_carrier carrier;
 	guint watch;
@@ -57,6 +186,117 @@ struct near_handover_agent {
 	char *path;
 };
 
+static void ndef_agent_channel_close(struct near_ndef_agent *agent)
+{
+	if (!agent->channel)
+		return;
+
+	DBG("%s %s", agent->sender, agent->path);
+
+	if (agent->channel_watch > 0) {
+		g_source_remove(agent->channel_watch);
+		agent->channel_watch = 0;
+	}
+
+	g_io_channel_shutdown(agent->channel, FALSE, NULL);
+	g_io_channel_unref(agent->channel);
+	agent->channel = NULL;
+}
+
+static gboolean ndef_agent_channel_event(GIOChannel *channel,
+					GIOCondition condition,
+					gpointer user_data)
+{
+	struct near_ndef_agent *agent = user_data;
+
+	DBG("condition 0x%x", condition);
+
+	/* Agent closed its end, fall back to D-Bus delivery */
+	agent->channel_watch = 0;
+	ndef_agent_channel_close(agent);
+
+	return FALSE;
+}
+
+static int ndef_agent_channel_open(struct near_ndef_agent *agent, int fd)
+{
+	int type;
+	socklen_t len = sizeof(type);
+
+	/* Frames are sent in one go, so message boundaries must be kept */
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+		return -errno;
+
+	if (type != SOCK_SEQPACKET && type != SOCK_DGRAM)
+		return -EINVAL;
+
+	agent->channel = g_io_channel_unix_new(fd);
+	if (!agent->channel)
+		return -ENOMEM;
+
+	g_io_channel_set_close_on_unref(agent->channel, TRUE);
+
+	agent->channel_watch = g_io_add_watch(agent->channel,
+					G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+					ndef_agent_channel_event, agent);
+
+	return 0;
+}
+
+static int ndef_agent_channel_send(struct near_ndef_agent *agent,
+					uint32_t adapter_idx,
+					uint32_t target_idx, uint32_t protocol,
+					uint8_t *uid, uint8_t uid_len,
+					struct ndef_blob *ndef)
+{
+	struct ndef_channel_header hdr;
+	struct iovec iov[3];
+	struct msghdr msg;
+	ssize_t len;
+	int fd;
+
+	if (agent->channel_serial == ndef_tap_serial)
+		return 0;
+
+	agent->channel_serial = ndef_tap_serial;
+
+	memset(&hdr, 0, sizeof(hdr));
+	near_put_le32(sizeof(hdr) + uid_len + ndef->length, &hdr.frame_len);
+	near_put_le32(adapter_idx, &hdr.adapter_idx);
+	near_put_le32(target_idx, &hdr.target_idx);
+	near_put_le32(ndef->length, &hdr.ndef_len);
+	hdr.protocol = protocol;
+	hdr.uid_len = uid_len;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = uid;
+	iov[1].iov_len = uid_len;
+	iov[2].iov_base = ndef->data;
+	iov[2].iov_len = ndef->length;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 3;
+
+	fd = g_io_channel_unix_get_fd(agent->channel);
+
+	len = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (len < 0) {
+		int err = -errno;
+
+		/* A slow reader only loses this tap */
+		if (err == -EAGAIN)
+			near_error("NDEF agent %s channel full", agent->sender);
+		else
+			ndef_agent_channel_close(agent);
+
+		return err;
+	}
+
+	return 0;
+}
+
 static void ndef_agent_free(gpointer data)
 {
 	struct near_ndef_agent *agent = data;
@@ -68,6 +308,12 @@ static void ndef_agent_free(gpointer data)
 
 	g_dbus_remove_watch(connection, agent->watch);
 
+	ndef_agent_batch_clear(agent);
+	ndef_agent_channel_close(agent);
+
+	if (agent->prefix_len)
+		ndef_prefix_agents = g_slist_remove(ndef_prefix_agents, agent);
+
 	g_free(agent->sender);
 	g_free(agent->path);
 	g_free(agent);
@@ -102,18 +348,115 @@ static void ndef_agent_disconnect(DBusConnection *conn, void *user_data)
 	g_hash_table_remove(ndef_app_hash, agent->record_type);
 }
 
-static void append_ndef(DBusMessageIter *iter, void *user_data)
+static void append_ndef_values(DBusMessageIter *iter, const char *path,
+					uint8_t *payload, size_t payload_len,
+					struct ndef_blob *ndef)
+{
+	DBusMessageIter dict;
+	uint8_t *data = ndef->data;
+
+	near_dbus_dict_open(iter, &dict);
+	near_dbus_dict_append_basic(&dict, "Record",
+					DBUS_TYPE_STRING, &path);
+	near_dbus_dict_append_fixed_array(&dict, "Payload",
+				DBUS_TYPE_BYTE, &payload, payload_len);
+	near_dbus_dict_append_fixed_array(&dict, "NDEF",
+				DBUS_TYPE_BYTE, &data, ndef->length);
+	near_dbus_dict_close(iter, &dict);
+}
+
+static void ndef_agent_flush(struct near_ndef_agent *agent)
+{
+	DBusMessageIter iter, array;
+	DBusMessage *message;
+	GSList *list;
+
+	DBG("%s %s: %u entries", agent->sender, agent->path, agent->batch_len);
+
+	if (!agent->batch)
+		return;
+
+	message = dbus_message_new_method_call(agent->sender, agent->path,
+					NFC_NDEF_AGENT_INTERFACE,
+					"GetNDEFBatch");
+	if (!message)
+		goto done;
+
+	agent->batch = g_slist_reverse(agent->batch);
+
+	dbus_message_iter_init_append(message, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+			DBUS_TYPE_ARRAY_AS_STRING
+			DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+			DBUS_TYPE_STRING_AS_STRING DBUS_TYPE_VARIANT_AS_STRING
+			DBUS_DICT_ENTRY_END_CHAR_AS_STRING, &array);
+
+	for (list = agent->batch; list; list = list->next) {
+		struct ndef_batch_entry *entry = list->data;
+
+		append_ndef_values(&array, entry->record_path, entry->payload,
+					entry->payload_len, entry->ndef);
+	}
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	dbus_message_set_no_reply(message, TRUE);
+
+	g_dbus_send_message(connection, message);
+
+done:
+	ndef_agent_batch_clear(agent);
+}
+
+static gboolean ndef_agent_batch_timeout(gpointer user_data)
+{
+	struct near_ndef_agent *agent = user_data;
+
+	agent->batch_timer = 0;
+
+	ndef_agent_flush(agent);
+
+	return FALSE;
+}
+
+static void ndef_agent_queue_record(struct near_ndef_agent *agent,
+					const char *path, uint8_t *payload,
+					size_t payload_len,
+					struct ndef_blob *ndef)
 {
-	GList *records = user_data;
+	struct ndef_batch_entry *entry;
+
+	entry = g_try_malloc0(sizeof(*entry));
+	if (!entry)
+		return;
 
-	__near_ndef_append_records(iter, records);
+	entry->record_path = g_strdup(path);
+	if (payload_len > 0) {
+		entry->payload = g_malloc(payload_len);
+		memcpy(entry->payload, payload, payload_len);
+	}
+	entry->payload_len = payload_len;
+	entry->ndef = ndef_blob_ref(ndef);
+
+	agent->batch = g_slist_prepend(agent->batch, entry);
+	agent->batch_len++;
+
+	if (agent->batch_len >= agent->batch_size) {
+		ndef_agent_flush(agent);
+		return;
+	}
+
+	if (agent->batch_timer == 0)
+		agent->batch_timer = g_timeout_add(agent->batch_timeout,
+						ndef_agent_batch_timeout,
+						agent);
 }
 
 static void ndef_agent_push_records(struct near_ndef_agent *agent,
 					struct near_ndef_record *record,
-							GList *records)
+					struct ndef_blob *ndef)
 {
-	DBusMessageIter iter, dict;
+	DBusMessageIter iter;
 	DBusMessage *message;
 	char *path;
 	uint8_t *payload;
@@ -124,6 +467,15 @@ static void ndef_agent_push_records(struct near_ndef_agent *agent,
 	if (!agent->sender || !agent->path)
 		return;
 
+	path = __near_ndef_record_get_path(record);
+	payload = __near_ndef_record_get_payload(record, &payload_len);
+
+	if (agent->batch_size > 1) {
+		ndef_agent_queue_record(agent, path, payload, payload_len,
+									ndef);
+		return;
+	}
+
 	DBG("Sending NDEF to %s %s", agent->path, agent->sender);
 
 	message = dbus_message_new_method_call(agent->sender, agent->path,
@@ -132,19 +484,8 @@ static void ndef_agent_push_records(struct near_ndef_agent *agent,
 	if (!message)
 		return;
 
-	path = __near_ndef_record_get_path(record);
-	payload = __near_ndef_record_get_payload(record, &payload_len);
-
 	dbus_message_iter_init_append(message, &iter);
-
-	near_dbus_dict_open(&iter, &dict);
-	near_dbus_dict_append_basic(&dict, "Record",
-					DBUS_TYPE_STRING, &path);
-	near_dbus_dict_append_fixed_array(&dict, "Payload",
-				DBUS_TYPE_BYTE, &payload, payload_len);
-	near_dbus_dict_append_array(&dict, "NDEF",
-				DBUS_TYPE_BYTE, append_ndef, records);
-	near_dbus_dict_close(&iter, &dict);
+	append_ndef_values(&iter, path, payload, payload_len, ndef);
 
 	DBG("sending...");
 
@@ -153,16 +494,67 @@ static void ndef_agent_push_records(struct near_ndef_agent *agent,
 	g_dbus_send_message(connection, message);
 }
 
-void __near_agent_ndef_parse_records(GList *records)
+struct ndef_tap {
+	uint32_t adapter_idx;
+	uint32_t target_idx;
+	uint32_t protocol;
+	uint8_t *uid;
+	uint8_t uid_len;
+	GList *records;
+	struct ndef_blob *ndef;
+};
+
+static bool ndef_agent_dispatch(struct near_ndef_agent *agent,
+					struct near_ndef_record *record,
+					struct ndef_tap *tap)
+{
+	/* Serialize the NDEF only once, and only if someone wants it */
+	if (!tap->ndef) {
+		tap->ndef = ndef_blob_new(tap->records);
+		if (!tap->ndef)
+			return false;
+	}
+
+	if (agent->channel) {
+		int err;
+
+		err = ndef_agent_channel_send(agent, tap->adapter_idx,
+					tap->target_idx, tap->protocol,
+					tap->uid, tap->uid_len, tap->ndef);
+		if (err == 0 || err == -EAGAIN)
+			return true;
+	}
+
+	ndef_agent_push_records(agent, record, tap->ndef);
+
+	return true;
+}
+
+void __near_agent_ndef_parse_records(uint32_t adapter_idx,
+					uint32_t target_idx, uint32_t protocol,
+					uint8_t *uid, uint8_t uid_len,
+					GList *records)
 {
 	GList *list;
+	GSList *prefix;
 	struct near_ndef_record *record;
 	struct near_ndef_agent *agent;
+	struct ndef_tap tap;
 	char *type;
 
 	DBG("");
 
-	for (list = records, agent = NULL; list; list = list->next) {
+	tap.adapter_idx = adapter_idx;
+	tap.target_idx = target_idx;
+	tap.protocol = protocol;
+	tap.uid = uid;
+	tap.uid_len = uid_len;
+	tap.records = records;
+	tap.ndef = NULL;
+
+	ndef_tap_serial++;
+
+	for (list = records; list; list = list->next) {
 		record = list->data;
 		type  = __near_ndef_record_get_type(record);
 
@@ -172,18 +564,49 @@ void __near_agent_ndef_parse_records(GList *records)
 		DBG("Looking for type %s", type);
 
 		agent = g_hash_table_lookup(ndef_app_hash, type);
-		if (agent)
-			ndef_agent_push_records(agent, record, records);
+		if (agent && agent->prefix_len == 0 &&
+				!ndef_agent_dispatch(agent, record, &tap))
+			return;
+
+		for (prefix = ndef_prefix_agents; prefix;
+						prefix = prefix->next) {
+			agent = prefix->data;
+
+			if (strncmp(type, agent->record_type,
+						agent->prefix_len - 1) != 0)
+				continue;
+
+			if (!ndef_agent_dispatch(agent, record, &tap))
+				return;
+		}
 	}
+
+	ndef_blob_unref(tap.ndef);
+}
+
+/* Longest prefixes first, so that the most specific agent gets it first */
+static gint ndef_prefix_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct near_ndef_agent *agent_a = a;
+	const struct near_ndef_agent *agent_b = b;
+
+	return agent_b->prefix_len - agent_a->prefix_len;
 }
 
 static int ndef_register(const char *sender, const char *path,
-						const char *record_type)
+					const char *record_type,
+					struct ndef_agent_options *options)
 {
 	struct near_ndef_agent *agent;
+	size_t type_len;
+	int err;
 
 	DBG("%s registers path %s for %s", sender, path, record_type);
 
+	type_len = strlen(record_type);
+	if (type_len == 0)
+		return -EINVAL;
+
 	if (g_hash_table_lookup(ndef_app_hash, record_type))
 		return -EEXIST;
 
@@ -201,11 +624,38 @@ static int ndef_register(const char *sender, const char *path,
 		return -ENOMEM;
 	}
 
+	agent->batch_size = options->batch_size;
+	agent->batch_timeout = options->batch_timeout;
+
+	if (options->channel_fd >= 0) {
+		err = ndef_agent_channel_open(agent, options->channel_fd);
+		if (err < 0) {
+			g_free(agent->sender);
+			g_free(agent->path);
+			g_free(agent->record_type);
+			g_free(agent);
+			return err;
+		}
+
+		/* Now owned by the channel */
+		options->channel_fd = -1;
+	}
+
 	agent->watch = g_dbus_add_disconnect_watch(connection, sender,
 							ndef_agent_disconnect,
 							agent, NULL);
 	g_hash_table_insert(ndef_app_hash, agent->record_type, agent);
 
+	/*
+	 * "prefix*" registrations match every record type starting with
+	 * prefix, a lone "*" matches all records.
+	 */
+	if (record_type[type_len - 1] == NDEF_AGENT_WILDCARD) {
+		agent->prefix_len = type_len;
+		ndef_prefix_agents = g_slist_insert_sorted(ndef_prefix_agents,
+							agent, ndef_prefix_cmp);
+	}
+
 	return 0;
 }
 
@@ -223,6 +673,8 @@ static int ndef_unregister(const char *sender, const char *path,
 	if (strcmp(agent->path, path) != 0 || strcmp(agent->sender, sender) != 0)
 		return -EINVAL;
 
+	ndef_agent_flush(agent);
+
 	g_hash_table_remove(ndef_app_hash, record_type);
 
 	return 0;
@@ -712,6 +1164,7 @@ static DBusMessage *register_ndef_agent(DBusConnection *conn,
 {
 	DBusMessageIter iter;
 	const char *sender, *path, *type;
+	struct ndef_agent_options options = { 1, 0, -1 };
 	int err;
 
 	DBG("conn %p", conn);
@@ -732,13 +1185,123 @@ static DBusMessage *register_ndef_agent(DBusConnection *conn,
 
 	dbus_message_iter_get_basic(&iter, &type);
 
-	err = ndef_register(sender, path, type);
+	err = ndef_register(sender, path, type, &options);
 	if (err < 0)
 		return __near_error_failed(msg, -err);
 
 	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
 }
 
+static int parse_ndef_agent_options(DBusMessageIter *iter,
+					struct ndef_agent_options *options)
+{
+	DBusMessageIter dict;
+
+	options->batch_size = 1;
+	options->batch_timeout = NDEF_AGENT_BATCH_TIMEOUT;
+	options->channel_fd = -1;
+
+	if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY)
+		return -EINVAL;
+
+	dbus_message_iter_recurse(iter, &dict);
+
+	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+		DBusMessageIter entry, value;
+		const char *key;
+		int var;
+		uint32_t val;
+
+		dbus_message_iter_recurse(&dict, &entry);
+		dbus_message_iter_get_basic(&entry, &key);
+
+		dbus_message_iter_next(&entry);
+		dbus_message_iter_recurse(&entry, &value);
+
+		var = dbus_message_iter_get_arg_type(&value);
+
+		if (g_str_equal(key, "Channel")) {
+			if (var != DBUS_TYPE_UNIX_FD || options->channel_fd >= 0)
+				return -EINVAL;
+
+			dbus_message_iter_get_basic(&value,
+						&options->channel_fd);
+
+			dbus_message_iter_next(&dict);
+			continue;
+		}
+
+		if (var != DBUS_TYPE_UINT32)
+			return -EINVAL;
+
+		dbus_message_iter_get_basic(&value, &val);
+
+		if (g_str_equal(key, "BatchSize")) {
+			if (val == 0 || val > NDEF_AGENT_BATCH_MAX)
+				return -EINVAL;
+
+			options->batch_size = val;
+		} else if (g_str_equal(key, "BatchTimeout")) {
+			if (val == 0)
+				return -EINVAL;
+
+			options->batch_timeout = val;
+		} else {
+			return -EINVAL;
+		}
+
+		dbus_message_iter_next(&dict);
+	}
+
+	return 0;
+}
+
+static DBusMessage *register_ndef_agent_with_options(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBusMessageIter iter;
+	const char *sender, *path, *type;
+	struct ndef_agent_options options;
+	DBusMessage *reply;
+	int err;
+
+	DBG("conn %p", conn);
+
+	sender = dbus_message_get_sender(msg);
+
+	if (!dbus_message_iter_init(msg, &iter))
+		return __near_error_invalid_arguments(msg);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_OBJECT_PATH)
+		return __near_error_invalid_arguments(msg);
+
+	dbus_message_iter_get_basic(&iter, &path);
+	dbus_message_iter_next(&iter);
+
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING)
+		return __near_error_invalid_arguments(msg);
+
+	dbus_message_iter_get_basic(&iter, &type);
+	dbus_message_iter_next(&iter);
+
+	if (parse_ndef_agent_options(&iter, &options) < 0) {
+		reply = __near_error_invalid_arguments(msg);
+		goto done;
+	}
+
+	err = ndef_register(sender, path, type, &options);
+	if (err < 0)
+		reply = __near_error_failed(msg, -err);
+	else
+		reply = g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
+
+done:
+	if (options.channel_fd >= 0)
+		close(options.channel_fd);
+
+	return reply;
+}
+
 static DBusMessage *unregister_ndef_agent(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
@@ -781,6 +1344,10 @@ static const GDBusMethodTable manager_methods[] = {
 	{ GDBUS_METHOD("RegisterNDEFAgent",
 			GDBUS_ARGS({"path", "o"}, {"type", "s"}),
 			NULL, register_ndef_agent) },
+	{ GDBUS_METHOD("RegisterNDEFAgentWithOptions",
+			GDBUS_ARGS({"path", "o"}, {"type", "s"},
+						{"options", "a{sv}"}),
+			NULL, register_ndef_agent_with_options) },
 	{ GDBUS_METHOD("UnregisterNDEFAgent",
 			GDBUS_ARGS({"path", "o"}, {"type", "s"}),
 			NULL, unregister_ndef_agent) },
@@ -826,6 +1393,9 @@ void __near_agent_cleanup(void)
 	g_hash_table_destroy(ndef_app_hash);
 	ndef_app_hash = NULL;
 
+	g_slist_free(ndef_prefix_agents);
+	ndef_prefix_agents = NULL;
+
 	g_hash_table_foreach(ho_agent_hash, handover_agent_release, NULL);
 	g_hash_table_destroy(ho_agent_hash);
 	ho_agent_hash = NULL;
@@ -47,6 +47,8 @@
 
 #define DBUS_MANAGER_INTF		"org.freedesktop.DBus.ObjectManager"
 #define AGENT_REGISTER_TIMEOUT	2
+#define OOB_KEYS_REFRESH_TIMEOUT	30
+#define OOB_KEYS_READ_TIMEOUT		2000	/* ms */
 
 /* BT EIR list */
 #define EIR_UUID128_ALL		0x07 /* 128-bit UUID, all listed */
@@ -89,8 +91,37 @@ struct near_oob_data {
 	uint8_t security_manager_oob_flags;	/* see BT Core 4.0 */
 };
 
+/*
+ * Prebuilt local OOB blocks. Only the simple pairing hash and randomizer
+ * change between handover sessions, so everything else is laid out once
+ * and rebuilt lazily after a local adapter property change.
+ */
+struct bt_local_oob {
+	bool valid;
+	struct carrier_data plain;	/* without OOB pairing keys */
+	struct carrier_data sp;		/* with room for OOB pairing keys */
+	uint8_t sp_offset;		/* EIR_SP_HASH field offset in sp */
+};
+
+/*
+ * Local OOB pairing keys, read ahead of time from BlueZ. The controller
+ * keeps the keys until the next ReadLocalData call. They are replaced
+ * OOB_KEYS_REFRESH_TIMEOUT seconds after being read, used or not, which
+ * leaves the remote time to pair but keeps them from being reused by
+ * peer after peer.
+ */
+struct bt_oob_keys {
+	bool valid;
+	uint8_t hash[OOB_SP_SIZE];
+	uint8_t randomizer[OOB_SP_SIZE];
+	DBusPendingCall *pending;
+	guint refresh_timer;
+};
+
 static DBusConnection *bt_conn;
 static struct near_oob_data bt_def_oob_data;
+static struct bt_local_oob bt_local_oob;
+static struct bt_oob_keys bt_oob_keys;
 
 static guint watch;
 static guint removed_watch;
@@ -99,10 +130,178 @@ static guint adapter_props_watch;
 
 static guint register_bluez_timer;
 
+static bool bt_attached;
+
+static void bt_attach(void);
+static gboolean bt_oob_keys_refresh(gpointer user_data);
+
+static void bt_local_oob_invalidate(void)
+{
+	bt_local_oob.valid = false;
+}
+
+static void bt_oob_keys_invalidate(void)
+{
+	bt_oob_keys.valid = false;
+
+	if (bt_oob_keys.pending) {
+		dbus_pending_call_cancel(bt_oob_keys.pending);
+		dbus_pending_call_unref(bt_oob_keys.pending);
+		bt_oob_keys.pending = NULL;
+	}
+
+	if (bt_oob_keys.refresh_timer > 0) {
+		g_source_remove(bt_oob_keys.refresh_timer);
+		bt_oob_keys.refresh_timer = 0;
+	}
+}
+
+static void bt_oob_read_local_data_cb(DBusPendingCall *pending,
+							void *user_data)
+{
+	DBusMessage *reply;
+	DBusError error;
+	uint8_t *hash, *randomizer;
+	int hash_len, rndm_len;
+
+	DBG("");
+
+	if (pending != bt_oob_keys.pending)
+		return;
+
+	bt_oob_keys.pending = NULL;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	if (!reply)
+		return;
+
+	dbus_error_init(&error);
+
+	if (dbus_set_error_from_message(&error, reply)) {
+		near_error("%s", error.message);
+		dbus_error_free(&error);
+		goto done;
+	}
+
+	if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_BYTE, &hash,
+					&hash_len, DBUS_TYPE_ARRAY,
+					DBUS_TYPE_BYTE, &randomizer,
+					&rndm_len, DBUS_TYPE_INVALID))
+		goto done;
+
+	if ((hash_len != OOB_SP_SIZE) || (rndm_len != OOB_SP_SIZE)) {
+		DBG("no OOB data found !");
+		goto done;
+	}
+
+	memcpy(bt_oob_keys.hash, hash, OOB_SP_SIZE);
+	memcpy(bt_oob_keys.randomizer, randomizer, OOB_SP_SIZE);
+	bt_oob_keys.valid = true;
+
+	if (bt_oob_keys.refresh_timer > 0)
+		g_source_remove(bt_oob_keys.refresh_timer);
+
+	bt_oob_keys.refresh_timer =
+		g_timeout_add_seconds(OOB_KEYS_REFRESH_TIMEOUT,
+					bt_oob_keys_refresh, NULL);
+
+	DBG("OOB data found");
+
+done:
+	dbus_message_unref(reply);
+}
+
+/* OOB datas change on each session, fetch the next ones in background */
+static void bt_oob_keys_prefetch(void)
+{
+	DBusMessage *message;
+
+	if (bt_oob_keys.valid || bt_oob_keys.pending)
+		return;
+
+	if (!bt_conn || !bt_def_oob_data.def_adapter ||
+					!bt_def_oob_data.powered)
+		return;
+
+	DBG("%s", bt_def_oob_data.def_adapter);
+
+	message = dbus_message_new_method_call(BLUEZ_SERVICE,
+					bt_def_oob_data.def_adapter,
+					OOB_INTF, "ReadLocalData");
+	if (!message)
+		return;
+
+	if (!dbus_connection_send_with_reply(bt_conn, message,
+					&bt_oob_keys.pending,
+					OOB_KEYS_READ_TIMEOUT) ||
+					!bt_oob_keys.pending) {
+		near_error("Sending ReadLocalData failed");
+		bt_oob_keys.pending = NULL;
+		goto done;
+	}
+
+	dbus_pending_call_set_notify(bt_oob_keys.pending,
+					bt_oob_read_local_data_cb, NULL, NULL);
+
+done:
+	dbus_message_unref(message);
+}
+
+static gboolean bt_oob_keys_refresh(gpointer user_data)
+{
+	DBG("");
+
+	bt_oob_keys.refresh_timer = 0;
+	bt_oob_keys.valid = false;
+
+	bt_oob_keys_prefetch();
+
+	return FALSE;
+}
+
+/*
+ * Hand out the prefetched keys, they may be handed out again until the
+ * refresh timer fires. Right after the keys were dropped, wait for the
+ * pending read rather than sending a handover select without them. The
+ * read is usually done by then, and only blocks for OOB_KEYS_READ_TIMEOUT
+ * at most.
+ */
+static bool bt_oob_keys_get(uint8_t *hash, uint8_t *randomizer)
+{
+	DBusPendingCall *pending;
+
+	bt_oob_keys_prefetch();
+
+	pending = bt_oob_keys.pending;
+	if (!bt_oob_keys.valid && pending) {
+		DBG("Waiting for OOB data");
+
+		/* The reply notification drops the last reference */
+		dbus_pending_call_ref(pending);
+		dbus_pending_call_block(pending);
+		dbus_pending_call_unref(pending);
+	}
+
+	if (!bt_oob_keys.valid)
+		return false;
+
+	memcpy(hash, bt_oob_keys.hash, OOB_SP_SIZE);
+	memcpy(randomizer, bt_oob_keys.randomizer, OOB_SP_SIZE);
+
+	return true;
+}
+
 static void __bt_eir_free(struct near_oob_data *oob)
 {
 	DBG("");
 
+	if (oob == &bt_def_oob_data) {
+		bt_local_oob_invalidate();
+		bt_oob_keys_invalidate();
+	}
+
 	if (oob->def_adapter) {
 		g_free(oob->def_adapter);
 		oob->def_adapter = NULL;
@@ -401,6 +600,8 @@ static int bt_parse_properties(DBusMessage *reply, void *user_data)
 	g_free(bt_props->bd_addr);
 	g_free(bt_props->bt_name);
 
+	bt_local_oob_invalidate();
+
 	/* Grab properties from dbus */
 	if (extract_properties(reply, bt_props) < 0)
 		goto fail;
@@ -452,6 +653,8 @@ static gboolean bt_adapter_property_changed(DBusConnection *conn,
 		else
 			bt_def_oob_data.bt_name_len = 0;
 
+		bt_local_oob_invalidate();
+
 		DBG("%s: %s", property, name);
 	} else if (g_str_equal(property, "Class")) {
 		int class;
@@ -461,6 +664,7 @@ static gboolean bt_adapter_property_changed(DBusConnection *conn,
 
 		dbus_message_iter_get_basic(&var, &class);
 		bt_def_oob_data.class_of_device = class;
+		bt_local_oob_invalidate();
 
 		DBG("%s: %x", property, (unsigned int)bt_def_oob_data.class_of_device);
 	} else if (g_str_equal(property, "Powered")) {
@@ -472,6 +676,10 @@ static gboolean bt_adapter_property_changed(DBusConnection *conn,
 		dbus_message_iter_get_basic(&var, &powered);
 		bt_def_oob_data.powered = powered;
 
+		/* Controller OOB keys do not survive a power cycle */
+		bt_oob_keys_invalidate();
+		bt_oob_keys_prefetch();
+
 		DBG("%s: %d", property, bt_def_oob_data.powered);
 	}
 
@@ -503,6 +711,8 @@ static void bt_get_properties_cb(DBusPendingCall *pending, void *user_data)
 	else
 		DBG("Get Properties complete: %s", bt_props->def_adapter);
 
+	bt_oob_keys_prefetch();
+
 	adapter_props_watch = g_dbus_add_signal_watch(bt_conn, NULL, NULL,
 						ADAPTER_INTF,
 						ADAPTER_PROPERTY_CHANGED,
@@ -690,6 +900,8 @@ int __near_bluetooth_parse_oob_record(struct carrier_data *data,
 
 	DBG("");
 
+	bt_attach();
+
 	oob = g_try_malloc0(sizeof(struct near_oob_data));
 
 	if (data->type == BT_MIME_V2_1) {
@@ -791,82 +1003,18 @@ int __near_bluetooth_pair(void *data)
 	return bt_do_pairing(oob);
 }
 
-/* This function is synchronous as oob datas change on each session */
-static int bt_sync_oob_readlocaldata(DBusConnection *conn, char *adapter_path,
-							char *spair_hash,
-							char *spair_randomizer)
-{
-	DBusMessage *message, *reply;
-	DBusError error;
-	int hash_len, rndm_len;
-
-	message = dbus_message_new_method_call(BLUEZ_SERVICE, adapter_path,
-			OOB_INTF, "ReadLocalData");
-	if (!message)
-		return 0;
-
-	dbus_error_init(&error);
-
-	reply = dbus_connection_send_with_reply_and_block(conn,
-			message, -1, &error);
-
-	dbus_message_unref(message);
-
-	if (!reply) {
-		if (dbus_error_is_set(&error)) {
-			near_error("%s", error.message);
-			dbus_error_free(&error);
-		} else {
-			near_error("Failed to set property");
-		}
-		return 0;
-	}
-
-	if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_ARRAY,
-					DBUS_TYPE_BYTE, spair_hash,
-					&hash_len, DBUS_TYPE_ARRAY,
-					DBUS_TYPE_BYTE, spair_randomizer,
-					&rndm_len, DBUS_TYPE_INVALID))
-		goto done;
-
-	if ((hash_len != OOB_SP_SIZE) || (rndm_len != OOB_SP_SIZE)) {
-		DBG("no OOB data found !");
-		goto done;
-	}
-
-	dbus_message_unref(reply);
-	DBG("OOB data found");
-	return hash_len;
-
-done:
-	dbus_message_unref(reply);
-	return 0;
-}
-
 /*
- * External API to get bt properties
- * Prepare a "real" oob datas block
- * mime_props is a bitmask we use to add or not specific fields in the
- * oob frame (e.g.: OOB keys)
- * */
-struct carrier_data *__near_bluetooth_local_get_properties(uint16_t mime_props)
+ * Lay out a local oob datas block. When with_sp is set, room is left for
+ * the OOB pairing keys and their offset is returned through sp_offset.
+ */
+static void bt_local_oob_build(struct carrier_data *data, bool with_sp,
+							uint8_t *sp_offset)
 {
-	struct carrier_data *data = NULL;
 	uint8_t offset;
 
-	char hash[OOB_SP_SIZE];
-	char random[OOB_SP_SIZE];
-
-	/* Check adapter datas */
-	if (!bt_def_oob_data.def_adapter) {
-		near_error("No bt adapter info");
-		goto fail;
-	}
-
-	data = g_try_malloc0(sizeof(*data));
-	if (!data)
-		goto fail;
+	memset(data, 0, sizeof(*data));
 
+	data->type = BT_MIME_V2_1;
 	data->size = sizeof(uint16_t)	/* stored oob size */
 			+ BT_ADDRESS_SIZE;	/* device address */
 
@@ -886,25 +1034,18 @@ struct carrier_data *__near_bluetooth_local_get_properties(uint16_t mime_props)
 			(uint8_t *)&bt_def_oob_data.class_of_device, COD_SIZE);
 	offset += COD_SIZE;
 
-	/*
-	 * The following data are generated dynamically so we have to read the
-	 * local oob data. Only add OOB pairing keys if needed.
-	 */
-	if ((mime_props & OOB_PROPS_SP) != 0 &&
-			bt_sync_oob_readlocaldata(bt_conn,
-					bt_def_oob_data.def_adapter,
-					hash, random) == OOB_SP_SIZE) {
+	if (with_sp) {
 		data->size += 2 * (OOB_SP_SIZE + EIR_HEADER_LEN);
 
-		/* OOB datas */
+		*sp_offset = offset;
+
+		/* OOB datas, keys are filled in on each session */
 		data->data[offset++] = OOB_SP_SIZE + EIR_SIZE_LEN;
 		data->data[offset++] = EIR_SP_HASH;
-		memcpy(data->data + offset, hash, OOB_SP_SIZE);
 		offset += OOB_SP_SIZE;
 
 		data->data[offset++] = OOB_SP_SIZE + EIR_SIZE_LEN;
 		data->data[offset++] = EIR_SP_RANDOMIZER;
-		memcpy(data->data + offset, random, OOB_SP_SIZE);
 		offset += OOB_SP_SIZE;
 	}
 
@@ -933,6 +1074,69 @@ struct carrier_data *__near_bluetooth_local_get_properties(uint16_t mime_props)
 	}
 
 	data->data[0] = data->size ;
+}
+
+static int bt_local_oob_refresh(void)
+{
+	if (bt_local_oob.valid)
+		return 0;
+
+	if (!bt_def_oob_data.bd_addr)
+		return -ENODEV;
+
+	DBG("");
+
+	bt_local_oob_build(&bt_local_oob.plain, false, NULL);
+	bt_local_oob_build(&bt_local_oob.sp, true, &bt_local_oob.sp_offset);
+
+	bt_local_oob.valid = true;
+
+	return 0;
+}
+
+/*
+ * External API to get bt properties
+ * Prepare a "real" oob datas block
+ * mime_props is a bitmask we use to add or not specific fields in the
+ * oob frame (e.g.: OOB keys)
+ * */
+struct carrier_data *__near_bluetooth_local_get_properties(uint16_t mime_props)
+{
+	struct carrier_data *data = NULL;
+	uint8_t offset;
+
+	uint8_t hash[OOB_SP_SIZE];
+	uint8_t random[OOB_SP_SIZE];
+
+	bt_attach();
+
+	/* Check adapter datas */
+	if (!bt_def_oob_data.def_adapter ||
+			bt_local_oob_refresh() < 0) {
+		near_error("No bt adapter info");
+		goto fail;
+	}
+
+	data = g_try_malloc0(sizeof(*data));
+	if (!data)
+		goto fail;
+
+	/*
+	 * The OOB pairing keys are generated dynamically and read ahead of
+	 * time. Only add them if needed and already available.
+	 */
+	if ((mime_props & OOB_PROPS_SP) != 0 &&
+			bt_oob_keys_get(hash, random)) {
+		memcpy(data, &bt_local_oob.sp, sizeof(*data));
+
+		offset = bt_local_oob.sp_offset + EIR_HEADER_LEN;
+		memcpy(data->data + offset, hash, OOB_SP_SIZE);
+
+		offset += OOB_SP_SIZE + EIR_HEADER_LEN;
+		memcpy(data->data + offset, random, OOB_SP_SIZE);
+	} else {
+		memcpy(data, &bt_local_oob.plain, sizeof(*data));
+	}
 
 	if (bt_def_oob_data.powered)
 		data->state = CPS_ACTIVE;
@@ -1104,10 +1308,56 @@ static int bt_prepare_handlers(DBusConnection *conn)
 	return 0;
 }
 
+/*
+ * BlueZ is only watched for once it is on the bus, or once a handover
+ * needs it, keeping the D-Bus round trips it involves out of the daemon
+ * startup.
+ */
+static void bt_attach(void)
+{
+	if (bt_attached || !bt_conn)
+		return;
+
+	DBG("");
+
+	if (bt_prepare_handlers(bt_conn) == 0)
+		bt_attached = true;
+}
+
+static void bt_name_has_owner_cb(DBusPendingCall *pending, void *user_data)
+{
+	DBusMessage *reply;
+	dbus_bool_t has_owner = FALSE;
+
+	reply = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	if (!reply)
+		return;
+
+	if (!dbus_message_get_args(reply, NULL, DBUS_TYPE_BOOLEAN, &has_owner,
+							DBUS_TYPE_INVALID))
+		has_owner = FALSE;
+
+	dbus_message_unref(reply);
+
+	DBG("BlueZ %s", has_owner ? "running" : "not running");
+
+	/*
+	 * Legacy BlueZ adapter properties are fetched asynchronously,
+	 * get them before the first handover asks for them.
+	 */
+	if (has_owner)
+		bt_attach();
+}
+
 void __near_bluetooth_legacy_start(void)
 {
 	DBG("");
 
+	/* Not attached yet, the first handover will do it */
+	if (!bt_attached)
+		return;
+
 	bt_prepare_handlers(bt_conn);
 }
 
@@ -1115,6 +1365,9 @@ void __near_bluetooth_legacy_stop(void)
 {
 	DBG("");
 
+	if (!bt_attached)
+		return;
+
 	g_dbus_remove_watch(bt_conn, watch);
 	watch = 0;
 
@@ -1141,6 +1394,7 @@ void __near_bluetooth_cleanup(void)
  */
 int __near_bluetooth_init(void)
 {
+	const char *service = BLUEZ_SERVICE;
 	DBusError err;
 
 	DBG("");
@@ -1162,6 +1416,10 @@ int __near_bluetooth_init(void)
 	g_dbus_set_disconnect_function(bt_conn, bt_dbus_disconnect_cb,
 						NULL, NULL);
 
-	/* Set bluez event handlers */
-	return bt_prepare_handlers(bt_conn);
+	/* BlueZ event handlers are set once BlueZ is seen, see bt_attach() */
+	return bt_generic_call(bt_conn, NULL, DBUS_SERVICE_DBUS,
+				DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS,
+				"NameHasOwner", bt_name_has_owner_cb,
+				DBUS_TYPE_STRING, &service,
+				DBUS_TYPE_INVALID);
 }
@@ -318,7 +318,10 @@ int near_device_add_records(struct near_device *device, GList *records,
 		device->records = g_list_append(device->records, record);
 	}
 
-	__near_agent_ndef_parse_records(device->records);
+	__near_agent_ndef_parse_records(device->adapter_idx,
+					device->target_idx, NFC_PROTO_NFC_DEP,
+					device->nfcid, device->nfcid_len,
+					device->records);
 
 	if (cb)
 		cb(device->adapter_idx, device->target_idx, status);
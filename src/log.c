@@ -72,8 +72,9 @@ void near_debug(const char *format, ...)
 	va_end(ap);
 }
 
-extern struct near_debug_desc __start___debug[];
-extern struct near_debug_desc __stop___debug[];
+/* Weak, as the section is empty when DBG() is compiled out */
+extern struct near_debug_desc __start___debug[] __attribute__((weak));
+extern struct near_debug_desc __stop___debug[] __attribute__((weak));
 
 static gchar **enabled = NULL;
 
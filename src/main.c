@@ -27,8 +27,12 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <stddef.h>
 #include <signal.h>
 #include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <gdbus.h>
 
@@ -38,10 +42,12 @@ static struct {
 	bool constant_poll;
 	bool default_powered;
 	bool reset_on_error;
+	bool tag_event_ring;
 } near_settings  = {
 	.constant_poll = FALSE,
 	.default_powered = FALSE,
 	.reset_on_error = TRUE,
+	.tag_event_ring = FALSE,
 };
 
 static GKeyFile *load_config(const char *file)
@@ -93,6 +99,13 @@ static void parse_config(GKeyFile *config)
 		near_settings.reset_on_error = boolean;
 
 	g_clear_error(&error);
+
+	boolean = g_key_file_get_boolean(config, "General",
+						"TagEventRing", &error);
+	if (!error)
+		near_settings.tag_event_ring = boolean;
+
+	g_clear_error(&error);
 }
 
 static GMainLoop *main_loop = NULL;
@@ -174,9 +187,59 @@ static void disconnect_callback(DBusConnection *conn, void *user_data)
 	g_main_loop_quit(main_loop);
 }
 
+static gint64 start_time;
+
+/*
+ * Tell systemd that the service is up, once adapters are discovered and
+ * powered. This is the same as sd_notify(0, "READY=1"), without linking
+ * against libsystemd.
+ */
+void __near_notify_ready(void)
+{
+	static bool ready = false;
+	struct sockaddr_un addr;
+	const char *path;
+	socklen_t len;
+	int fd;
+
+	if (ready)
+		return;
+
+	ready = true;
+
+	near_info("Ready in %" G_GINT64_FORMAT " ms",
+			(g_get_monotonic_time() - start_time) / 1000);
+
+	path = getenv("NOTIFY_SOCKET");
+	if (!path || (path[0] != '/' && path[0] != '@') ||
+			strlen(path) >= sizeof(addr.sun_path))
+		return;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	/* Abstract namespace socket */
+	if (addr.sun_path[0] == '@')
+		addr.sun_path[0] = '\0';
+
+	len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	if (sendto(fd, "READY=1", 7, MSG_NOSIGNAL,
+				(struct sockaddr *) &addr, len) < 0)
+		near_error("Can't notify readiness: %s", strerror(errno));
+
+	close(fd);
+}
+
 static gchar *option_debug = NULL;
 static gchar *option_plugin = NULL;
 static gchar *option_noplugin = NULL;
+static gchar *option_trace = NULL;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
 
@@ -202,6 +265,8 @@ static GOptionEntry options[] = {
 				"Specify plugins to load", "NAME,..." },
 	{ "noplugin", 'P', 0, G_OPTION_ARG_STRING, &option_noplugin,
 				"Specify plugins not to load", "NAME,..." },
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &option_trace,
+				"Record trace points to FILE", "FILE" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
 	{ NULL },
@@ -218,6 +283,9 @@ bool near_setting_get_bool(const char *key)
 	if (g_str_equal(key, "ResetOnError"))
 		return near_settings.reset_on_error;
 
+	if (g_str_equal(key, "TagEventRing"))
+		return near_settings.tag_event_ring;
+
 	return false;
 }
 
@@ -229,6 +297,7 @@ int main(int argc, char *argv[])
 	DBusError err;
 	GKeyFile *config;
 	guint signal;
+	int adapters_err;
 
 	context = g_option_context_new(NULL);
 	g_option_context_add_main_entries(context, options, NULL);
@@ -249,10 +318,25 @@ int main(int argc, char *argv[])
 		exit(0);
 	}
 
+	start_time = g_get_monotonic_time();
+
 	main_loop = g_main_loop_new(NULL, FALSE);
 
 	signal = setup_signalfd();
 
+	__near_log_init(option_debug, option_detach);
+
+	if (__near_netlink_init() < 0) {
+		near_error("*** NETLINK INITIALIZATION FAILED ***");
+		exit(1);
+	}
+
+	/*
+	 * Ask the kernel for its adapters right away, they are added from
+	 * the main loop while the bus name and plugins are set up.
+	 */
+	adapters_err = __near_netlink_get_adapters();
+
 	dbus_error_init(&err);
 
 	conn = g_dbus_setup_bus(DBUS_BUS_SYSTEM, NFC_SERVICE, &err);
@@ -267,18 +351,14 @@ int main(int argc, char *argv[])
 
 	g_dbus_set_disconnect_function(conn, disconnect_callback, NULL, NULL);
 
-	__near_log_init(option_debug, option_detach);
 	__near_dbus_init(conn);
+	__near_trace_init(option_trace);
 
 	config = load_config(CONFIGDIR "/main.conf");
 
 	parse_config(config);
 
-	if (__near_netlink_init() < 0) {
-		near_error("*** NETLINK INITIALIZATION FAILED ***");
-		exit(1);
-	}
-
+	__near_ring_init();
 	__near_agent_init();
 	__near_tag_init();
 	__near_device_init();
@@ -290,6 +370,14 @@ int main(int argc, char *argv[])
 
 	__near_plugin_init(option_plugin, option_noplugin);
 
+	/*
+	 * Without an adapters dump to wait for, the service is ready now
+	 * that it owns its bus name. Otherwise the dump reply, handled
+	 * from the main loop, tells.
+	 */
+	if (adapters_err < 0)
+		__near_notify_ready();
+
 	if (option_detach) {
 		if (daemon(0, 0)) {
 			perror("Can't start daemon");
@@ -311,8 +399,10 @@ int main(int argc, char *argv[])
 	__near_device_cleanup();
 	__near_tag_cleanup();
 	__near_agent_cleanup();
+	__near_ring_cleanup();
 	__near_netlink_cleanup();
 
+	__near_trace_cleanup();
 	__near_dbus_cleanup();
 	__near_log_cleanup();
 
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 
 #include <glib.h>
@@ -79,6 +80,17 @@ void __near_manager_adapter_remove(uint32_t idx)
 	__near_adapter_remove(adapter);
 }
 
+/* The initial adapters dump is done, all adapters are added and powered */
+void __near_manager_adapters_done(int err)
+{
+	DBG("err %d", err);
+
+	if (err < 0)
+		near_error("Adapters discovery failed: %s", strerror(-err));
+
+	__near_notify_ready();
+}
+
 int __near_manager_init(DBusConnection *conn)
 {
 	DBG("");
@@ -89,7 +101,7 @@ int __near_manager_init(DBusConnection *conn)
 
 	g_dbus_attach_object_manager(connection);
 
-	return __near_netlink_get_adapters();
+	return 0;
 }
 
 void __near_manager_cleanup(void)
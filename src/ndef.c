@@ -2990,6 +2990,255 @@ fail:
 	return err;
 }
 
+/*
+ * Size of the NDEF record starting at data, or 0 if not enough bytes were
+ * received yet to tell. The payload offset is returned in payload_offset.
+ */
+static size_t handover_record_size(uint8_t *data, size_t len,
+						size_t *payload_offset)
+{
+	size_t header_len, payload_len;
+
+	/* header + type length + short payload length */
+	header_len = 3;
+	if (len < header_len)
+		return 0;
+
+	if (data[0] & RECORD_SR) {
+		payload_len = data[2];
+	} else {
+		header_len += 3;
+		if (len < header_len)
+			return 0;
+
+		payload_len = near_get_be32(data + 2);
+	}
+
+	if (data[0] & RECORD_IL) {
+		header_len++;
+		if (len < header_len)
+			return 0;
+
+		header_len += data[header_len - 1];
+	}
+
+	header_len += data[1];
+
+	*payload_offset = header_len;
+
+	return header_len + payload_len;
+}
+
+/*
+ * Locate the records of the len bytes of a handover message received so
+ * far, from where the previous call stopped. Returns 1 when the message
+ * is complete, 0 if more bytes are needed.
+ */
+int near_ndef_scan_handover(struct near_ndef_ho_scan *ho, uint8_t *data,
+								size_t len)
+{
+	size_t size, payload_offset;
+	int count;
+
+	while (ho->records_left != 0) {
+		size = handover_record_size(data + ho->scan, len - ho->scan,
+							&payload_offset);
+		if (!size || size > len - ho->scan)
+			return 0;
+
+		if (ho->records_left > 0) {
+			ho->cfg_offsets[ho->cfg_count++] = ho->scan;
+			ho->records_left--;
+			ho->scan += size;
+			continue;
+		}
+
+		/*
+		 * The Hr record is complete, one configuration record follows
+		 * for each of its alternative carriers. Skip the version byte
+		 * to get to the nested records.
+		 */
+		payload_offset++;
+
+		count = 0;
+		if (size > payload_offset)
+			count = near_ndef_count_records(
+					data + ho->scan + payload_offset,
+					size - payload_offset,
+					RECORD_TYPE_WKT_ALTERNATIVE_CARRIER);
+		if (count < 0)
+			return count;
+
+		if (count > 0) {
+			ho->cfg_offsets = g_try_new0(size_t, count);
+			if (!ho->cfg_offsets)
+				return -ENOMEM;
+		}
+
+		DBG("Handover record size %zu, %d carriers", size, count);
+
+		ho->records_left = count;
+		ho->scan += size;
+	}
+
+	/* Nothing may follow the last configuration record */
+	if (len > ho->scan) {
+		DBG("%zu trailing bytes", len - ho->scan);
+		return -EBADMSG;
+	}
+
+	return 1;
+}
+
+/*
+ * Process a complete handover message, whose carrier configuration records
+ * have already been located by the caller. Only the handover record header
+ * and the records at cfg_offsets are looked at, the nested records of the
+ * handover payload are not parsed again.
+ * For a Hr, *reply is set to the Hs to send back. For a Hs, the first
+ * usable carrier is processed.
+ */
+int near_ndef_process_handover(uint8_t *ndef_data, size_t ndef_length,
+				const size_t *cfg_offsets, unsigned int cfg_count,
+				struct near_ndef_message **reply)
+{
+	struct near_ndef_record_header *header;
+	struct near_ndef_record *record = NULL;
+	struct near_ndef_mime_payload *mime;
+	struct carrier_data *c_data;
+	GSList *mimes = NULL, *c_datas = NULL, *m, *c;
+	enum record_type rec_type;
+	uint8_t version;
+	uint8_t mb = 0, me = 0;
+	unsigned int i;
+	int err;
+
+	DBG("%u configuration records", cfg_count);
+
+	if (!ndef_data || ndef_length < NDEF_MSG_MIN_LENGTH)
+		return -EINVAL;
+
+	header = parse_record_header(ndef_data, 0, ndef_length);
+	if (!header)
+		return -EINVAL;
+
+	rec_type = header->rec_type;
+	version = header->payload_len ? ndef_data[header->offset] : 0;
+	err = validate_record_begin_and_end_bits(&mb, &me, header->mb,
+								header->me);
+
+	g_free(header->il_field);
+	g_free(header->type_name);
+	g_free(header);
+
+	if (err != 0) {
+		DBG("validate mb me failed");
+		return -EINVAL;
+	}
+
+	if (rec_type != RECORD_TYPE_WKT_HANDOVER_REQUEST &&
+			rec_type != RECORD_TYPE_WKT_HANDOVER_SELECT)
+		return -EINVAL;
+
+	/* If major is different, reply with an empty Hs */
+	if (HANDOVER_MAJOR(version) != HANDOVER_MAJOR(HANDOVER_VERSION)) {
+		near_error("Unsupported version (%d)", version);
+
+		if (rec_type == RECORD_TYPE_WKT_HANDOVER_REQUEST && reply)
+			*reply = near_ndef_prepare_empty_hs_message();
+
+		return 0;
+	}
+
+	for (i = 0; i < cfg_count; i++) {
+		record = g_try_malloc0(sizeof(struct near_ndef_record));
+		if (!record) {
+			err = -ENOMEM;
+			goto fail;
+		}
+
+		record->header = parse_record_header(ndef_data, cfg_offsets[i],
+								ndef_length);
+		if (!record->header) {
+			err = -EINVAL;
+			goto fail;
+		}
+
+		if (validate_record_begin_and_end_bits(&mb, &me,
+					record->header->mb,
+					record->header->me) != 0) {
+			DBG("validate mb me failed");
+			err = -EINVAL;
+			goto fail;
+		}
+
+		if (record->header->rec_type != RECORD_TYPE_MIME_TYPE) {
+			free_ndef_record(record);
+			record = NULL;
+			continue;
+		}
+
+		mime = parse_mime_type(record, ndef_data, ndef_length,
+					record->header->offset,
+					record->header->payload_len, &c_data);
+		if (!mime || !c_data) {
+			free_mime_payload(mime);
+			err = -EINVAL;
+			goto fail;
+		}
+
+		mimes = g_slist_append(mimes, mime);
+		c_datas = g_slist_append(c_datas, c_data);
+
+		free_ndef_record(record);
+		record = NULL;
+	}
+
+	/* The last record must close the message */
+	if (me != 1) {
+		DBG("validate mb me failed");
+		err = -EINVAL;
+		goto fail;
+	}
+
+	if (rec_type == RECORD_TYPE_WKT_HANDOVER_SELECT) {
+		/* In case of multiple carriers, use the first usable one */
+		err = -EIO;
+
+		for (m = mimes, c = c_datas; m && c; m = m->next, c = c->next)
+			if (process_mime_type(m->data, c->data) == 0) {
+				err = 0;
+				break;
+			}
+
+		if (err < 0) {
+			DBG("could not process alternative carriers");
+			goto fail;
+		}
+	} else if (reply) {
+		/* Prepare Hs, it depends upon Hr message carrier types */
+		*reply = near_ndef_prepare_hs_reply(mimes, c_datas);
+		if (!*reply) {
+			err = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	g_slist_free_full(mimes, (GDestroyNotify) free_mime_payload);
+	g_slist_free_full(c_datas, g_free);
+
+	return 0;
+
+fail:
+	near_error("handover processing failed %d", err);
+
+	free_ndef_record(record);
+	g_slist_free_full(mimes, (GDestroyNotify) free_mime_payload);
+	g_slist_free_full(c_datas, g_free);
+
+	return err;
+}
+
 /* Possible encoding "UTF-8" or "UTF-16" */
 struct near_ndef_message *near_ndef_prepare_text_record(char *encoding,
 						char *language_code, char *text)
@@ -38,6 +38,11 @@ struct near_device_driver;
 int __near_log_init(const char *debug, gboolean detach);
 void __near_log_cleanup(void);
 
+int __near_trace_init(const char *path);
+void __near_trace_cleanup(void);
+
+void __near_notify_ready(void);
+
 #include <near/dbus.h>
 
 int __near_dbus_init(DBusConnection *conn);
@@ -70,6 +75,7 @@ DBusMessage *__near_error_io_error(DBusMessage *msg);
 int __near_manager_adapter_add(uint32_t idx, const char *name,
 			uint32_t protocols, bool powered);
 void __near_manager_adapter_remove(uint32_t idx);
+void __near_manager_adapters_done(int err);
 int __near_manager_init(DBusConnection *conn);
 void __near_manager_cleanup(void);
 
@@ -141,6 +147,9 @@ int __near_tag_read(struct near_tag *tag, near_tag_io_cb cb);
 int __near_tag_write(struct near_tag *tag,
 				struct near_ndef_message *ndef,
 				near_tag_io_cb cb);
+int __near_tag_queue_write(struct near_tag *tag,
+				struct near_ndef_message *ndef,
+				near_tag_io_cb cb);
 int __near_tag_check_presence(struct near_tag *tag, near_tag_io_cb cb);
 
 #include <near/device.h>
@@ -248,7 +257,10 @@ int __near_bluetooth_parse_oob_record(struct carrier_data *data,
 int __near_bluetooth_pair(void *data);
 struct carrier_data *__near_bluetooth_local_get_properties(uint16_t mime_props);
 
-void __near_agent_ndef_parse_records(GList *records);
+void __near_agent_ndef_parse_records(uint32_t adapter_idx,
+					uint32_t target_idx, uint32_t protocol,
+					uint8_t *uid, uint8_t uid_len,
+					GList *records);
 bool __near_agent_handover_registered(enum ho_agent_carrier carrier);
 
 struct carrier_data *__near_agent_handover_request_data(
@@ -259,3 +271,12 @@ int __near_agent_handover_push_data(enum ho_agent_carrier carrier,
 
 int __near_agent_init(void);
 void __near_agent_cleanup(void);
+
+int __near_ring_init(void);
+void __near_ring_cleanup(void);
+void __near_ring_target_found(uint32_t adapter_idx, uint32_t target_idx,
+					uint32_t protocols,
+					uint8_t *uid, uint8_t uid_len);
+void __near_ring_target_read(uint32_t adapter_idx, uint32_t target_idx,
+					GList *records);
+void __near_ring_target_lost(uint32_t adapter_idx, uint32_t target_idx);
@@ -61,12 +61,15 @@ static inline void __nl_perror(int error, const char *s)
 struct nlnfc_state {
 	struct nl_sock *cmd_sock;
 	struct nl_sock *event_sock;
+	struct nl_sock *dump_sock;
 	int nfc_id;
 	int mcid;
 };
 
 static struct nlnfc_state *nfc_state;
 static GIOChannel *netlink_channel = NULL;
+static GIOChannel *dump_channel = NULL;
+static guint dump_watch = 0;
 
 struct send_msg_data {
 	void *data;
@@ -112,7 +115,7 @@ static int ack_handler(struct nl_msg *msg, void *arg)
 	return NL_STOP;
 }
 
-static int __nl_send_msg(struct nl_sock *sock, struct nl_msg *msg,
+static int nl_recv_reply(struct nl_sock *sock,
 			int (*rx_handler)(struct nl_msg *, void *),
 			int (*finish_handler)(struct nl_msg *, void *),
 			void *data)
@@ -121,20 +124,10 @@ static int __nl_send_msg(struct nl_sock *sock, struct nl_msg *msg,
 	int err, done;
 	struct send_msg_data send_data;
 
-	DBG("");
-
 	cb = nl_cb_alloc(NL_CB_DEFAULT);
 	if (!cb)
 		return -ENOMEM;
 
-	err = nl_send_auto_complete(sock, msg);
-	if (err < 0) {
-		nl_cb_put(cb);
-		near_error("%s", strerror(err));
-
-		return err;
-	}
-
 	err = done = 0;
 	send_data.done = &done;
 	send_data.data = data;
@@ -155,6 +148,25 @@ static int __nl_send_msg(struct nl_sock *sock, struct nl_msg *msg,
 	return err;
 }
 
+static int __nl_send_msg(struct nl_sock *sock, struct nl_msg *msg,
+			int (*rx_handler)(struct nl_msg *, void *),
+			int (*finish_handler)(struct nl_msg *, void *),
+			void *data)
+{
+	int err;
+
+	DBG("");
+
+	err = nl_send_auto_complete(sock, msg);
+	if (err < 0) {
+		near_error("%s", strerror(err));
+
+		return err;
+	}
+
+	return nl_recv_reply(sock, rx_handler, finish_handler, data);
+}
+
 static inline int nl_send_msg(struct nl_sock *sock, struct nl_msg *msg,
 			int (*rx_handler)(struct nl_msg *, void *),
 			void *data)
@@ -195,6 +207,50 @@ static int get_devices_handler(struct nl_msg *n, void *arg)
 	return NL_SKIP;
 }
 
+static void get_adapters_cleanup(void)
+{
+	if (dump_watch > 0) {
+		g_source_remove(dump_watch);
+		dump_watch = 0;
+	}
+
+	if (dump_channel) {
+		g_io_channel_unref(dump_channel);
+		dump_channel = NULL;
+	}
+
+	if (nfc_state && nfc_state->dump_sock) {
+		nl_socket_free(nfc_state->dump_sock);
+		nfc_state->dump_sock = NULL;
+	}
+}
+
+static gboolean get_adapters_event(GIOChannel *channel,
+				GIOCondition condition, gpointer user_data)
+{
+	int err = -EIO;
+
+	DBG("condition 0x%x", condition);
+
+	dump_watch = 0;
+
+	if (!(condition & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)))
+		err = nl_recv_reply(nfc_state->dump_sock,
+					get_devices_handler, NULL, NULL);
+
+	get_adapters_cleanup();
+
+	__near_manager_adapters_done(err);
+
+	return FALSE;
+}
+
+/*
+ * Only send the device dump request, on a dedicated socket so that
+ * commands can still be sent meanwhile. Adapters are added from the
+ * main loop when the reply comes in, the kernel prepares it while the
+ * rest of the daemon initializes.
+ */
 int __near_netlink_get_adapters(void)
 {
 	struct nl_msg *msg;
@@ -206,22 +262,59 @@ int __near_netlink_get_adapters(void)
 	if (!nfc_state || nfc_state->nfc_id < 0)
 		return -ENODEV;
 
-	msg = nlmsg_alloc();
-	if (!msg)
+	if (nfc_state->dump_sock)
+		return -EALREADY;
+
+	nfc_state->dump_sock = nl_socket_alloc();
+	if (!nfc_state->dump_sock)
 		return -ENOMEM;
 
+	if (genl_connect(nfc_state->dump_sock)) {
+		err = -ENOLINK;
+		goto out_sock;
+	}
+
+	msg = nlmsg_alloc();
+	if (!msg) {
+		err = -ENOMEM;
+		goto out_sock;
+	}
+
 	hdr = genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, nfc_state->nfc_id, 0,
 			  NLM_F_DUMP, NFC_CMD_GET_DEVICE, NFC_GENL_VERSION);
 	if (!hdr) {
 		err = -EINVAL;
-		goto out;
+		goto out_msg;
 	}
 
-	err = nl_send_msg(nfc_state->cmd_sock, msg, get_devices_handler, NULL);
+	err = nl_send_auto_complete(nfc_state->dump_sock, msg);
+	if (err < 0) {
+		near_error("%s", strerror(err));
+		err = -EIO;
+		goto out_msg;
+	}
 
-out:
 	nlmsg_free(msg);
 
+	dump_channel = g_io_channel_unix_new(
+				nl_socket_get_fd(nfc_state->dump_sock));
+
+	g_io_channel_set_encoding(dump_channel, NULL, NULL);
+	g_io_channel_set_buffered(dump_channel, FALSE);
+
+	dump_watch = g_io_add_watch(dump_channel,
+				G_IO_IN | G_IO_NVAL | G_IO_HUP | G_IO_ERR,
+				get_adapters_event, NULL);
+
+	return 0;
+
+out_msg:
+	nlmsg_free(msg);
+
+out_sock:
+	nl_socket_free(nfc_state->dump_sock);
+	nfc_state->dump_sock = NULL;
+
 	return err;
 }
 
@@ -1024,6 +1117,8 @@ void __near_netlink_cleanup(void)
 	if (!nfc_state)
 		return;
 
+	get_adapters_cleanup();
+
 	nl_socket_free(nfc_state->cmd_sock);
 	nl_socket_free(nfc_state->event_sock);
 
@@ -23,7 +23,9 @@
 #include <config.h>
 #endif
 
+#ifndef NEAR_PLUGIN_BUILTIN_ONLY
 #include <dlfcn.h>
+#endif
 
 #include <glib.h>
 
@@ -107,9 +109,11 @@ int __near_plugin_init(const char *pattern, const char *exclude)
 	gchar **patterns = NULL;
 	gchar **excludes = NULL;
 	GSList *list;
+#ifndef NEAR_PLUGIN_BUILTIN_ONLY
 	GDir *dir;
 	const gchar *file;
 	gchar *filename;
+#endif
 	unsigned int i;
 
 	DBG("");
@@ -127,6 +131,7 @@ int __near_plugin_init(const char *pattern, const char *exclude)
 		add_plugin(NULL, __near_builtin[i]);
 	}
 
+#ifndef NEAR_PLUGIN_BUILTIN_ONLY
 	dir = g_dir_open(PLUGINDIR, 0, NULL);
 	if (dir) {
 		while ((file = g_dir_read_name(dir))) {
@@ -168,6 +173,7 @@ int __near_plugin_init(const char *pattern, const char *exclude)
 
 		g_dir_close(dir);
 	}
+#endif
 
 	for (list = plugins; list; list = list->next) {
 		struct near_plugin *plugin = list->data;
@@ -196,8 +202,10 @@ void __near_plugin_cleanup(void)
 		if (plugin->active && plugin->desc->exit)
 			plugin->desc->exit();
 
+#ifndef NEAR_PLUGIN_BUILTIN_ONLY
 		if (plugin->handle)
 			dlclose(plugin->handle);
+#endif
 
 		g_free(plugin);
 	}
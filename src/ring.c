@@ -0,0 +1,434 @@
+/*
+ *
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include <gdbus.h>
+
+#include "near.h"
+
+/*
+ * Tag event ring, see doc/tag-events-api.txt for the consumer side.
+ *
+ * neard is the only writer. Each event slot is guarded by a sequence
+ * counter which is odd while the slot is being written, so readers can
+ * copy a slot and retry if the counter moved. Raw NDEF goes to a
+ * circular byte arena, addressed by absolute offsets that let readers
+ * detect data overwritten since the event was published. The arena
+ * head is moved before the bytes it covers are overwritten, so that
+ * checking it after copying catches a concurrent overwrite as well.
+ */
+
+#define RING_MAGIC		0x4e524e47	/* "NRNG" */
+#define RING_VERSION		1
+#define RING_EVENT_COUNT	256		/* power of two */
+#define RING_ARENA_SIZE		(256 * 1024)	/* power of two */
+#define RING_UID_MAX		10
+
+struct ring_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t event_size;
+	uint32_t event_count;
+	uint32_t arena_size;
+	uint32_t events_offset;
+	uint32_t arena_offset;
+	uint64_t event_head;	/* number of events ever published */
+	uint64_t arena_head;	/* number of bytes ever claimed in arena */
+	uint8_t reserved[24];
+} __attribute__((packed));
+
+struct ring_event {
+	uint32_t sequence;	/* odd while being written */
+	uint32_t adapter_idx;
+	uint32_t target_idx;
+	uint32_t protocols;	/* NFC_PROTO_*_MASK */
+	uint64_t id;		/* event number, slot is id % event_count */
+	uint64_t discovered;	/* CLOCK_MONOTONIC ns */
+	uint64_t read;		/* 0 until NDEF was read */
+	uint64_t lost;		/* 0 until target is gone */
+	uint64_t ndef_offset;	/* absolute arena offset */
+	uint32_t ndef_len;
+	uint8_t uid_len;
+	uint8_t uid[RING_UID_MAX];
+	uint8_t reserved[1];
+} __attribute__((packed));
+
+static DBusConnection *connection;
+static int ring_fd = -1;
+static int ring_ro_fd = -1;	/* handed out to consumers */
+static uint8_t *ring_map;
+static size_t ring_size;
+static struct ring_header *ring_hdr;
+static struct ring_event *ring_events;
+static uint8_t *ring_arena;
+
+/* (adapter, target) -> id of the event describing that target */
+static GHashTable *ring_targets;
+
+static uint64_t ring_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static gint64 *ring_target_key(uint32_t adapter_idx, uint32_t target_idx)
+{
+	gint64 *key;
+
+	key = g_try_new(gint64, 1);
+	if (key)
+		*key = ((gint64)adapter_idx << 32) | target_idx;
+
+	return key;
+}
+
+static struct ring_event *ring_event_begin(uint64_t id)
+{
+	struct ring_event *event;
+
+	event = &ring_events[id & (RING_EVENT_COUNT - 1)];
+
+	/* Slot recycled since, nothing to update anymore */
+	if (event->id != id)
+		return NULL;
+
+	__atomic_store_n(&event->sequence, event->sequence + 1,
+							__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return event;
+}
+
+static void ring_event_end(struct ring_event *event)
+{
+	__atomic_store_n(&event->sequence, event->sequence + 1,
+							__ATOMIC_RELEASE);
+}
+
+static struct ring_event *ring_lookup(uint32_t adapter_idx,
+					uint32_t target_idx, bool remove)
+{
+	struct ring_event *event;
+	gint64 key;
+	uint64_t *id;
+
+	key = ((gint64)adapter_idx << 32) | target_idx;
+
+	id = g_hash_table_lookup(ring_targets, &key);
+	if (!id)
+		return NULL;
+
+	event = ring_event_begin(*id);
+
+	if (remove)
+		g_hash_table_remove(ring_targets, &key);
+
+	return event;
+}
+
+void __near_ring_target_found(uint32_t adapter_idx, uint32_t target_idx,
+					uint32_t protocols,
+					uint8_t *uid, uint8_t uid_len)
+{
+	struct ring_event *event;
+	uint64_t id, *value;
+	uint32_t sequence;
+	gint64 *key;
+
+	if (!ring_hdr)
+		return;
+
+	DBG("adapter %u target %u", adapter_idx, target_idx);
+
+	id = ring_hdr->event_head;
+	event = &ring_events[id & (RING_EVENT_COUNT - 1)];
+
+	sequence = event->sequence + 1;
+	__atomic_store_n(&event->sequence, sequence, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memset((uint8_t *)event + sizeof(event->sequence), 0,
+				sizeof(*event) - sizeof(event->sequence));
+
+	event->id = id;
+	event->adapter_idx = adapter_idx;
+	event->target_idx = target_idx;
+	event->protocols = protocols;
+	event->discovered = ring_now();
+
+	if (uid && uid_len <= RING_UID_MAX) {
+		memcpy(event->uid, uid, uid_len);
+		event->uid_len = uid_len;
+	}
+
+	ring_event_end(event);
+
+	__atomic_store_n(&ring_hdr->event_head, id + 1, __ATOMIC_RELEASE);
+
+	key = ring_target_key(adapter_idx, target_idx);
+	value = g_try_new(uint64_t, 1);
+	if (!key || !value) {
+		g_free(key);
+		g_free(value);
+		return;
+	}
+
+	*value = id;
+	g_hash_table_replace(ring_targets, key, value);
+}
+
+static void ring_arena_write(uint64_t offset, uint8_t *data, size_t len)
+{
+	size_t pos, first;
+
+	pos = offset & (RING_ARENA_SIZE - 1);
+	first = MIN(len, RING_ARENA_SIZE - pos);
+
+	memcpy(ring_arena + pos, data, first);
+	memcpy(ring_arena, data + first, len - first);
+}
+
+/* The NDEF message is written out of its records, as read from the tag */
+void __near_ring_target_read(uint32_t adapter_idx, uint32_t target_idx,
+					GList *records)
+{
+	struct ring_event *event;
+	uint64_t offset, pos;
+	size_t ndef_len = 0, len;
+	uint8_t *data;
+	GList *list;
+
+	if (!ring_hdr)
+		return;
+
+	event = ring_lookup(adapter_idx, target_idx, false);
+	if (!event)
+		return;
+
+	for (list = records; list; list = list->next) {
+		if (__near_ndef_record_get_data(list->data, &len))
+			ndef_len += len;
+	}
+
+	DBG("adapter %u target %u len %zd", adapter_idx, target_idx, ndef_len);
+
+	offset = ring_hdr->arena_head;
+
+	if (ndef_len > 0 && ndef_len <= RING_ARENA_SIZE) {
+		/* Claim the bytes before overwriting them, like a seqlock */
+		__atomic_store_n(&ring_hdr->arena_head, offset + ndef_len,
+							__ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		pos = offset;
+		for (list = records; list; list = list->next) {
+			data = __near_ndef_record_get_data(list->data, &len);
+			if (!data)
+				continue;
+
+			ring_arena_write(pos, data, len);
+			pos += len;
+		}
+
+		/* Published by the release of the event sequence */
+		event->ndef_offset = offset;
+		event->ndef_len = ndef_len;
+	}
+
+	event->read = ring_now();
+
+	ring_event_end(event);
+}
+
+void __near_ring_target_lost(uint32_t adapter_idx, uint32_t target_idx)
+{
+	struct ring_event *event;
+
+	if (!ring_hdr)
+		return;
+
+	event = ring_lookup(adapter_idx, target_idx, true);
+	if (!event)
+		return;
+
+	DBG("adapter %u target %u", adapter_idx, target_idx);
+
+	event->lost = ring_now();
+
+	ring_event_end(event);
+}
+
+static DBusMessage *get_ring(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	DBG("conn %p", conn);
+
+	if (ring_ro_fd < 0)
+		return __near_error_not_supported(msg);
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UNIX_FD, &ring_ro_fd,
+							DBUS_TYPE_INVALID);
+}
+
+static const GDBusMethodTable ring_methods[] = {
+	{ GDBUS_METHOD("GetRing", NULL,
+			GDBUS_ARGS({ "fd", "h" }), get_ring) },
+	{ },
+};
+
+static int ring_create(void)
+{
+	char path[32];
+	int err;
+
+	ring_size = sizeof(struct ring_header) +
+			RING_EVENT_COUNT * sizeof(struct ring_event) +
+			RING_ARENA_SIZE;
+
+	ring_fd = memfd_create("neard-tag-events",
+					MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (ring_fd < 0)
+		return -errno;
+
+	if (ftruncate(ring_fd, ring_size) < 0)
+		goto fail;
+
+	ring_map = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+								ring_fd, 0);
+	if (ring_map == MAP_FAILED) {
+		ring_map = NULL;
+		goto fail;
+	}
+
+	if (fcntl(ring_fd, F_ADD_SEALS,
+			F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+		goto fail;
+
+	/*
+	 * Consumers get a read only descriptor of the same memory, they
+	 * can neither map it writable nor write to it.
+	 */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", ring_fd);
+	ring_ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (ring_ro_fd < 0)
+		goto fail;
+
+	ring_hdr = (struct ring_header *)ring_map;
+	ring_events = (struct ring_event *)(ring_map + sizeof(*ring_hdr));
+	ring_arena = ring_map + sizeof(*ring_hdr) +
+			RING_EVENT_COUNT * sizeof(struct ring_event);
+
+	ring_hdr->version = RING_VERSION;
+	ring_hdr->event_size = sizeof(struct ring_event);
+	ring_hdr->event_count = RING_EVENT_COUNT;
+	ring_hdr->arena_size = RING_ARENA_SIZE;
+	ring_hdr->events_offset = sizeof(*ring_hdr);
+	ring_hdr->arena_offset = ring_arena - ring_map;
+
+	__atomic_store_n(&ring_hdr->magic, RING_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+
+fail:
+	err = -errno;
+
+	if (ring_map) {
+		munmap(ring_map, ring_size);
+		ring_map = NULL;
+	}
+
+	close(ring_fd);
+	ring_fd = -1;
+
+	return err;
+}
+
+int __near_ring_init(void)
+{
+	int err;
+
+	DBG("");
+
+	if (!near_setting_get_bool("TagEventRing"))
+		return 0;
+
+	err = ring_create();
+	if (err < 0) {
+		near_error("Could not create tag event ring: %s",
+							strerror(-err));
+		return err;
+	}
+
+	ring_targets = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+							g_free, g_free);
+
+	connection = near_dbus_get_connection();
+
+	g_dbus_register_interface(connection, NFC_PATH,
+						NFC_TAG_EVENTS_INTERFACE,
+						ring_methods,
+						NULL, NULL, NULL, NULL);
+
+	return 0;
+}
+
+void __near_ring_cleanup(void)
+{
+	DBG("");
+
+	if (ring_fd < 0)
+		return;
+
+	g_dbus_unregister_interface(connection, NFC_PATH,
+						NFC_TAG_EVENTS_INTERFACE);
+	dbus_connection_unref(connection);
+
+	g_hash_table_destroy(ring_targets);
+	ring_targets = NULL;
+
+	munmap(ring_map, ring_size);
+	ring_map = NULL;
+	ring_hdr = NULL;
+
+	close(ring_ro_fd);
+	ring_ro_fd = -1;
+
+	close(ring_fd);
+	ring_fd = -1;
+}
@@ -81,8 +81,23 @@ struct near_tag {
 		uint8_t num_blks;
 	} t5;
 
-	DBusMessage *write_msg; /* Pending write message */
-	struct near_ndef_message *write_ndef;
+	struct tag_write_req *write_req; /* Write in progress */
+	bool writing; /* Until the queue is drained and the tag read back */
+	guint write_resume; /* Idle going on with the queue */
+	bool write_read_back; /* ... after reading the tag back */
+	GQueue write_queue; /* Pending writes, at most TAG_WRITE_QUEUE_DEPTH */
+};
+
+/*
+ * NDEF writes are built and framed for the tag type when queued, so that
+ * the next write can be started as soon as the previous one is done.
+ */
+#define TAG_WRITE_QUEUE_DEPTH	8
+
+struct tag_write_req {
+	DBusMessage *msg;	/* Write() call, or NULL for internal writes */
+	near_tag_io_cb cb;
+	struct near_ndef_message *ndef;
 };
 
 static DBusConnection *connection = NULL;
@@ -91,6 +106,9 @@ static GHashTable *tag_hash;
 
 static GSList *driver_list = NULL;
 
+/* Highest priority driver for each NFC_PROTO_* tag type */
+static struct near_tag_driver *driver_table[NFC_PROTO_MAX];
+
 struct near_tag *near_tag_get_tag(uint32_t adapter_idx, uint32_t target_idx)
 {
 	struct near_tag *tag;
@@ -268,6 +286,149 @@ static gboolean property_get_adapter(const GDBusPropertyTable *property,
 
 }
 
+static void tag_write_req_free(struct tag_write_req *req)
+{
+	if (req->msg)
+		dbus_message_unref(req->msg);
+
+	near_ndef_msg_free(req->ndef);
+	g_free(req);
+}
+
+static void tag_write_req_done(struct near_tag *tag,
+				struct tag_write_req *req, int status)
+{
+	DBusMessage *reply;
+
+	if (req->msg && status != 0) {
+		reply = __near_error_failed(req->msg, -status);
+		if (reply)
+			g_dbus_send_message(connection, reply);
+	} else if (req->msg) {
+		g_dbus_send_reply(connection, req->msg, DBUS_TYPE_INVALID);
+	}
+
+	if (req->cb)
+		req->cb(tag->adapter_idx, tag->target_idx, status);
+
+	tag_write_req_free(req);
+}
+
+/* Fail the queued writes, and the running one if any */
+static void tag_write_fail_all(struct near_tag *tag, int err)
+{
+	struct tag_write_req *req;
+
+	req = tag->write_req;
+	tag->write_req = NULL;
+	if (req)
+		tag_write_req_done(tag, req, err);
+
+	while ((req = g_queue_pop_head(&tag->write_queue)))
+		tag_write_req_done(tag, req, err);
+
+	tag->writing = false;
+}
+
+static struct near_tag_driver *get_driver(uint32_t type);
+
+static void write_cb(uint32_t adapter_idx, uint32_t target_idx, int status);
+
+/*
+ * Returns 0 if a write is running or check presence was restarted,
+ * which a failed __near_tag_write() does.
+ */
+static int tag_write_next(struct near_tag *tag)
+{
+	struct tag_write_req *req;
+	bool failed = false;
+	int err;
+
+	tag->writing = true;
+
+	while ((req = g_queue_pop_head(&tag->write_queue))) {
+		DBG("%u writes left", g_queue_get_length(&tag->write_queue));
+
+		tag->write_req = req;
+
+		err = __near_tag_write(tag, req->ndef, write_cb);
+		if (err == 0)
+			return 0;
+
+		/*
+		 * Most drivers call back before returning an error, and
+		 * write_cb() completed the request already.
+		 */
+		if (tag->write_req != req)
+			return 0;
+
+		tag->write_req = NULL;
+		tag_write_req_done(tag, req, err);
+
+		failed = true;
+	}
+
+	tag->writing = false;
+
+	return failed ? 0 : -ENOENT;
+}
+
+static void tag_read_cb(uint32_t adapter_idx, uint32_t target_idx, int status);
+
+static gboolean tag_write_resume(gpointer user_data)
+{
+	struct near_tag *tag = user_data;
+	int err;
+
+	if (tag->write_read_back) {
+		tag->write_read_back = false;
+
+		/*
+		 * __near_tag_read() never calls back without a driver, and
+		 * no queued write could go through anyway.
+		 */
+		if (!get_driver(tag->type)) {
+			tag->write_resume = 0;
+			tag_write_fail_all(tag, -EOPNOTSUPP);
+			goto presence;
+		}
+
+		/*
+		 * We're still scheduled, a read calling back before failing
+		 * leaves it to us to go on.
+		 */
+		err = __near_tag_read(tag, tag_read_cb);
+		if (err == 0) {
+			tag->write_resume = 0;
+			return FALSE;
+		}
+	}
+
+	tag->write_resume = 0;
+
+	if (tag_write_next(tag) == 0)
+		return FALSE;
+
+presence:
+	__near_adapter_start_check_presence(tag->adapter_idx, tag->target_idx);
+
+	return FALSE;
+}
+
+/*
+ * Drivers may call back from within their read and write calls, and
+ * restart check presence when returning an error afterwards. The
+ * queue goes on from an idle callback to stay out of their way.
+ */
+static void tag_write_schedule(struct near_tag *tag, bool read_back)
+{
+	if (read_back)
+		tag->write_read_back = true;
+
+	if (!tag->write_resume)
+		tag->write_resume = g_idle_add(tag_write_resume, tag);
+}
+
 static void tag_read_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 {
 	struct near_tag *tag;
@@ -277,19 +438,13 @@ static void tag_read_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 	if (!tag)
 		return;
 
-	if (tag->write_msg) {
-		dbus_message_unref(tag->write_msg);
-		tag->write_msg = NULL;
-	}
-
-	__near_adapter_start_check_presence(adapter_idx, target_idx);
+	tag_write_schedule(tag, false);
 }
 
 static void write_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 {
 	struct near_tag *tag;
-	DBusConnection *conn;
-	DBusMessage *reply;
+	struct tag_write_req *req;
 
 	DBG("Write status %d", status);
 
@@ -297,37 +452,23 @@ static void write_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 	if (!tag)
 		return;
 
-	conn = near_dbus_get_connection();
-	if (!conn)
-		goto out;
-
-	if (status != 0) {
-		reply = __near_error_failed(tag->write_msg, EINVAL);
-		if (reply)
-			g_dbus_send_message(conn, reply);
-	} else {
-		g_dbus_send_reply(conn, tag->write_msg, DBUS_TYPE_INVALID);
-	}
+	req = tag->write_req;
+	tag->write_req = NULL;
+	if (req)
+		tag_write_req_done(tag, req, status);
 
 	near_ndef_records_free(tag->records);
 	tag->records = NULL;
 	g_free(tag->data);
 	tag->data = NULL;
+	tag->data_length = 0;
 
-	if (status == 0) {
-		/*
-		 * If writing succeeded,
-		 * check presence will be restored after reading
-		 */
-		__near_tag_read(tag, tag_read_cb);
-		return;
-	}
-
-out:
-	dbus_message_unref(tag->write_msg);
-	tag->write_msg = NULL;
-
-	__near_adapter_start_check_presence(tag->adapter_idx, tag->target_idx);
+	/*
+	 * A failed write may have changed the tag as well. Either way it
+	 * is read back, and the drivers rely on that data for the next
+	 * write, which is started after reading.
+	 */
+	tag_write_schedule(tag, true);
 }
 
 static void format_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
@@ -341,49 +482,36 @@ static void format_cb(uint32_t adapter_idx, uint32_t target_idx, int status)
 	if (!tag)
 		return;
 
-	if (!tag->write_msg)
+	if (!tag->write_req)
 		return;
 
 	if (status == 0) {
-		err = __near_tag_write(tag, tag->write_ndef,
+		err = __near_tag_write(tag, tag->write_req->ndef,
 						write_cb);
-		if (err < 0)
-			goto error;
-	} else {
-		err = status;
-		goto error;
-	}
 
-	return;
+		/* Unless the driver called back already */
+		if (err < 0 && tag->write_req)
+			write_cb(tag->adapter_idx, tag->target_idx, err);
 
-error:
-	write_cb(tag->adapter_idx, tag->target_idx, err);
+		return;
+	}
+
+	write_cb(tag->adapter_idx, tag->target_idx, status);
 }
 
-static DBusMessage *write_ndef(DBusConnection *conn,
-				DBusMessage *msg, void *data)
+/* Add NDEF header information depends upon tag type */
+static int tag_build_ndef(struct near_tag *tag, struct near_ndef_message *ndef,
+				struct near_ndef_message **ndef_with_header)
 {
-	struct near_tag *tag = data;
-	struct near_ndef_message *ndef, *ndef_with_header = NULL;
-	int tlv_len_size, err;
-
-	DBG("conn %p", conn);
+	struct near_ndef_message *msg;
+	int tlv_len_size;
 
-	if (tag->readonly) {
-		DBG("Read only tag");
-		return __near_error_permission_denied(msg);
-	}
-
-	if (tag->write_msg)
-		return __near_error_in_progress(msg);
-
-	ndef = __ndef_build_from_message(msg);
-	if (!ndef)
-		return __near_error_failed(msg, EINVAL);
+	msg = g_try_malloc0(sizeof(struct near_ndef_message));
+	if (!msg)
+		return -ENOMEM;
 
-	tag->write_msg = dbus_message_ref(msg);
+	msg->offset = 0;
 
-	/* Add NDEF header information depends upon tag type */
 	switch (tag->type) {
 	case NFC_PROTO_JEWEL:
 	case NFC_PROTO_MIFARE:
@@ -393,95 +521,139 @@ static DBusMessage *write_ndef(DBusConnection *conn,
 		else
 			tlv_len_size = 5;
 
-		ndef_with_header = g_try_malloc0(sizeof(
-					struct near_ndef_message));
-		if (!ndef_with_header)
-			goto fail;
-
-		ndef_with_header->offset = 0;
-		ndef_with_header->length = ndef->length + tlv_len_size;
-		ndef_with_header->data =
-				g_try_malloc0(ndef->length + tlv_len_size);
-		if (!ndef_with_header->data)
+		msg->length = ndef->length + tlv_len_size;
+		msg->data = g_try_malloc0(msg->length);
+		if (!msg->data)
 			goto fail;
 
-		ndef_with_header->data[0] = TLV_NDEF;
+		msg->data[0] = TLV_NDEF;
 
 		if (ndef->length < 0xff) {
-			ndef_with_header->data[1] = ndef->length;
+			msg->data[1] = ndef->length;
 		} else {
-			ndef_with_header->data[1] = 0xff;
-			ndef_with_header->data[2] =
-					(uint8_t)(ndef->length >> 8);
-			ndef_with_header->data[3] = (uint8_t)(ndef->length);
+			msg->data[1] = 0xff;
+			msg->data[2] = (uint8_t)(ndef->length >> 8);
+			msg->data[3] = (uint8_t)(ndef->length);
 		}
 
-		memcpy(ndef_with_header->data + tlv_len_size - 1, ndef->data,
-				ndef->length);
-		ndef_with_header->data[ndef->length + tlv_len_size - 1] =
-									TLV_END;
+		memcpy(msg->data + tlv_len_size - 1, ndef->data, ndef->length);
+		msg->data[ndef->length + tlv_len_size - 1] = TLV_END;
 		break;
 
 	case NFC_PROTO_FELICA:
-		ndef_with_header = g_try_malloc0(sizeof(
-					struct near_ndef_message));
-		if (!ndef_with_header)
+		msg->length = ndef->length;
+		msg->data = g_try_malloc0(msg->length);
+		if (!msg->data)
 			goto fail;
 
-		ndef_with_header->offset = 0;
-		ndef_with_header->length = ndef->length;
-		ndef_with_header->data = g_try_malloc0(
-						ndef_with_header->length);
-		if (!ndef_with_header->data)
-			goto fail;
-
-		memcpy(ndef_with_header->data, ndef->data, ndef->length);
-
+		memcpy(msg->data, ndef->data, ndef->length);
 		break;
 
 	case NFC_PROTO_ISO14443:
 	case NFC_PROTO_ISO14443_B:
-		ndef_with_header = g_try_malloc0(sizeof(
-					struct near_ndef_message));
-		if (!ndef_with_header)
-			goto fail;
-
-		ndef_with_header->offset = 0;
-		ndef_with_header->length = ndef->length + 2;
-		ndef_with_header->data = g_try_malloc0(ndef->length + 2);
-		if (!ndef_with_header->data)
+		msg->length = ndef->length + 2;
+		msg->data = g_try_malloc0(msg->length);
+		if (!msg->data)
 			goto fail;
 
-		ndef_with_header->data[0] = (uint8_t)(ndef->length >> 8);
-		ndef_with_header->data[1] = (uint8_t)(ndef->length);
-		memcpy(ndef_with_header->data + 2, ndef->data, ndef->length);
-
+		msg->data[0] = (uint8_t)(ndef->length >> 8);
+		msg->data[1] = (uint8_t)(ndef->length);
+		memcpy(msg->data + 2, ndef->data, ndef->length);
 		break;
 
 	default:
-		near_ndef_msg_free(ndef);
-
-		return __near_error_failed(msg, EOPNOTSUPP);
+		g_free(msg);
+		return -EOPNOTSUPP;
 	}
 
-	near_ndef_msg_free(ndef);
+	*ndef_with_header = msg;
+
+	return 0;
+
+fail:
+	g_free(msg);
+	return -ENOMEM;
+}
+
+static int tag_queue_write(struct near_tag *tag, DBusMessage *msg,
+				struct near_ndef_message *ndef,
+				near_tag_io_cb cb)
+{
+	struct tag_write_req *req;
+	int err;
+
+	if (tag->readonly)
+		return -EACCES;
 
-	tag->write_ndef = ndef_with_header;
-	err = __near_tag_write(tag, ndef_with_header, write_cb);
+	if (g_queue_get_length(&tag->write_queue) >= TAG_WRITE_QUEUE_DEPTH)
+		return -EBUSY;
+
+	req = g_try_malloc0(sizeof(struct tag_write_req));
+	if (!req)
+		return -ENOMEM;
+
+	err = tag_build_ndef(tag, ndef, &req->ndef);
 	if (err < 0) {
-		g_free(ndef_with_header->data);
-		g_free(ndef_with_header);
+		g_free(req);
+		return err;
+	}
 
-		return __near_error_failed(msg, -err);
+	if (msg)
+		req->msg = dbus_message_ref(msg);
+	req->cb = cb;
+
+	g_queue_push_tail(&tag->write_queue, req);
+
+	DBG("%u writes queued", g_queue_get_length(&tag->write_queue));
+
+	/* The queue is drained from the completion of the running write */
+	if (tag->writing)
+		return 0;
+
+	tag_write_next(tag);
+
+	return 0;
+}
+
+int __near_tag_queue_write(struct near_tag *tag,
+				struct near_ndef_message *ndef,
+				near_tag_io_cb cb)
+{
+	DBG("tag %p", tag);
+
+	return tag_queue_write(tag, NULL, ndef, cb);
+}
+
+static DBusMessage *write_ndef(DBusConnection *conn,
+				DBusMessage *msg, void *data)
+{
+	struct near_tag *tag = data;
+	struct near_ndef_message *ndef;
+	int err;
+
+	DBG("conn %p", conn);
+
+	if (tag->readonly) {
+		DBG("Read only tag");
+		return __near_error_permission_denied(msg);
 	}
 
-	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
+	if (g_queue_get_length(&tag->write_queue) >= TAG_WRITE_QUEUE_DEPTH)
+		return __near_error_in_progress(msg);
 
-fail:
-	dbus_message_unref(tag->write_msg);
-	tag->write_msg = NULL;
+	ndef = __ndef_build_from_message(msg);
+	if (!ndef)
+		return __near_error_failed(msg, EINVAL);
+
+	err = tag_queue_write(tag, msg, ndef, NULL);
+
+	near_ndef_msg_free(ndef);
+
+	if (err < 0)
+		return __near_error_failed(msg, -err);
 
-	return __near_error_failed(msg, ENOMEM);
+	/* Replied to when the write is done */
+	return NULL;
 }
 
 static DBusMessage *deactivate_tag(DBusConnection *conn,
@@ -665,6 +837,7 @@ static int tag_initialize(struct near_tag *tag,
 	tag->protocol = protocols;
 	tag->next_record = 0;
 	tag->readonly = false;
+	g_queue_init(&tag->write_queue);
 
 	if (nfcid_len && nfcid_len <= NFC_MAX_NFCID1_LEN) {
 		tag->nfcid_len = nfcid_len;
@@ -717,10 +890,12 @@ struct near_tag *__near_tag_add(uint32_t adapter_idx, uint32_t target_idx,
 
 	DBG("connection %p", connection);
 
-	g_dbus_register_interface(connection, tag->path,
+	/* No bus when run from the unit tests */
+	if (connection)
+		g_dbus_register_interface(connection, tag->path,
 					NFC_TAG_INTERFACE,
 					tag_methods, NULL,
-				        tag_properties, tag, NULL);
+					tag_properties, tag, NULL);
 
 	return tag;
 }
@@ -876,6 +1051,8 @@ int near_tag_add_records(struct near_tag *tag, GList *records,
 
 	DBG("records %p", records);
 
+	__near_ring_target_read(tag->adapter_idx, tag->target_idx, records);
+
 	for (list = records; list; list = list->next) {
 		record = list->data;
 
@@ -892,7 +1069,9 @@ int near_tag_add_records(struct near_tag *tag, GList *records,
 		tag->records = g_list_append(tag->records, record);
 	}
 
-	__near_agent_ndef_parse_records(tag->records);
+	__near_agent_ndef_parse_records(tag->adapter_idx, tag->target_idx,
+					tag->type, tag->nfcid, tag->nfcid_len,
+					tag->records);
 
 	near_dbus_property_changed_array(tag->path,
 					NFC_TAG_INTERFACE, "Records",
@@ -1108,83 +1287,99 @@ static gint cmp_prio(gconstpointer a, gconstpointer b)
 	return driver2->priority - driver1->priority;
 }
 
+static void update_driver_table(uint16_t type)
+{
+	GSList *list;
+
+	driver_table[type] = NULL;
+
+	/* The list is sorted by priority, the first match wins */
+	for (list = driver_list; list; list = list->next) {
+		struct near_tag_driver *driver = list->data;
+
+		if (driver->type == type) {
+			driver_table[type] = driver;
+			break;
+		}
+	}
+}
+
+static struct near_tag_driver *get_driver(uint32_t type)
+{
+	if (type >= NFC_PROTO_MAX)
+		return NULL;
+
+	return driver_table[type];
+}
+
 int near_tag_driver_register(struct near_tag_driver *driver)
 {
-	DBG("");
+	DBG("type 0x%x", driver->type);
 
-	if (!driver->read)
+	if (!driver->read || driver->type >= NFC_PROTO_MAX)
 		return -EINVAL;
 
 	driver_list = g_slist_insert_sorted(driver_list, driver, cmp_prio);
 
+	update_driver_table(driver->type);
+
 	return 0;
 }
 
 void near_tag_driver_unregister(struct near_tag_driver *driver)
 {
-	DBG("");
+	DBG("type 0x%x", driver->type);
 
 	driver_list = g_slist_remove(driver_list, driver);
+
+	if (driver->type < NFC_PROTO_MAX)
+		update_driver_table(driver->type);
 }
 
 int __near_tag_read(struct near_tag *tag, near_tag_io_cb cb)
 {
-	GSList *list;
+	struct near_tag_driver *driver;
 
 	DBG("type 0x%x", tag->type);
 
 	/* Stop check presence while reading */
 	__near_adapter_stop_check_presence(tag->adapter_idx, tag->target_idx);
 
-	for (list = driver_list; list; list = list->next) {
-		struct near_tag_driver *driver = list->data;
-
-		DBG("driver type 0x%x", driver->type);
-
-		if (driver->type == tag->type)
-			return driver->read(tag->adapter_idx, tag->target_idx,
-									cb);
-	}
+	driver = get_driver(tag->type);
+	if (!driver)
+		return 0;
 
-	return 0;
+	return driver->read(tag->adapter_idx, tag->target_idx, cb);
 }
 
 int __near_tag_write(struct near_tag *tag,
 				struct near_ndef_message *ndef,
 				near_tag_io_cb cb)
 {
-	GSList *list;
+	struct near_tag_driver *driver;
 	int err;
 
 	DBG("type 0x%x", tag->type);
 
-	for (list = driver_list; list; list = list->next) {
-		struct near_tag_driver *driver = list->data;
-
-		DBG("driver type 0x%x", driver->type);
-
-		if (driver->type == tag->type) {
-			/* Stop check presence while writing */
-			__near_adapter_stop_check_presence(tag->adapter_idx,
-								tag->target_idx);
+	driver = get_driver(tag->type);
+	if (!driver) {
+		err = -EOPNOTSUPP;
+		goto out;
+	}
 
-			if (tag->blank && driver->format) {
-				DBG("Blank tag detected, formatting");
-				err = driver->format(tag->adapter_idx,
-						tag->target_idx, format_cb);
-			} else {
-				err = driver->write(tag->adapter_idx,
-							tag->target_idx, ndef,
-							cb);
-			}
+	/* Stop check presence while writing */
+	__near_adapter_stop_check_presence(tag->adapter_idx, tag->target_idx);
 
-			break;
-		}
+	if (tag->blank && driver->format) {
+		DBG("Blank tag detected, formatting");
+		err = driver->format(tag->adapter_idx, tag->target_idx,
+								format_cb);
+	} else {
+		err = driver->write(tag->adapter_idx, tag->target_idx, ndef,
+									cb);
 	}
 
-	if (!list)
-		err = -EOPNOTSUPP;
-
+out:
 	if (err < 0)
 		__near_adapter_start_check_presence(tag->adapter_idx,
 							tag->target_idx);
@@ -1194,24 +1389,15 @@ int __near_tag_write(struct near_tag *tag,
 
 int __near_tag_check_presence(struct near_tag *tag, near_tag_io_cb cb)
 {
-	GSList *list;
+	struct near_tag_driver *driver;
 
 	DBG("type 0x%x", tag->type);
 
-	for (list = driver_list; list; list = list->next) {
-		struct near_tag_driver *driver = list->data;
-
-		DBG("driver type 0x%x", driver->type);
-
-		if (driver->type == tag->type) {
-			if (!driver->check_presence)
-				continue;
+	driver = get_driver(tag->type);
+	if (!driver || !driver->check_presence)
+		return -EOPNOTSUPP;
 
-			return driver->check_presence(tag->adapter_idx, tag->target_idx, cb);
-		}
-	}
-
-	return -EOPNOTSUPP;
+	return driver->check_presence(tag->adapter_idx, tag->target_idx, cb);
 }
 
 int near_tag_activate_target(uint32_t adapter_idx, uint32_t target_idx,
@@ -1227,9 +1413,15 @@ static void free_tag(gpointer data)
 
 	DBG("tag %p", tag);
 
+	tag_write_fail_all(tag, -ENODEV);
+
+	if (tag->write_resume)
+		g_source_remove(tag->write_resume);
+
 	near_ndef_records_free(tag->records);
 
-	g_dbus_unregister_interface(connection, tag->path,
+	if (connection)
+		g_dbus_unregister_interface(connection, tag->path,
 						NFC_TAG_INTERFACE);
 
 	g_free(tag->path);
@@ -86,7 +86,7 @@ GList *near_tlv_parse(uint8_t *tlv, size_t tlv_length)
 	while (1) {
 		t = tlv[0];
 
-		DBG("tlv 0x%x", tlv[0]);
+		TRACE("tlv 0x%x", tlv[0]);
 
 		switch (t) {
 		case TLV_NDEF:
@@ -0,0 +1,311 @@
+/*
+ *
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include <gdbus.h>
+
+#include "near.h"
+
+/*
+ * Binary trace ring, see doc/trace-api.txt for the file layout.
+ *
+ * TRACE() call sites store fixed size records to a memory mapped file,
+ * without any formatting. The file also holds the call site table, so
+ * that it can be decoded offline by neard-trace, including after a
+ * crash since the records live in the page cache.
+ */
+
+#define TRACE_MAGIC		0x4e545243	/* "NTRC" */
+#define TRACE_VERSION		1
+#define TRACE_RECORD_COUNT	32768		/* power of two */
+
+struct trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t record_count;
+	uint32_t site_count;
+	uint32_t records_offset;
+	uint32_t sites_offset;
+	uint64_t head;		/* number of records ever written */
+	uint8_t reserved[32];
+} __attribute__((packed));
+
+struct trace_site {
+	uint32_t line;
+	uint32_t file;		/* file offsets of NUL terminated strings */
+	uint32_t function;
+	uint32_t format;
+} __attribute__((packed));
+
+struct trace_record {
+	uint64_t timestamp;	/* CLOCK_MONOTONIC ns */
+	uint32_t site;
+	uint32_t reserved;
+	uint64_t args[4];
+} __attribute__((packed));
+
+/* Weak, the section only exists if there is at least one call site */
+extern struct near_trace_desc __start___trace[] __attribute__((weak));
+extern struct near_trace_desc __stop___trace[] __attribute__((weak));
+
+static DBusConnection *connection;
+static int trace_fd = -1;
+static uint8_t *trace_map;
+static size_t trace_size;
+static struct trace_header *trace_hdr;
+static struct trace_record *trace_records;
+
+void near_trace(const struct near_trace_desc *desc, const uint64_t *args)
+{
+	struct trace_record *record;
+	struct timespec ts;
+	uint64_t head;
+
+	if (!trace_hdr)
+		return;
+
+	/*
+	 * Site ids are indexes in the daemon's own __trace section. A
+	 * dlopen'd plugin has a section of its own, with no entry in the
+	 * trace file: its call sites are not supported.
+	 */
+	if (desc < __start___trace || desc >= __stop___trace)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	head = trace_hdr->head;
+	record = &trace_records[head & (TRACE_RECORD_COUNT - 1)];
+
+	record->timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	record->site = desc - __start___trace;
+	memcpy(record->args, args, sizeof(record->args));
+
+	__atomic_store_n(&trace_hdr->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static bool site_match(struct near_trace_desc *desc, const char *pattern)
+{
+	return g_pattern_match_simple(pattern, desc->file) ||
+			g_pattern_match_simple(pattern, desc->function);
+}
+
+static DBusMessage *set_sites(DBusMessage *msg, bool enable)
+{
+	struct near_trace_desc *desc;
+	const char *pattern;
+	uint32_t count = 0;
+
+	if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &pattern,
+							DBUS_TYPE_INVALID))
+		return __near_error_invalid_arguments(msg);
+
+	DBG("%s %s", enable ? "enable" : "disable", pattern);
+
+	for (desc = __start___trace; desc < __stop___trace; desc++) {
+		if (!site_match(desc, pattern))
+			continue;
+
+		if (enable)
+			desc->flags |= NEAR_TRACE_FLAG_ENABLED;
+		else
+			desc->flags &= ~NEAR_TRACE_FLAG_ENABLED;
+
+		count++;
+	}
+
+	return g_dbus_create_reply(msg, DBUS_TYPE_UINT32, &count,
+							DBUS_TYPE_INVALID);
+}
+
+static DBusMessage *enable_sites(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_sites(msg, true);
+}
+
+static DBusMessage *disable_sites(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	return set_sites(msg, false);
+}
+
+static const GDBusMethodTable trace_methods[] = {
+	{ GDBUS_METHOD("Enable", GDBUS_ARGS({ "pattern", "s" }),
+			GDBUS_ARGS({ "count", "u" }), enable_sites) },
+	{ GDBUS_METHOD("Disable", GDBUS_ARGS({ "pattern", "s" }),
+			GDBUS_ARGS({ "count", "u" }), disable_sites) },
+	{ },
+};
+
+static uint32_t trace_add_string(uint32_t *offset, const char *str)
+{
+	uint32_t start = *offset;
+	size_t len = strlen(str) + 1;
+
+	memcpy(trace_map + start, str, len);
+	*offset += len;
+
+	return start;
+}
+
+static int trace_create(const char *path)
+{
+	struct near_trace_desc *desc;
+	struct trace_site *sites;
+	size_t site_count, strings_size;
+	uint32_t offset;
+	int err;
+
+	site_count = __stop___trace - __start___trace;
+
+	strings_size = 0;
+	for (desc = __start___trace; desc < __stop___trace; desc++)
+		strings_size += strlen(desc->file) + strlen(desc->function) +
+						strlen(desc->format) + 3;
+
+	trace_size = sizeof(struct trace_header) +
+			TRACE_RECORD_COUNT * sizeof(struct trace_record) +
+			site_count * sizeof(struct trace_site) + strings_size;
+
+	trace_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (trace_fd < 0)
+		return -errno;
+
+	if (ftruncate(trace_fd, trace_size) < 0)
+		goto fail;
+
+	trace_map = mmap(NULL, trace_size, PROT_READ | PROT_WRITE,
+						MAP_SHARED, trace_fd, 0);
+	if (trace_map == MAP_FAILED) {
+		trace_map = NULL;
+		goto fail;
+	}
+
+	trace_hdr = (struct trace_header *)trace_map;
+	trace_records = (struct trace_record *)(trace_map + sizeof(*trace_hdr));
+
+	trace_hdr->version = TRACE_VERSION;
+	trace_hdr->record_size = sizeof(struct trace_record);
+	trace_hdr->record_count = TRACE_RECORD_COUNT;
+	trace_hdr->site_count = site_count;
+	trace_hdr->records_offset = sizeof(*trace_hdr);
+	trace_hdr->sites_offset = sizeof(*trace_hdr) +
+			TRACE_RECORD_COUNT * sizeof(struct trace_record);
+
+	sites = (struct trace_site *)(trace_map + trace_hdr->sites_offset);
+	offset = trace_hdr->sites_offset +
+			site_count * sizeof(struct trace_site);
+
+	for (desc = __start___trace; desc < __stop___trace; desc++, sites++) {
+		sites->line = desc->line;
+		sites->file = trace_add_string(&offset, desc->file);
+		sites->function = trace_add_string(&offset, desc->function);
+		sites->format = trace_add_string(&offset, desc->format);
+	}
+
+	__atomic_store_n(&trace_hdr->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+
+fail:
+	err = -errno;
+
+	close(trace_fd);
+	trace_fd = -1;
+
+	return err;
+}
+
+int __near_trace_init(const char *path)
+{
+	struct near_trace_desc *desc;
+	int err;
+
+	DBG("%s", path);
+
+	if (!path)
+		return 0;
+
+	err = trace_create(path);
+	if (err < 0) {
+		near_error("Could not create trace file %s: %s", path,
+							strerror(-err));
+		return err;
+	}
+
+	/* All call sites are on by default, they can be toggled on D-Bus */
+	for (desc = __start___trace; desc < __stop___trace; desc++)
+		desc->flags |= NEAR_TRACE_FLAG_ENABLED;
+
+	/* No bus when run from the unit tests */
+	connection = near_dbus_get_connection();
+	if (connection)
+		g_dbus_register_interface(connection, NFC_PATH,
+						NFC_TRACE_INTERFACE,
+						trace_methods,
+						NULL, NULL, NULL, NULL);
+
+	return 0;
+}
+
+void __near_trace_cleanup(void)
+{
+	struct near_trace_desc *desc;
+
+	DBG("");
+
+	if (trace_fd < 0)
+		return;
+
+	for (desc = __start___trace; desc < __stop___trace; desc++)
+		desc->flags &= ~NEAR_TRACE_FLAG_ENABLED;
+
+	if (connection) {
+		g_dbus_unregister_interface(connection, NFC_PATH,
+						NFC_TRACE_INTERFACE);
+		dbus_connection_unref(connection);
+		connection = NULL;
+	}
+
+	munmap(trace_map, trace_size);
+	trace_map = NULL;
+	trace_hdr = NULL;
+	trace_records = NULL;
+
+	close(trace_fd);
+	trace_fd = -1;
+}
@@ -0,0 +1,272 @@
+/*
+ *
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Decode the trace file written by neard --trace, see doc/trace-api.txt.
+ * The file can be read while neard runs or after it exited or crashed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_MAGIC		0x4e545243	/* "NTRC" */
+#define TRACE_VERSION		1
+#define TRACE_HEADER_SIZE	64
+#define TRACE_RECORD_MIN_SIZE	48
+#define TRACE_SITE_SIZE		16
+#define TRACE_MAX_ARGS		4
+
+static const uint8_t *map;
+static size_t map_size;
+
+static uint32_t get32(size_t offset)
+{
+	uint32_t val;
+
+	memcpy(&val, map + offset, sizeof(val));
+
+	return val;
+}
+
+static uint64_t get64(size_t offset)
+{
+	uint64_t val;
+
+	memcpy(&val, map + offset, sizeof(val));
+
+	return val;
+}
+
+static const char *get_string(uint32_t offset)
+{
+	if (offset >= map_size ||
+			!memchr(map + offset, '\0', map_size - offset))
+		return "?";
+
+	return (const char *) map + offset;
+}
+
+/*
+ * Arguments are all stored as 64 bits integers, keep the flags and width
+ * of each conversion but print it with a 64 bits length modifier.
+ */
+static void print_format(const char *format, const uint64_t *args)
+{
+	char spec[32];
+	size_t len;
+	int arg = 0;
+
+	while (*format) {
+		if (*format != '%') {
+			putchar(*format++);
+			continue;
+		}
+
+		if (format[1] == '%') {
+			putchar('%');
+			format += 2;
+			continue;
+		}
+
+		len = strspn(format + 1, "#0- +'123456789.");
+		if (len > sizeof(spec) - 5)
+			len = sizeof(spec) - 5;
+
+		spec[0] = '%';
+		memcpy(spec + 1, format + 1, len);
+		format += len + 1;
+
+		/* Length modifiers are replaced */
+		format += strspn(format, "hlLqjzt");
+
+		if (*format == '\0')
+			break;
+
+		if (arg == TRACE_MAX_ARGS) {
+			fputs("?", stdout);
+			format++;
+			continue;
+		}
+
+		switch (*format) {
+		case 'd':
+		case 'i':
+			strcpy(spec + len + 1, "lld");
+			printf(spec, (long long) args[arg++]);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			spec[len + 1] = 'l';
+			spec[len + 2] = 'l';
+			spec[len + 3] = *format;
+			spec[len + 4] = '\0';
+			printf(spec, (unsigned long long) args[arg++]);
+			break;
+		case 'c':
+			putchar((int) args[arg++]);
+			break;
+		default:
+			/* Strings and pointers can't be traced */
+			printf("0x%llx", (unsigned long long) args[arg++]);
+			break;
+		}
+
+		format++;
+	}
+
+	putchar('\n');
+}
+
+static int decode(void)
+{
+	uint32_t record_size, record_count, site_count, site;
+	uint32_t records_offset, sites_offset;
+	uint64_t head, first, i, timestamp, args[TRACE_MAX_ARGS];
+	size_t record, site_entry;
+	unsigned int j;
+
+	if (map_size < TRACE_HEADER_SIZE || get32(0) != TRACE_MAGIC) {
+		fprintf(stderr, "Not a neard trace file\n");
+		return -EINVAL;
+	}
+
+	if ((get32(4) & 0xffff) != TRACE_VERSION) {
+		fprintf(stderr, "Unsupported trace version %u\n",
+							get32(4) & 0xffff);
+		return -EINVAL;
+	}
+
+	record_size = get32(4) >> 16;
+	record_count = get32(8);
+	site_count = get32(12);
+	records_offset = get32(16);
+	sites_offset = get32(20);
+	head = get64(24);
+
+	if (record_size < TRACE_RECORD_MIN_SIZE || record_count == 0 ||
+		records_offset + (uint64_t) record_size * record_count >
+								map_size ||
+		sites_offset + (uint64_t) site_count * TRACE_SITE_SIZE >
+								map_size) {
+		fprintf(stderr, "Corrupted trace file\n");
+		return -EINVAL;
+	}
+
+	first = head > record_count ? head - record_count : 0;
+
+	for (i = first; i < head; i++) {
+		record = records_offset + (i % record_count) * record_size;
+
+		timestamp = get64(record);
+		site = get32(record + 8);
+
+		for (j = 0; j < TRACE_MAX_ARGS; j++)
+			args[j] = get64(record + 16 + j * 8);
+
+		printf("%" PRIu64 ".%06" PRIu64 " ",
+				timestamp / 1000000000,
+				(timestamp % 1000000000) / 1000);
+
+		if (site >= site_count) {
+			printf("unknown call site %u\n", site);
+			continue;
+		}
+
+		site_entry = sites_offset + (size_t) site * TRACE_SITE_SIZE;
+
+		printf("%s:%u %s() ", get_string(get32(site_entry + 4)),
+					get32(site_entry),
+					get_string(get32(site_entry + 8)));
+
+		print_format(get_string(get32(site_entry + 12)), args);
+	}
+
+	if (first > 0)
+		fprintf(stderr, "%" PRIu64 " older records overwritten\n",
+									first);
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("neard-trace - neard trace file decoder\n\n");
+	printf("Usage:\n");
+	printf("\tneard-trace <trace file>\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct stat st;
+	int fd, err;
+
+	if (argc != 2) {
+		usage();
+		exit(1);
+	}
+
+	fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror("Can't open trace file");
+		exit(1);
+	}
+
+	if (fstat(fd, &st) < 0) {
+		perror("Can't stat trace file");
+		close(fd);
+		exit(1);
+	}
+
+	map_size = st.st_size;
+	if (map_size == 0) {
+		fprintf(stderr, "Empty trace file\n");
+		close(fd);
+		exit(1);
+	}
+
+	map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		perror("Can't map trace file");
+		exit(1);
+	}
+
+	err = decode();
+
+	munmap((void *) map, map_size);
+
+	return err < 0 ? 1 : 0;
+}
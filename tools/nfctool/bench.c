@@ -0,0 +1,690 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <glib.h>
+
+#include <near/nfc_copy.h>
+
+#include "nfctool.h"
+#include "bench.h"
+
+/*
+ * Tag I/O benchmark: a script of tag commands is run a number of
+ * times over a raw socket to the first tag found, and round trip
+ * times are reported per script line.
+ *
+ * Script lines, '#' starting comments:
+ *
+ *   type 2|3|4|4b|5		tag type, mandatory and first
+ *   raw HEX			any command, sent as is
+ *   read BLOCK			T2, T5
+ *   fast_read START END	T2
+ *   write BLOCK HEX		T2 (4 bytes), T5
+ *   check SERVICE BLOCK [COUNT]	T3, without encryption
+ *   select_ndef		T4, NDEF application
+ *   select_file FID		T4
+ *   read_binary OFFSET LENGTH	T4
+ *   update_binary OFFSET HEX	T4
+ */
+
+#define BENCH_TIMEOUT_MS	1000
+#define BENCH_MAX_CMD		256
+#define BENCH_MAX_RESP		1024
+
+#define T3_IDM_LEN		8
+#define T3_IDM_OFFSET		2	/* after length and command code */
+
+enum bench_check {
+	BENCH_CHECK_NONE,
+	BENCH_CHECK_T3,
+	BENCH_CHECK_T4,
+	BENCH_CHECK_T5,
+};
+
+struct bench_cmd {
+	gchar *name;
+	guint8 req[BENCH_MAX_CMD];
+	guint16 req_len;
+	guint16 tx_bytes;	/* payload written to the tag */
+	bool needs_idm;
+	enum bench_check check;
+
+	GArray *rtts;		/* nanoseconds */
+	guint32 errors;
+	guint64 rx_bytes;
+};
+
+static GSList *bench_cmds;
+static guint8 bench_type;
+static guint8 bench_protocol;
+
+static void free_cmd(gpointer data)
+{
+	struct bench_cmd *cmd = data;
+
+	g_free(cmd->name);
+	if (cmd->rtts)
+		g_array_free(cmd->rtts, TRUE);
+	g_free(cmd);
+}
+
+static int parse_uint(const char *str, guint32 max, guint32 *val)
+{
+	unsigned long ul;
+	char *end;
+
+	if (!str)
+		return -EINVAL;
+
+	ul = strtoul(str, &end, 0);
+	if (*str == '\0' || *end != '\0' || ul > max)
+		return -EINVAL;
+
+	*val = ul;
+
+	return 0;
+}
+
+static int parse_hex(const char *str, guint8 *buf, gsize max)
+{
+	gsize len, i;
+
+	if (!str)
+		return -EINVAL;
+
+	len = strlen(str);
+	if (len == 0 || len % 2 || len / 2 > max)
+		return -EINVAL;
+
+	for (i = 0; i < len / 2; i++) {
+		if (!g_ascii_isxdigit(str[2 * i]) ||
+					!g_ascii_isxdigit(str[2 * i + 1]))
+			return -EINVAL;
+
+		buf[i] = g_ascii_xdigit_value(str[2 * i]) << 4 |
+				g_ascii_xdigit_value(str[2 * i + 1]);
+	}
+
+	return len / 2;
+}
+
+static int parse_type(const char *str)
+{
+	static const struct {
+		const char *name;
+		guint8 type;
+		guint8 protocol;
+	} types[] = {
+		{ "1", 1, NFC_PROTO_JEWEL },
+		{ "2", 2, NFC_PROTO_MIFARE },
+		{ "3", 3, NFC_PROTO_FELICA },
+		{ "4", 4, NFC_PROTO_ISO14443 },
+		{ "4a", 4, NFC_PROTO_ISO14443 },
+		{ "4b", 4, NFC_PROTO_ISO14443_B },
+		{ "5", 5, NFC_PROTO_ISO15693 },
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(types); i++)
+		if (str && g_ascii_strcasecmp(str, types[i].name) == 0) {
+			bench_type = types[i].type;
+			bench_protocol = types[i].protocol;
+			return 0;
+		}
+
+	return -EINVAL;
+}
+
+static int parse_t2(struct bench_cmd *cmd, gchar **argv)
+{
+	guint32 block, end;
+	int len;
+
+	if (g_strcmp0(argv[0], "read") == 0) {
+		if (parse_uint(argv[1], 0xFF, &block) || argv[2])
+			return -EINVAL;
+
+		cmd->req[0] = 0x30;
+		cmd->req[1] = block;
+		cmd->req_len = 2;
+	} else if (g_strcmp0(argv[0], "fast_read") == 0) {
+		if (parse_uint(argv[1], 0xFF, &block) ||
+				parse_uint(argv[2], 0xFF, &end) ||
+				end < block || argv[3])
+			return -EINVAL;
+
+		cmd->req[0] = 0x3A;
+		cmd->req[1] = block;
+		cmd->req[2] = end;
+		cmd->req_len = 3;
+	} else if (g_strcmp0(argv[0], "write") == 0) {
+		if (parse_uint(argv[1], 0xFF, &block) || !argv[2] || argv[3])
+			return -EINVAL;
+
+		len = parse_hex(argv[2], cmd->req + 2, 4);
+		if (len != 4)
+			return -EINVAL;
+
+		cmd->req[0] = 0xA2;
+		cmd->req[1] = block;
+		cmd->req_len = 6;
+		cmd->tx_bytes = 4;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_t3(struct bench_cmd *cmd, gchar **argv)
+{
+	guint32 service, block, count = 1, i;
+
+	if (g_strcmp0(argv[0], "check") != 0)
+		return -EINVAL;
+
+	if (parse_uint(argv[1], 0xFFFF, &service) ||
+			parse_uint(argv[2], 0xFF, &block))
+		return -EINVAL;
+
+	if (argv[3] && (parse_uint(argv[3], 15, &count) || argv[4] ||
+						count == 0 || block + count > 0x100))
+		return -EINVAL;
+
+	/* Length, CHECK, IDm, one service, block list */
+	cmd->req[1] = 0x06;
+	cmd->req[10] = 1;
+	cmd->req[11] = service & 0xFF;
+	cmd->req[12] = service >> 8;
+	cmd->req[13] = count;
+
+	for (i = 0; i < count; i++) {
+		cmd->req[14 + 2 * i] = 0x80;
+		cmd->req[15 + 2 * i] = block + i;
+	}
+
+	cmd->req_len = 14 + 2 * count;
+	cmd->req[0] = cmd->req_len;
+	cmd->needs_idm = true;
+	cmd->check = BENCH_CHECK_T3;
+
+	return 0;
+}
+
+static int parse_t4(struct bench_cmd *cmd, gchar **argv)
+{
+	static const guint8 select_ndef[] = {
+		0x00, 0xA4, 0x04, 0x00, 0x07,
+		0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00
+	};
+	guint32 fid, offset, len;
+	int data_len;
+
+	cmd->check = BENCH_CHECK_T4;
+
+	if (g_strcmp0(argv[0], "select_ndef") == 0) {
+		if (argv[1])
+			return -EINVAL;
+
+		memcpy(cmd->req, select_ndef, sizeof(select_ndef));
+		cmd->req_len = sizeof(select_ndef);
+	} else if (g_strcmp0(argv[0], "select_file") == 0) {
+		if (parse_uint(argv[1], 0xFFFF, &fid) || argv[2])
+			return -EINVAL;
+
+		cmd->req[0] = 0x00;
+		cmd->req[1] = 0xA4;
+		cmd->req[2] = 0x00;
+		cmd->req[3] = 0x0C;
+		cmd->req[4] = 0x02;
+		cmd->req[5] = fid >> 8;
+		cmd->req[6] = fid & 0xFF;
+		cmd->req_len = 7;
+	} else if (g_strcmp0(argv[0], "read_binary") == 0) {
+		if (parse_uint(argv[1], 0x7FFF, &offset) ||
+				parse_uint(argv[2], 0xFF, &len) || argv[3])
+			return -EINVAL;
+
+		cmd->req[0] = 0x00;
+		cmd->req[1] = 0xB0;
+		cmd->req[2] = offset >> 8;
+		cmd->req[3] = offset & 0xFF;
+		cmd->req[4] = len;
+		cmd->req_len = 5;
+	} else if (g_strcmp0(argv[0], "update_binary") == 0) {
+		if (parse_uint(argv[1], 0x7FFF, &offset) || !argv[2] ||
+								argv[3])
+			return -EINVAL;
+
+		/* Lc can take 255 bytes, the buffer after the header can't */
+		data_len = parse_hex(argv[2], cmd->req + 5,
+						BENCH_MAX_CMD - 5);
+		if (data_len < 0)
+			return data_len;
+
+		cmd->req[0] = 0x00;
+		cmd->req[1] = 0xD6;
+		cmd->req[2] = offset >> 8;
+		cmd->req[3] = offset & 0xFF;
+		cmd->req[4] = data_len;
+		cmd->req_len = 5 + data_len;
+		cmd->tx_bytes = data_len;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_t5(struct bench_cmd *cmd, gchar **argv)
+{
+	guint32 block;
+	int len;
+
+	/* Non addressed mode, high data rate */
+	cmd->req[0] = 0x02;
+	cmd->check = BENCH_CHECK_T5;
+
+	if (g_strcmp0(argv[0], "read") == 0) {
+		if (parse_uint(argv[1], 0xFF, &block) || argv[2])
+			return -EINVAL;
+
+		cmd->req[1] = 0x20;
+		cmd->req[2] = block;
+		cmd->req_len = 3;
+	} else if (g_strcmp0(argv[0], "write") == 0) {
+		if (parse_uint(argv[1], 0xFF, &block) || !argv[2] || argv[3])
+			return -EINVAL;
+
+		len = parse_hex(argv[2], cmd->req + 3, 32);
+		if (len < 0)
+			return len;
+
+		cmd->req[1] = 0x21;
+		cmd->req[2] = block;
+		cmd->req_len = 3 + len;
+		cmd->tx_bytes = len;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_line(gchar *line)
+{
+	struct bench_cmd *cmd;
+	gchar **argv;
+	int i, len, err = -EINVAL;
+
+	argv = g_strsplit_set(g_strstrip(line), " \t", -1);
+
+	/* Drop the empty tokens of repeated blanks */
+	for (i = 0, len = 0; argv[i]; i++) {
+		if (*argv[i] == '\0')
+			g_free(argv[i]);
+		else
+			argv[len++] = argv[i];
+	}
+	argv[len] = NULL;
+
+	if (!argv[0]) {
+		err = 0;
+		goto exit;
+	}
+
+	if (g_strcmp0(argv[0], "type") == 0) {
+		if (bench_type || !argv[1] || argv[2])
+			goto exit;
+
+		err = parse_type(argv[1]);
+		goto exit;
+	}
+
+	if (!bench_type)
+		goto exit;
+
+	cmd = g_try_malloc0(sizeof(*cmd));
+	if (!cmd) {
+		err = -ENOMEM;
+		goto exit;
+	}
+
+	if (g_strcmp0(argv[0], "raw") == 0 && argv[1] && !argv[2]) {
+		len = parse_hex(argv[1], cmd->req, BENCH_MAX_CMD);
+		err = len < 0 ? len : 0;
+		cmd->req_len = len;
+	} else if (bench_type == 2) {
+		err = parse_t2(cmd, argv);
+	} else if (bench_type == 3) {
+		err = parse_t3(cmd, argv);
+	} else if (bench_type == 4) {
+		err = parse_t4(cmd, argv);
+	} else if (bench_type == 5) {
+		err = parse_t5(cmd, argv);
+	}
+
+	if (err) {
+		g_free(cmd);
+		goto exit;
+	}
+
+	cmd->name = g_strjoinv(" ", argv);
+	cmd->rtts = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	bench_cmds = g_slist_append(bench_cmds, cmd);
+
+exit:
+	g_strfreev(argv);
+
+	return err;
+}
+
+int bench_init(const char *filename)
+{
+	gchar *content, **lines, *comment;
+	GError *error = NULL;
+	int i, err = 0;
+
+	if (!g_file_get_contents(filename, &content, NULL, &error)) {
+		print_error("Can't read %s: %s", filename, error->message);
+		g_error_free(error);
+		return -EIO;
+	}
+
+	lines = g_strsplit(content, "\n", -1);
+	g_free(content);
+
+	for (i = 0; lines[i]; i++) {
+		comment = strchr(lines[i], '#');
+		if (comment)
+			*comment = '\0';
+
+		err = parse_line(lines[i]);
+		if (err) {
+			print_error("%s:%d: invalid line", filename, i + 1);
+			break;
+		}
+	}
+
+	g_strfreev(lines);
+
+	if (!err && !bench_cmds) {
+		print_error("%s: no tag type or command", filename);
+		err = -EINVAL;
+	}
+
+	if (err)
+		bench_cleanup();
+
+	return err;
+}
+
+void bench_cleanup(void)
+{
+	g_slist_free_full(bench_cmds, free_cmd);
+	bench_cmds = NULL;
+	bench_type = 0;
+}
+
+static guint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (guint64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns the response length, status byte included */
+static int bench_transceive(int sock, guint8 *req, guint16 req_len,
+						guint8 *resp, guint64 *rtt)
+{
+	guint64 start;
+	ssize_t len;
+
+	start = now_ns();
+
+	if (send(sock, req, req_len, 0) < 0)
+		return -errno;
+
+	len = recv(sock, resp, BENCH_MAX_RESP, 0);
+	if (len < 0)
+		return -errno;
+
+	*rtt = now_ns() - start;
+
+	/* The kernel prepends a status byte */
+	if (len < 1 || resp[0] != 0)
+		return -EIO;
+
+	return len;
+}
+
+/* Number of data bytes read, or a negative error */
+static int bench_check_resp(struct bench_cmd *cmd, guint8 *resp, int len)
+{
+	/* Skip the status byte */
+	resp++;
+	len--;
+
+	switch (cmd->check) {
+	case BENCH_CHECK_NONE:
+		return len;
+
+	case BENCH_CHECK_T3:
+		/* Length, code, IDm, status flags, block count */
+		if (len < 13 || resp[1] != 0x07 || resp[10] != 0)
+			return -EIO;
+
+		return len - 13;
+
+	case BENCH_CHECK_T4:
+		if (len < 2 || resp[len - 2] != 0x90 || resp[len - 1] != 0x00)
+			return -EIO;
+
+		return len - 2;
+
+	case BENCH_CHECK_T5:
+		if (len < 1 || resp[0] & 0x01)
+			return -EIO;
+
+		return len - 1;
+	}
+
+	return len;
+}
+
+static int bench_t3_poll(int sock, guint8 *idm)
+{
+	guint8 req[] = { 0x06, 0x00, 0x12, 0xFC, 0x01, 0x00 };
+	guint8 resp[BENCH_MAX_RESP];
+	guint64 rtt;
+	int len;
+
+	len = bench_transceive(sock, req, sizeof(req), resp, &rtt);
+	if (len < 0)
+		return len;
+
+	/* Status, length, response code, IDm */
+	if (len < 3 + T3_IDM_LEN || resp[2] != 0x01)
+		return -EIO;
+
+	memcpy(idm, resp + 3, T3_IDM_LEN);
+
+	return 0;
+}
+
+static gint compare_u64(gconstpointer a, gconstpointer b)
+{
+	guint64 val_a = *(const guint64 *) a;
+	guint64 val_b = *(const guint64 *) b;
+
+	return val_a < val_b ? -1 : val_a > val_b;
+}
+
+static double percentile(GArray *rtts, guint pct)
+{
+	guint idx = (rtts->len - 1) * pct / 100;
+
+	return g_array_index(rtts, guint64, idx) / 1000.0;
+}
+
+static void bench_report(void)
+{
+	struct bench_cmd *cmd;
+	guint64 total, bytes;
+	GSList *list;
+	guint i;
+
+	printf("%-28s %6s %6s %9s %9s %9s %9s %9s %10s\n", "command",
+			"count", "errors", "min", "p50", "p95", "p99", "max",
+			"bytes/s");
+
+	for (list = bench_cmds; list; list = list->next) {
+		cmd = list->data;
+
+		printf("%-28.28s %6u %6u", cmd->name, cmd->rtts->len,
+							cmd->errors);
+
+		if (!cmd->rtts->len) {
+			printf("\n");
+			continue;
+		}
+
+		g_array_sort(cmd->rtts, compare_u64);
+
+		for (total = 0, i = 0; i < cmd->rtts->len; i++)
+			total += g_array_index(cmd->rtts, guint64, i);
+
+		bytes = cmd->rx_bytes +
+				(guint64) cmd->tx_bytes * cmd->rtts->len;
+
+		printf(" %9.1f %9.1f %9.1f %9.1f %9.1f %10.0f\n",
+				percentile(cmd->rtts, 0),
+				percentile(cmd->rtts, 50),
+				percentile(cmd->rtts, 95),
+				percentile(cmd->rtts, 99),
+				percentile(cmd->rtts, 100),
+				total ? bytes * 1e9 / total : 0);
+	}
+
+	printf("(round trip times in usec)\n");
+}
+
+int bench_run(guint32 adapter_idx, guint32 target_idx)
+{
+	struct sockaddr_nfc addr;
+	struct timeval timeout;
+	struct bench_cmd *cmd;
+	guint8 resp[BENCH_MAX_RESP];
+	guint8 idm[T3_IDM_LEN];
+	bool idm_valid = false;
+	GSList *list;
+	guint64 rtt;
+	int sock, len, err;
+	gint32 i;
+
+	sock = socket(AF_NFC, SOCK_SEQPACKET, NFC_SOCKPROTO_RAW);
+	if (sock < 0) {
+		err = -errno;
+		print_error("socket: %s", strerror(-err));
+		return err;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sa_family = AF_NFC;
+	addr.dev_idx = adapter_idx;
+	addr.target_idx = target_idx;
+	addr.nfc_protocol = bench_protocol;
+
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err = -errno;
+		print_error("Can't connect to target %u: %s", target_idx,
+							strerror(-err));
+		goto exit;
+	}
+
+	timeout.tv_sec = BENCH_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (BENCH_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	printf("Running %d iterations on nfc%u target %u\n\n",
+				opts.bench_count, adapter_idx, target_idx);
+
+	for (i = 0; i < opts.bench_count; i++) {
+		for (list = bench_cmds; list; list = list->next) {
+			cmd = list->data;
+
+			if (cmd->needs_idm && !idm_valid) {
+				err = bench_t3_poll(sock, idm);
+				if (err) {
+					print_error("Can't get the T3 IDm: %s",
+							strerror(-err));
+					goto exit;
+				}
+
+				idm_valid = true;
+			}
+
+			if (cmd->needs_idm)
+				memcpy(cmd->req + T3_IDM_OFFSET, idm,
+								T3_IDM_LEN);
+
+			len = bench_transceive(sock, cmd->req, cmd->req_len,
+								resp, &rtt);
+			if (len >= 0)
+				len = bench_check_resp(cmd, resp, len);
+
+			if (len < 0) {
+				cmd->errors++;
+
+				/* The tag is gone, no point in going on */
+				if (len == -ENODEV || len == -ENOLINK ||
+							len == -ENOTCONN)
+					goto report;
+
+				continue;
+			}
+
+			g_array_append_val(cmd->rtts, rtt);
+			cmd->rx_bytes += len;
+		}
+	}
+
+report:
+	bench_report();
+	err = 0;
+
+exit:
+	close(sock);
+
+	return err;
+}
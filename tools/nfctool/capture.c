@@ -0,0 +1,395 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <glib.h>
+
+#include "nfctool.h"
+#include "capture.h"
+
+/*
+ * Capture only mode: frames are drained from the LLCP raw socket in
+ * recvmmsg() batches and appended to the pcapng file, without being
+ * decoded. Records are staged in a ring of large buffers, which are
+ * written out from an idle callback so that disk writes never delay
+ * the socket draining. Only when the whole ring is full does the
+ * capture path write a buffer itself.
+ */
+
+#define CAPTURE_BATCH		32
+#define CAPTURE_FRAME_LEN	0x8FF
+#define CAPTURE_MAX_BATCHES	8	/* per main loop iteration */
+#define CAPTURE_RCVBUF		(4 * 1024 * 1024)
+
+#define CAPTURE_BUF_SIZE	(1024 * 1024)
+#define CAPTURE_BUF_COUNT	4
+
+#define CAPTURE_LINKTYPE	0xF5	/* LINKTYPE_NFC_LLCP */
+#define CAPTURE_SNAP_LEN	0xFFFF
+
+#define CAPTURE_CTRL_LEN	CMSG_SPACE(sizeof(struct timespec))
+
+#define EPB_HEADER_LEN		28
+#define BLOCK_TRAILER_LEN	4
+
+struct capture_buf {
+	guint8 *data;
+	gsize len;
+};
+
+static int capture_fd = -1;
+static GIOChannel *capture_channel;
+static guint capture_watch;
+static guint flush_watch;
+
+static guint8 *frames;
+static struct mmsghdr msgs[CAPTURE_BATCH];
+static struct iovec iovs[CAPTURE_BATCH];
+static guint8 ctrls[CAPTURE_BATCH][CAPTURE_CTRL_LEN];
+
+/* bufs[fill] is being filled, the pending ones before it wait for disk */
+static struct capture_buf bufs[CAPTURE_BUF_COUNT];
+static guint fill;
+static guint pending;
+
+static guint32 snap_len;
+static guint64 packets;
+static guint64 bytes;
+
+static int capture_write(guint8 *data, gsize len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(capture_fd, data, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		data += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+static int capture_flush_one(void)
+{
+	struct capture_buf *buf;
+	int err;
+
+	if (!pending)
+		return 0;
+
+	buf = &bufs[(fill + CAPTURE_BUF_COUNT - pending) % CAPTURE_BUF_COUNT];
+
+	err = capture_write(buf->data, buf->len);
+	if (err)
+		print_error("pcapng write: %s", strerror(-err));
+
+	buf->len = 0;
+	pending--;
+
+	return err;
+}
+
+static gboolean capture_flush(gpointer user_data)
+{
+	capture_flush_one();
+
+	if (pending)
+		return TRUE;
+
+	flush_watch = 0;
+
+	return FALSE;
+}
+
+static guint8 *capture_reserve(gsize len)
+{
+	struct capture_buf *buf = &bufs[fill];
+	guint8 *ptr;
+
+	if (buf->len + len > CAPTURE_BUF_SIZE) {
+		/* Ring is full, the disk can't keep up */
+		if (pending == CAPTURE_BUF_COUNT - 1)
+			capture_flush_one();
+
+		pending++;
+		fill = (fill + 1) % CAPTURE_BUF_COUNT;
+		buf = &bufs[fill];
+
+		if (!flush_watch)
+			flush_watch = g_idle_add(capture_flush, NULL);
+	}
+
+	ptr = buf->data + buf->len;
+	buf->len += len;
+
+	return ptr;
+}
+
+static guint8 *put32(guint8 *ptr, guint32 val)
+{
+	memcpy(ptr, &val, 4);
+
+	return ptr + 4;
+}
+
+static guint8 *put16(guint8 *ptr, guint16 val)
+{
+	memcpy(ptr, &val, 2);
+
+	return ptr + 2;
+}
+
+static void capture_write_headers(void)
+{
+	guint8 *ptr;
+
+	/* Section Header Block, no options */
+	ptr = capture_reserve(28);
+	ptr = put32(ptr, PCAPNG_BLOCK_SHB);
+	ptr = put32(ptr, 28);
+	ptr = put32(ptr, PCAPNG_BYTE_ORDER_MAGIC);
+	ptr = put16(ptr, 1);
+	ptr = put16(ptr, 0);
+	ptr = put32(ptr, 0xFFFFFFFF);	/* section length unknown */
+	ptr = put32(ptr, 0xFFFFFFFF);
+	put32(ptr, 28);
+
+	/* Interface Description Block, nanosecond timestamps */
+	ptr = capture_reserve(32);
+	ptr = put32(ptr, PCAPNG_BLOCK_IDB);
+	ptr = put32(ptr, 32);
+	ptr = put16(ptr, CAPTURE_LINKTYPE);
+	ptr = put16(ptr, 0);
+	ptr = put32(ptr, snap_len);
+	ptr = put16(ptr, PCAPNG_OPT_IF_TSRESOL);
+	ptr = put16(ptr, 1);
+	ptr[0] = 9;			/* 10^-9 */
+	ptr[1] = ptr[2] = ptr[3] = 0;	/* padding */
+	ptr += 4;
+	ptr = put32(ptr, PCAPNG_OPT_END);
+	put32(ptr, 32);
+}
+
+static void capture_write_packet(struct msghdr *msg, guint32 len)
+{
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+	guint32 caplen, block_len;
+	guint64 nsec;
+	guint8 *ptr;
+
+	cmsg = CMSG_FIRSTHDR(msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+				cmsg->cmsg_type == SCM_TIMESTAMPNS)
+		memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+	else
+		clock_gettime(CLOCK_REALTIME, &ts);
+
+	nsec = (guint64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	caplen = MIN(len, snap_len);
+	block_len = EPB_HEADER_LEN + ((caplen + 3) & ~3) + BLOCK_TRAILER_LEN;
+
+	ptr = capture_reserve(block_len);
+	ptr = put32(ptr, PCAPNG_BLOCK_EPB);
+	ptr = put32(ptr, block_len);
+	ptr = put32(ptr, 0);		/* interface id */
+	ptr = put32(ptr, nsec >> 32);
+	ptr = put32(ptr, nsec & 0xFFFFFFFF);
+	ptr = put32(ptr, caplen);
+	ptr = put32(ptr, len);
+
+	memcpy(ptr, msg->msg_iov->iov_base, caplen);
+	memset(ptr + caplen, 0, ((caplen + 3) & ~3) - caplen);
+	ptr += (caplen + 3) & ~3;
+
+	put32(ptr, block_len);
+
+	packets++;
+	bytes += len;
+}
+
+static gboolean capture_handler(GIOChannel *channel,
+				GIOCondition cond, gpointer data)
+{
+	int sock, batch, count, i;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		print_error("Capture IO error 0x%x\n", cond);
+
+		capture_watch = 0;
+
+		return FALSE;
+	}
+
+	sock = g_io_channel_unix_get_fd(channel);
+
+	for (batch = 0; batch < CAPTURE_MAX_BATCHES; batch++) {
+		/* The kernel updates the control lengths on each call */
+		for (i = 0; i < CAPTURE_BATCH; i++)
+			msgs[i].msg_hdr.msg_controllen = CAPTURE_CTRL_LEN;
+
+		count = recvmmsg(sock, msgs, CAPTURE_BATCH, MSG_DONTWAIT,
+									NULL);
+		if (count < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+
+			print_error("recvmmsg: %s", strerror(errno));
+
+			capture_watch = 0;
+
+			return FALSE;
+		}
+
+		for (i = 0; i < count; i++)
+			capture_write_packet(&msgs[i].msg_hdr, msgs[i].msg_len);
+
+		if (count < CAPTURE_BATCH)
+			break;
+	}
+
+	return TRUE;
+}
+
+void capture_cleanup(void)
+{
+	int i;
+
+	if (capture_watch > 0)
+		g_source_remove(capture_watch);
+	capture_watch = 0;
+
+	if (flush_watch > 0)
+		g_source_remove(flush_watch);
+	flush_watch = 0;
+
+	if (capture_channel) {
+		g_io_channel_shutdown(capture_channel, TRUE, NULL);
+		g_io_channel_unref(capture_channel);
+		capture_channel = NULL;
+	}
+
+	if (capture_fd >= 0) {
+		/* Pending buffers, then the one being filled */
+		while (pending)
+			capture_flush_one();
+
+		if (bufs[fill].len)
+			capture_write(bufs[fill].data, bufs[fill].len);
+
+		close(capture_fd);
+		capture_fd = -1;
+
+		printf("Captured %" G_GUINT64_FORMAT " packets (%"
+				G_GUINT64_FORMAT " bytes)\n", packets, bytes);
+	}
+
+	for (i = 0; i < CAPTURE_BUF_COUNT; i++) {
+		g_free(bufs[i].data);
+		bufs[i].data = NULL;
+		bufs[i].len = 0;
+	}
+
+	g_free(frames);
+	frames = NULL;
+}
+
+int capture_init(int sock, char *pcap_filename)
+{
+	int one = 1, rcvbuf = CAPTURE_RCVBUF;
+	int i, err;
+
+	capture_fd = open(pcap_filename, O_WRONLY | O_CREAT | O_TRUNC |
+							O_CLOEXEC, 0644);
+	if (capture_fd < 0) {
+		err = errno;
+		print_error("Can't open file %s: %s",
+				pcap_filename, strerror(err));
+		return -err;
+	}
+
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one,
+							sizeof(one)) < 0)
+		print_error("setsockopt: %s", strerror(errno));
+
+	/* Absorb bursts while a buffer is being written out */
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+							sizeof(rcvbuf)) < 0)
+		print_error("setsockopt: %s", strerror(errno));
+
+	frames = g_malloc(CAPTURE_BATCH * CAPTURE_FRAME_LEN);
+
+	for (i = 0; i < CAPTURE_BATCH; i++) {
+		iovs[i].iov_base = frames + i * CAPTURE_FRAME_LEN;
+		iovs[i].iov_len = CAPTURE_FRAME_LEN;
+
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = ctrls[i];
+	}
+
+	for (i = 0; i < CAPTURE_BUF_COUNT; i++)
+		bufs[i].data = g_malloc(CAPTURE_BUF_SIZE);
+
+	fill = 0;
+	pending = 0;
+	packets = 0;
+	bytes = 0;
+
+	if (opts.snap_len && opts.snap_len < CAPTURE_SNAP_LEN)
+		snap_len = opts.snap_len;
+	else
+		snap_len = CAPTURE_SNAP_LEN;
+
+	capture_write_headers();
+
+	capture_channel = g_io_channel_unix_new(sock);
+	g_io_channel_set_close_on_unref(capture_channel, TRUE);
+
+	g_io_channel_set_encoding(capture_channel, NULL, NULL);
+	g_io_channel_set_buffered(capture_channel, FALSE);
+
+	/* Draining the socket comes before anything else */
+	capture_watch = g_io_add_watch_full(capture_channel, G_PRIORITY_HIGH,
+				G_IO_IN | G_IO_NVAL | G_IO_HUP | G_IO_ERR,
+				capture_handler, NULL, NULL);
+
+	return 0;
+}
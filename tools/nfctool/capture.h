@@ -0,0 +1,37 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+#define PCAPNG_BLOCK_SHB	0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB	0x00000001
+#define PCAPNG_BLOCK_EPB	0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC	0x1A2B3C4D
+
+#define PCAPNG_OPT_END		0
+#define PCAPNG_OPT_IF_TSRESOL	9
+
+int capture_init(int sock, char *pcap_filename);
+
+void capture_cleanup(void);
+
+#endif /* __CAPTURE_H */
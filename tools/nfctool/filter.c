@@ -0,0 +1,331 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <glib.h>
+
+#include <near/nfc_copy.h>
+
+#include "nfctool.h"
+#include "sniffer.h"
+#include "llcp-decode.h"
+#include "filter.h"
+
+/*
+ * Kernel side capture filtering. The filter expressions are turned
+ * into a classic BPF program attached to the raw LLCP socket, so that
+ * frames we don't care about are never copied to user space.
+ *
+ * Frames start with the raw socket header (adapter index, direction)
+ * followed by the LLCP header: DSAP (6 bits), PTYPE (4), SSAP (6).
+ */
+
+enum filter_field {
+	FILTER_DIR,
+	FILTER_PTYPE,
+	FILTER_LOCAL_SAP,
+	FILTER_REMOTE_SAP,
+	FILTER_FIELD_MAX
+};
+
+static const char *field_names[FILTER_FIELD_MAX] = {
+	"dir", "ptype", "lsap", "rsap"
+};
+
+static const guint8 field_sizes[FILTER_FIELD_MAX] = { 2, 16, 64, 64 };
+
+/* Bitmask of the values allowed for each field, all by default */
+static guint64 field_masks[FILTER_FIELD_MAX] = {
+	0x3, 0xFFFF, G_MAXUINT64, G_MAXUINT64
+};
+
+#define FILTER_MAX_INSNS	256
+
+static struct sock_filter insns[FILTER_MAX_INSNS];
+static guint16 insn_count;
+
+static int filter_parse_value(enum filter_field field, const char *str,
+							guint64 *values)
+{
+	char *end;
+	long val;
+	int i;
+
+	if (field == FILTER_DIR) {
+		if (g_ascii_strcasecmp(str, "rx") == 0)
+			val = NFC_DIRECTION_RX;
+		else if (g_ascii_strcasecmp(str, "tx") == 0)
+			val = NFC_DIRECTION_TX;
+		else
+			return -EINVAL;
+
+		*values |= 1ULL << val;
+
+		return 0;
+	}
+
+	if (field == FILTER_PTYPE) {
+		for (i = 0; i < 16; i++)
+			if (g_ascii_strcasecmp(str, llcp_ptype_name(i)) == 0) {
+				*values |= 1ULL << i;
+				return 0;
+			}
+	}
+
+	val = strtol(str, &end, 0);
+	if (*str == '\0' || *end != '\0' || val < 0 ||
+						val >= field_sizes[field])
+		return -EINVAL;
+
+	*values |= 1ULL << val;
+
+	return 0;
+}
+
+static int filter_parse_term(const char *term)
+{
+	gchar **values = NULL;
+	guint64 mask = 0;
+	const char *op;
+	bool negate;
+	gsize name_len;
+	int field, i, err = -EINVAL;
+
+	if (g_ascii_strcasecmp(term, "nosymm") == 0) {
+		field_masks[FILTER_PTYPE] &= ~(1ULL << LLCP_PTYPE_SYMM);
+		return 0;
+	}
+
+	op = strchr(term, '=');
+	if (!op || op == term)
+		goto exit;
+
+	negate = op[-1] == '!';
+	name_len = op - term - negate;
+
+	for (field = 0; field < FILTER_FIELD_MAX; field++)
+		if (strlen(field_names[field]) == name_len &&
+			g_ascii_strncasecmp(term, field_names[field],
+							name_len) == 0)
+			break;
+
+	if (field == FILTER_FIELD_MAX)
+		goto exit;
+
+	values = g_strsplit(op + 1, "|", -1);
+
+	for (i = 0; values[i]; i++) {
+		err = filter_parse_value(field, values[i], &mask);
+		if (err)
+			goto exit;
+	}
+
+	if (negate)
+		field_masks[field] &= ~mask;
+	else
+		field_masks[field] &= mask;
+
+	err = 0;
+
+exit:
+	if (err)
+		print_error("Invalid filter: %s", term);
+
+	g_strfreev(values);
+
+	return err;
+}
+
+/* Comma separated terms, all of which have to match */
+int filter_parse(const char *expr)
+{
+	gchar **terms;
+	int i, err = 0;
+
+	terms = g_strsplit(expr, ",", -1);
+
+	for (i = 0; terms[i] && !err; i++)
+		err = filter_parse_term(terms[i]);
+
+	g_strfreev(terms);
+
+	return err;
+}
+
+static void emit(guint16 code, guint8 jt, guint8 jf, guint32 k)
+{
+	struct sock_filter insn = BPF_JUMP(code, k, jt, jf);
+
+	if (insn_count < FILTER_MAX_INSNS)
+		insns[insn_count] = insn;
+
+	insn_count++;
+}
+
+static void emit_load_field(enum filter_field field)
+{
+	switch (field) {
+	case FILTER_DIR:
+		emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 1);
+		emit(BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x01);
+		break;
+
+	case FILTER_PTYPE:
+		emit(BPF_LD | BPF_H | BPF_ABS, 0, 0, 2);
+		emit(BPF_ALU | BPF_RSH | BPF_K, 0, 0, 6);
+		emit(BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x0F);
+		break;
+
+	case FILTER_LOCAL_SAP:
+	case FILTER_REMOTE_SAP:
+		/* The local SAP is the DSAP of received frames */
+		emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 1);
+		emit(BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x01);
+		emit(BPF_JMP | BPF_JEQ | BPF_K,
+				field == FILTER_LOCAL_SAP ? 3 : 0,
+				field == FILTER_LOCAL_SAP ? 0 : 3,
+				NFC_DIRECTION_RX);
+		/* SSAP */
+		emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 3);
+		emit(BPF_ALU | BPF_AND | BPF_K, 0, 0, 0x3F);
+		emit(BPF_JMP | BPF_JA, 0, 0, 2);
+		/* DSAP */
+		emit(BPF_LD | BPF_B | BPF_ABS, 0, 0, 2);
+		emit(BPF_ALU | BPF_RSH | BPF_K, 0, 0, 2);
+		break;
+
+	case FILTER_FIELD_MAX:
+		break;
+	}
+}
+
+/*
+ * Compares the loaded field against either the allowed or the refused
+ * values, whichever are fewer, and drops the frame on mismatch.
+ */
+static void emit_field(enum filter_field field, guint64 mask)
+{
+	guint64 refused;
+	guint8 val, count, i;
+
+	refused = ~mask;
+	if (field_sizes[field] < 64)
+		refused &= (1ULL << field_sizes[field]) - 1;
+
+	emit_load_field(field);
+
+	if (__builtin_popcountll(mask) <= __builtin_popcountll(refused)) {
+		count = __builtin_popcountll(mask);
+
+		for (i = 0, val = 0; i < count; val++) {
+			if (!(mask & (1ULL << val)))
+				continue;
+
+			/* Match: skip the remaining tests and the drop */
+			emit(BPF_JMP | BPF_JEQ | BPF_K, count - i, 0, val);
+			i++;
+		}
+
+		emit(BPF_RET | BPF_K, 0, 0, 0);
+
+		return;
+	}
+
+	count = __builtin_popcountll(refused);
+
+	for (i = 0, val = 0; i < count; val++) {
+		if (!(refused & (1ULL << val)))
+			continue;
+
+		/* Match: jump over the remaining tests and the skip */
+		emit(BPF_JMP | BPF_JEQ | BPF_K, count - i, 0, val);
+		i++;
+	}
+
+	emit(BPF_JMP | BPF_JA, 0, 0, 1);
+	emit(BPF_RET | BPF_K, 0, 0, 0);
+}
+
+int filter_attach(int sock)
+{
+	struct sock_fprog prog;
+	guint64 full;
+	int field, err;
+
+	/* Nobody would look at SYMM frames */
+	if (!opts.dump_symm && !opts.pcap_filename && !opts.stats &&
+							!opts.summary)
+		field_masks[FILTER_PTYPE] &= ~(1ULL << LLCP_PTYPE_SYMM);
+
+	insn_count = 0;
+
+	/* Too short to hold an LLCP header */
+	emit(BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+	emit(BPF_JMP | BPF_JGE | BPF_K, 1, 0, 4);
+	emit(BPF_RET | BPF_K, 0, 0, 0);
+
+	for (field = 0; field < FILTER_FIELD_MAX; field++) {
+		if (field_sizes[field] < 64)
+			full = (1ULL << field_sizes[field]) - 1;
+		else
+			full = G_MAXUINT64;
+
+		if (!field_masks[field]) {
+			print_error("Filter on %s matches nothing",
+							field_names[field]);
+			return -EINVAL;
+		}
+
+		if (field_masks[field] != full)
+			emit_field(field, field_masks[field]);
+	}
+
+	/* No filtering at all */
+	if (insn_count == 3)
+		return 0;
+
+	emit(BPF_RET | BPF_K, 0, 0, 0xFFFFFFFF);
+
+	if (insn_count > FILTER_MAX_INSNS) {
+		print_error("Filter is too complex");
+		return -E2BIG;
+	}
+
+	prog.len = insn_count;
+	prog.filter = insns;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+							sizeof(prog)) < 0) {
+		err = errno;
+		print_error("Can't attach socket filter: %s", strerror(err));
+		return -err;
+	}
+
+	DBG("%u instructions", insn_count);
+
+	return 0;
+}
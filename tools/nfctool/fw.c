@@ -0,0 +1,330 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include <netlink/genl/genl.h>
+
+#include <near/nfc_copy.h>
+
+#include "nfctool.h"
+#include "adapter.h"
+#include "netlink.h"
+#include "fw.h"
+
+/*
+ * Firmware downloads, possibly to several adapters at once. All the
+ * requests are sent upfront, the kernel runs them in parallel, and we
+ * report progress until the last completion event.
+ *
+ * The kernel does not report how far a download is, only when it is
+ * done: progress is the elapsed time, and the throughput is computed
+ * from the size of the file the kernel loaded.
+ */
+
+#define FW_PROGRESS_INTERVAL	1	/* seconds */
+#define FW_SEARCH_PATH		"/lib/firmware/"
+
+struct fw_job {
+	guint32 adapter_idx;
+	gchar *filename;
+	gint64 size;		/* -1 when unknown */
+
+	gint64 start;		/* monotonic, usec */
+	gint64 end;
+	bool done;
+	int status;
+};
+
+static GSList *fw_jobs;
+static guint fw_pending;
+static guint progress_timer;
+static gint64 fw_start;
+static fw_done_cb_t fw_done;
+
+static void free_job(gpointer data)
+{
+	struct fw_job *job = data;
+
+	g_free(job->filename);
+	g_free(job);
+}
+
+static struct fw_job *fw_find_job(guint32 adapter_idx)
+{
+	struct fw_job *job;
+	GSList *list;
+
+	for (list = fw_jobs; list; list = list->next) {
+		job = list->data;
+
+		if (job->adapter_idx == adapter_idx)
+			return job;
+	}
+
+	return NULL;
+}
+
+int fw_add_job(guint32 adapter_idx, const gchar *fw_filename)
+{
+	struct fw_job *job;
+	struct stat st;
+	gchar *path;
+
+	if (fw_find_job(adapter_idx)) {
+		print_error("nfc%u has more than one firmware", adapter_idx);
+		return -EEXIST;
+	}
+
+	job = g_try_malloc0(sizeof(*job));
+	if (!job)
+		return -ENOMEM;
+
+	job->adapter_idx = adapter_idx;
+	job->filename = g_strdup(fw_filename);
+
+	path = g_strconcat(FW_SEARCH_PATH, fw_filename, NULL);
+	job->size = stat(path, &st) == 0 ? st.st_size : -1;
+	g_free(path);
+
+	fw_jobs = g_slist_append(fw_jobs, job);
+
+	return 0;
+}
+
+/* One "nfcX firmware_name" pair per line, '#' starting comments */
+int fw_load_manifest(const gchar *filename)
+{
+	gchar *content, **lines, **fields, *end;
+	GError *error = NULL;
+	guint32 idx;
+	int i, err = 0;
+
+	if (!g_file_get_contents(filename, &content, NULL, &error)) {
+		print_error("Can't read %s: %s", filename, error->message);
+		g_error_free(error);
+		return -EIO;
+	}
+
+	lines = g_strsplit(content, "\n", -1);
+	g_free(content);
+
+	for (i = 0; lines[i] && !err; i++) {
+		end = strchr(lines[i], '#');
+		if (end)
+			*end = '\0';
+
+		g_strstrip(lines[i]);
+		if (lines[i][0] == '\0')
+			continue;
+
+		fields = g_strsplit_set(lines[i], " \t", 2);
+
+		err = -EINVAL;
+
+		if (fields[0] && fields[1] &&
+				strncmp(fields[0], "nfc", 3) == 0) {
+			idx = strtoul(fields[0] + 3, &end, 10);
+			g_strstrip(fields[1]);
+
+			if (end != fields[0] + 3 && *end == '\0' &&
+							fields[1][0] != '\0')
+				err = fw_add_job(idx, fields[1]);
+		}
+
+		if (err == -EINVAL)
+			print_error("%s:%d: invalid line", filename, i + 1);
+
+		g_strfreev(fields);
+	}
+
+	g_strfreev(lines);
+
+	if (!err && !fw_jobs) {
+		print_error("%s: no firmware to download", filename);
+		err = -EINVAL;
+	}
+
+	return err;
+}
+
+static void fw_print_job(struct fw_job *job)
+{
+	double secs = (job->end - job->start) / 1000000.0;
+
+	printf("nfc%u: %s %s in %.1fs", job->adapter_idx, job->filename,
+		job->status ? strerror(-job->status) : "OK", secs);
+
+	if (!job->status && job->size >= 0 && secs > 0)
+		printf(" (%" G_GINT64_FORMAT " bytes, %.1f kB/s)",
+				job->size, job->size / secs / 1000.0);
+
+	printf("\n");
+}
+
+static void fw_finish(void)
+{
+	struct fw_job *job;
+	GSList *list;
+	guint failed = 0;
+	gint64 end = fw_start;
+
+	if (progress_timer > 0)
+		g_source_remove(progress_timer);
+	progress_timer = 0;
+
+	for (list = fw_jobs; list; list = list->next) {
+		job = list->data;
+
+		if (job->status)
+			failed++;
+
+		end = MAX(end, job->end);
+	}
+
+	printf("\n%u firmware downloads, %u failed, %.1fs total\n",
+			g_slist_length(fw_jobs), failed,
+			(end - fw_start) / 1000000.0);
+
+	if (fw_done)
+		fw_done();
+}
+
+static gboolean fw_progress(gpointer user_data)
+{
+	struct fw_job *job;
+	GSList *list;
+	gint64 now;
+
+	now = g_get_monotonic_time();
+
+	printf("[%.0fs]", (now - fw_start) / 1000000.0);
+
+	for (list = fw_jobs; list; list = list->next) {
+		job = list->data;
+
+		if (job->done)
+			printf(" nfc%u:%s", job->adapter_idx,
+					job->status ? "failed" : "done");
+		else
+			printf(" nfc%u:%.0fs", job->adapter_idx,
+					(now - job->start) / 1000000.0);
+	}
+
+	printf("\n");
+
+	return TRUE;
+}
+
+static int fw_download_cb(guint8 cmd, guint32 adapter_idx, gpointer data)
+{
+	struct nlattr **nl_attr = data;
+	struct fw_job *job;
+
+	job = fw_find_job(adapter_idx);
+	if (!job || job->done)
+		return 0;
+
+	if (nl_attr[NFC_ATTR_FIRMWARE_DOWNLOAD_STATUS])
+		job->status = nla_get_u32(
+				nl_attr[NFC_ATTR_FIRMWARE_DOWNLOAD_STATUS]);
+	else
+		job->status = -ENOTSUP;
+
+	job->end = g_get_monotonic_time();
+	job->done = true;
+
+	fw_print_job(job);
+
+	if (--fw_pending == 0)
+		fw_finish();
+
+	return 0;
+}
+
+int fw_download_start(fw_done_cb_t done_cb)
+{
+	struct nfc_adapter *adapter;
+	struct fw_job *job;
+	GSList *list;
+	int err;
+
+	fw_done = NULL;
+	fw_pending = 0;
+	fw_start = g_get_monotonic_time();
+
+	nl_add_event_handler(NFC_CMD_FW_DOWNLOAD, fw_download_cb);
+
+	for (list = fw_jobs; list; list = list->next) {
+		job = list->data;
+
+		job->start = g_get_monotonic_time();
+
+		adapter = adapter_get(job->adapter_idx);
+		if (adapter)
+			err = nl_fw_download(adapter, job->filename);
+		else
+			err = -ENODEV;
+
+		if (err) {
+			job->status = err;
+			job->end = job->start;
+			job->done = true;
+
+			fw_print_job(job);
+			continue;
+		}
+
+		printf("nfc%u: downloading %s\n", job->adapter_idx,
+							job->filename);
+		fw_pending++;
+	}
+
+	if (!fw_pending) {
+		fw_finish();
+		return -EIO;
+	}
+
+	fw_done = done_cb;
+
+	progress_timer = g_timeout_add_seconds(FW_PROGRESS_INTERVAL,
+							fw_progress, NULL);
+
+	return 0;
+}
+
+void fw_cleanup(void)
+{
+	if (progress_timer > 0)
+		g_source_remove(progress_timer);
+	progress_timer = 0;
+
+	g_slist_free_full(fw_jobs, free_job);
+	fw_jobs = NULL;
+}
@@ -0,0 +1,35 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __FW_H
+#define __FW_H
+
+typedef void (*fw_done_cb_t)(void);
+
+int fw_add_job(guint32 adapter_idx, const gchar *fw_filename);
+
+int fw_load_manifest(const gchar *filename);
+
+int fw_download_start(fw_done_cb_t done_cb);
+
+void fw_cleanup(void);
+
+#endif /* __FW_H */
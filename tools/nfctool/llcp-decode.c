@@ -36,20 +36,6 @@
 /* Raw socket + LLCP headers */
 #define RAW_LLCP_HEADERS_SIZE 4
 
-#define LLCP_PTYPE_SYMM		0
-#define LLCP_PTYPE_PAX		1
-#define LLCP_PTYPE_AGF		2
-#define LLCP_PTYPE_UI		3
-#define LLCP_PTYPE_CONNECT	4
-#define LLCP_PTYPE_DISC		5
-#define LLCP_PTYPE_CC		6
-#define LLCP_PTYPE_DM		7
-#define LLCP_PTYPE_FRMR		8
-#define LLCP_PTYPE_SNL		9
-#define LLCP_PTYPE_I		12
-#define LLCP_PTYPE_RR		13
-#define LLCP_PTYPE_RNR		14
-
 #define LLCP_DM_NORMAL			0x00
 #define LLCP_DM_NO_ACTIVE_CONN		0x01
 #define LLCP_DM_NOT_BOUND		0x02
@@ -59,21 +45,6 @@
 #define LLCP_DM_TMP_SAP_FAILURE		0x20
 #define LLCP_DM_TMP_ALL_SAP_FAILURE	0x21
 
-enum llcp_param_t {
-	LLCP_PARAM_VERSION = 1,
-	LLCP_PARAM_MIUX,
-	LLCP_PARAM_WKS,
-	LLCP_PARAM_LTO,
-	LLCP_PARAM_RW,
-	LLCP_PARAM_SN,
-	LLCP_PARAM_OPT,
-	LLCP_PARAM_SDREQ,
-	LLCP_PARAM_SDRES,
-
-	LLCP_PARAM_MIN = LLCP_PARAM_VERSION,
-	LLCP_PARAM_MAX = LLCP_PARAM_SDRES
-};
-
 static guint8 llcp_param_length[] = {
 	0,
 	1,
@@ -161,6 +132,12 @@ static struct timeval start_timestamp;
 
 static GHashTable *connection_hash;
 
+static guint8 *agf_pdu;
+static gsize agf_pdu_size;
+
+static GString *json_line;
+static int json_agf_index;
+
 /* We associate an SN from a CONNECT to its sender */
 static void llcp_add_connection_sn(struct sniffer_packet *packet, gchar *sn)
 {
@@ -295,8 +272,8 @@ static void llcp_print_params(struct sniffer_packet *packet)
 	}
 }
 
-static int llcp_decode_packet(guint8 *data, guint32 data_len,
-			      struct sniffer_packet *packet)
+int llcp_decode_packet(guint8 *data, guint32 data_len,
+			struct sniffer_packet *packet)
 {
 	if (data_len < RAW_LLCP_HEADERS_SIZE)
 		return -EINVAL;
@@ -339,6 +316,45 @@ static int llcp_decode_packet(guint8 *data, guint32 data_len,
 	return 0;
 }
 
+/*
+ * Calls cb for each PDU of an AGF, with the raw socket header of the
+ * AGF itself prepended. The PDU buffer is reused across calls.
+ */
+int llcp_decode_agf(struct sniffer_packet *packet, llcp_pdu_cb cb,
+							gpointer user_data)
+{
+	guint8 *data = packet->llcp.data;
+	guint32 len = packet->llcp.data_len;
+	guint32 offset = 0, size;
+
+	/* AGFs can't be nested */
+	if (agf_pdu && data >= agf_pdu && data < agf_pdu + agf_pdu_size)
+		return -EINVAL;
+
+	while (offset + 2 <= len) {
+		size = (data[offset] << 8) | data[offset + 1];
+		offset += 2;
+
+		if (size == 0 || offset + size > len)
+			return -EINVAL;
+
+		if (size + NFC_RAW_HEADER_SIZE > agf_pdu_size) {
+			agf_pdu_size = size + NFC_RAW_HEADER_SIZE;
+			agf_pdu = g_realloc(agf_pdu, agf_pdu_size);
+		}
+
+		agf_pdu[0] = packet->adapter_idx;
+		agf_pdu[1] = packet->direction;
+		memcpy(agf_pdu + NFC_RAW_HEADER_SIZE, data + offset, size);
+
+		offset += size;
+
+		cb(agf_pdu, size + NFC_RAW_HEADER_SIZE, user_data);
+	}
+
+	return 0;
+}
+
 static void llcp_print_sequence(struct sniffer_packet *packet)
 {
 	llcp_printf_msg("N(S):%d N(R):%d",
@@ -509,6 +525,82 @@ static int llcp_print_frmr(struct sniffer_packet *packet)
 	return 0;
 }
 
+const char *llcp_ptype_name(guint8 ptype)
+{
+	if (ptype >= ARRAY_SIZE(llcp_ptype_short_str) ||
+					!llcp_ptype_short_str[ptype])
+		return "reserved";
+
+	return llcp_ptype_short_str[ptype];
+}
+
+static void llcp_json_pdu(guint8 *data, guint32 len, gpointer user_data);
+
+/*
+ * JSON Lines output: one object per PDU, AGFs being expanded into one
+ * line per aggregated PDU. Lines are formatted in a buffer that is
+ * only ever grown.
+ */
+static int llcp_print_json(guint8 *data, guint32 data_len,
+				struct timeval *timestamp, int agf_index)
+{
+	struct sniffer_packet packet;
+	guint32 output_len;
+	int err;
+
+	err = llcp_decode_packet(data, data_len, &packet);
+	if (err)
+		return err;
+
+	if (!opts.dump_symm && packet.llcp.ptype == LLCP_PTYPE_SYMM)
+		return 0;
+
+	if (packet.llcp.ptype == LLCP_PTYPE_AGF && agf_index < 0)
+		return llcp_decode_agf(&packet, llcp_json_pdu, timestamp);
+
+	if (!json_line)
+		json_line = g_string_sized_new(1024);
+
+	g_string_printf(json_line, "{\"ts\":%ld.%06ld,\"adapter\":%u,"
+			"\"dir\":\"%s\",\"local\":%u,\"remote\":%u,"
+			"\"ptype\":\"%s\"", (long) timestamp->tv_sec,
+			(long) timestamp->tv_usec, packet.adapter_idx,
+			packet.direction == NFC_DIRECTION_RX ? "rx" : "tx",
+			packet.llcp.local_sap, packet.llcp.remote_sap,
+			llcp_ptype_name(packet.llcp.ptype));
+
+	if (agf_index >= 0)
+		g_string_append_printf(json_line, ",\"agf\":%d", agf_index);
+
+	if (packet.llcp.ptype >= LLCP_PTYPE_I)
+		g_string_append_printf(json_line, ",\"ns\":%u,\"nr\":%u",
+						packet.llcp.send_seq,
+						packet.llcp.recv_seq);
+
+	output_len = packet.llcp.data_len;
+	if (opts.snap_len && output_len > opts.snap_len)
+		output_len = opts.snap_len;
+
+	g_string_append_printf(json_line, ",\"len\":%u,\"data\":\"",
+						packet.llcp.data_len);
+
+	/* Hex digits are written straight into the line */
+	g_string_set_size(json_line, json_line->len + 2 * output_len);
+	sniffer_hex_encode(json_line->str + json_line->len - 2 * output_len,
+					packet.llcp.data, output_len);
+
+	g_string_append(json_line, "\"}\n");
+
+	fwrite(json_line->str, 1, json_line->len, stdout);
+
+	return 0;
+}
+
+static void llcp_json_pdu(guint8 *data, guint32 len, gpointer user_data)
+{
+	llcp_print_json(data, len, user_data, json_agf_index++);
+}
+
 int llcp_print_pdu(guint8 *data, guint32 data_len, struct timeval *timestamp)
 {
 	struct timeval msg_timestamp;
@@ -520,6 +612,12 @@ int llcp_print_pdu(guint8 *data, guint32 data_len, struct timeval *timestamp)
 	if (!timestamp)
 		return -EINVAL;
 
+	if (opts.json) {
+		json_agf_index = 0;
+
+		return llcp_print_json(data, data_len, timestamp, -1);
+	}
+
 	if (!timerisset(&start_timestamp))
 		start_timestamp = *timestamp;
 
@@ -614,6 +712,15 @@ void llcp_decode_cleanup(void)
 
 	if (connection_hash)
 		g_hash_table_destroy(connection_hash);
+	connection_hash = NULL;
+
+	g_free(agf_pdu);
+	agf_pdu = NULL;
+	agf_pdu_size = 0;
+
+	if (json_line)
+		g_string_free(json_line, TRUE);
+	json_line = NULL;
 }
 
 int llcp_decode_init(void)
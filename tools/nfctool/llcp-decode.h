@@ -21,10 +21,49 @@
 #ifndef __LLCP_DECODE_H
 #define __LLCP_DECODE_H
 
+#define LLCP_PTYPE_SYMM		0
+#define LLCP_PTYPE_PAX		1
+#define LLCP_PTYPE_AGF		2
+#define LLCP_PTYPE_UI		3
+#define LLCP_PTYPE_CONNECT	4
+#define LLCP_PTYPE_DISC		5
+#define LLCP_PTYPE_CC		6
+#define LLCP_PTYPE_DM		7
+#define LLCP_PTYPE_FRMR		8
+#define LLCP_PTYPE_SNL		9
+#define LLCP_PTYPE_I		12
+#define LLCP_PTYPE_RR		13
+#define LLCP_PTYPE_RNR		14
+
+enum llcp_param_t {
+	LLCP_PARAM_VERSION = 1,
+	LLCP_PARAM_MIUX,
+	LLCP_PARAM_WKS,
+	LLCP_PARAM_LTO,
+	LLCP_PARAM_RW,
+	LLCP_PARAM_SN,
+	LLCP_PARAM_OPT,
+	LLCP_PARAM_SDREQ,
+	LLCP_PARAM_SDRES,
+
+	LLCP_PARAM_MIN = LLCP_PARAM_VERSION,
+	LLCP_PARAM_MAX = LLCP_PARAM_SDRES
+};
+
+typedef void (*llcp_pdu_cb)(guint8 *data, guint32 len, gpointer user_data);
+
 int llcp_decode_init(void);
 
 void llcp_decode_cleanup(void);
 
 int llcp_print_pdu(guint8 *buffer, guint32 len, struct timeval *timestamp);
 
+int llcp_decode_packet(guint8 *data, guint32 data_len,
+			struct sniffer_packet *packet);
+
+int llcp_decode_agf(struct sniffer_packet *packet, llcp_pdu_cb cb,
+							gpointer user_data);
+
+const char *llcp_ptype_name(guint8 ptype);
+
 #endif /* __LLCP_DECODE_H */
@@ -38,6 +38,11 @@
 #include "adapter.h"
 #include "netlink.h"
 #include "sniffer.h"
+#include "summary.h"
+#include "replay.h"
+#include "filter.h"
+#include "bench.h"
+#include "fw.h"
 
 #define LLCP_MAX_LTO  0xff
 #define LLCP_MAX_RW   0x0f
@@ -45,6 +50,8 @@
 
 static GMainLoop *main_loop = NULL;
 
+static char output_buffer[64 * 1024];
+
 static int nfctool_poll_cb(guint8 cmd, guint32 idx, gpointer data);
 static int nfctool_snl_cb(guint8 cmd, guint32 idx, gpointer data);
 
@@ -154,47 +161,28 @@ static int nfctool_set_powered(bool powered)
 	return err;
 }
 
-static int nfctool_fw_download_cb(guint8 cmd, guint32 adapter_idx,
-				  gpointer data)
+static void nfctool_fw_download_done(void)
 {
-	int err;
-	gchar *fw_filename;
-	struct nlattr **nl_attr = data;
-
-	if (nl_attr[NFC_ATTR_FIRMWARE_DOWNLOAD_STATUS] != NULL)
-		err = nla_get_u32(nl_attr[NFC_ATTR_FIRMWARE_DOWNLOAD_STATUS]);
-	else
-		err = -ENOTSUP;
-
-	if (nl_attr[NFC_ATTR_FIRMWARE_NAME] != NULL)
-		fw_filename = nla_get_string(nl_attr[NFC_ATTR_FIRMWARE_NAME]);
-	else
-		fw_filename = "UNKNOWN";
-
-	printf("Firmware download operation for %s terminated with status %s\n",
-	       fw_filename, err ? strerror(-err) : "OK");
-
 	nfctool_quit(false);
-
-	return 0;
 }
 
-static int nfctool_fw_download(gchar *fw_filename)
+static int nfctool_fw_download(void)
 {
-	struct nfc_adapter *adapter;
 	int err;
 
-	adapter = adapter_get(opts.adapter_idx);
-	if (!adapter)
-		return -ENODEV;
-
-	nl_add_event_handler(NFC_CMD_FW_DOWNLOAD, nfctool_fw_download_cb);
+	if (opts.fw_filename) {
+		err = fw_add_job(opts.adapter_idx, opts.fw_filename);
+		if (err)
+			return err;
+	}
 
-	err = nl_fw_download(adapter, fw_filename);
-	if (err)
-		print_error("Firmware download failed: %s", strerror(-err));
+	if (opts.fw_manifest) {
+		err = fw_load_manifest(opts.fw_manifest);
+		if (err)
+			return err;
+	}
 
-	return err;
+	return fw_download_start(nfctool_fw_download_done);
 }
 
 static int nfctool_dep_link_up_cb(guint8 cmd, guint32 idx, gpointer data)
@@ -289,6 +277,18 @@ static int nfctool_targets_found(guint32 adapter_idx)
 	adpater_print_targets(adapter, "  ");
 	printf("\n");
 
+	if (opts.bench_script) {
+		if (!adapter->tags) {
+			print_error("No tag to run the benchmark on");
+			err = -ENODEV;
+			goto exit;
+		}
+
+		err = bench_run(adapter_idx,
+				GPOINTER_TO_INT(adapter->tags->data));
+		goto exit;
+	}
+
 	if (adapter->polling) {
 		g_slist_foreach(adapter->devices,
 				(GFunc)nfctool_send_dep_link_up,
@@ -419,6 +419,13 @@ struct nfctool_options opts = {
 	.show_timestamp = SNIFFER_SHOW_TIMESTAMP_NONE,
 	.snep_sap = 0x04,
 	.pcap_filename = NULL,
+	.capture_only = FALSE,
+	.read_pcap_filename = NULL,
+	.summary = 0,
+	.stats = FALSE,
+	.json = FALSE,
+	.bench_script = NULL,
+	.bench_count = 100,
 };
 
 static bool opt_parse_poll_arg(const gchar *option_name, const gchar *value,
@@ -542,6 +549,47 @@ static bool opt_parse_snl_arg(const gchar *option_name, const gchar *value,
 	return true;
 }
 
+static bool opt_parse_summary_arg(const gchar *option_name,
+				  const gchar *value,
+				  gpointer data, GError **error)
+{
+	gchar **modes;
+	bool result = true;
+	int i;
+
+	if (!value) {
+		opts.summary = SUMMARY_ALL;
+		return true;
+	}
+
+	modes = g_strsplit(value, ",", -1);
+
+	for (i = 0; modes[i]; i++) {
+		if (g_ascii_strcasecmp(modes[i], "sap") == 0) {
+			opts.summary |= SUMMARY_SAP;
+		} else if (g_ascii_strcasecmp(modes[i], "snep") == 0) {
+			opts.summary |= SUMMARY_SNEP;
+		} else if (g_ascii_strcasecmp(modes[i], "frag") == 0) {
+			opts.summary |= SUMMARY_FRAG;
+		} else {
+			print_error("Unknown summary mode: %s", modes[i]);
+			result = false;
+			break;
+		}
+	}
+
+	g_strfreev(modes);
+
+	return result;
+}
+
+static bool opt_parse_filter_arg(const gchar *option_name,
+				 const gchar *value,
+				 gpointer data, GError **error)
+{
+	return filter_parse(value) == 0;
+}
+
 static GOptionEntry option_entries[] = {
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &opts.show_version,
 	  "show version information and exit" },
@@ -558,6 +606,9 @@ static GOptionEntry option_entries[] = {
 	  "disable device", NULL },
 	{ "fw-download", 'w', 0, G_OPTION_ARG_STRING, &opts.fw_filename,
 	  "Put the device in firmware download mode", "fw_filename" },
+	{ "fw-manifest", 'W', 0, G_OPTION_ARG_STRING, &opts.fw_manifest,
+	  "Download firmwares to several devices in parallel, from a file "
+	  "of \"nfcX fw_filename\" lines", "manifest" },
 	{ "set-param", 's', 0, G_OPTION_ARG_CALLBACK, opt_parse_set_param_arg,
 	  "set lto, rw, and/or miux parameters", "lto=150,rw=1,miux=100" },
 	{ "snl", 'k', 0, G_OPTION_ARG_CALLBACK, &opt_parse_snl_arg,
@@ -579,6 +630,30 @@ static GOptionEntry option_entries[] = {
 	{ "pcap-file", 'f', 0, G_OPTION_ARG_STRING, &opts.pcap_filename,
 	  "specify a filename to save traffic in pcap format; "
 	  "only relevant with -n", "filename" },
+	{ "capture-only", 'c', 0, G_OPTION_ARG_NONE, &opts.capture_only,
+	  "save traffic to the -f file in pcapng format without decoding "
+	  "it; only relevant with -n", NULL },
+	{ "read-pcap", 'r', 0, G_OPTION_ARG_STRING, &opts.read_pcap_filename,
+	  "decode traffic from a pcap or pcapng capture file", "filename" },
+	{ "summary", 'm', G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK,
+	  opt_parse_summary_arg, "print traffic statistics instead of "
+	  "decoding each packet; only relevant with -n or -r",
+	  "[sap,snep,frag]" },
+	{ "stats", 'S', 0, G_OPTION_ARG_NONE, &opts.stats,
+	  "print per connection latency and throughput statistics; "
+	  "only relevant with -n or -r", NULL },
+	{ "filter", 'F', 0, G_OPTION_ARG_CALLBACK, opt_parse_filter_arg,
+	  "only capture the frames matching all the comma separated terms: "
+	  "nosymm, dir, ptype, lsap or rsap, followed by = or != and values "
+	  "separated by |; only relevant with -n", "ptype!=symm,lsap=4|0x10" },
+	{ "bench-tag", 'b', 0, G_OPTION_ARG_STRING, &opts.bench_script,
+	  "poll, then run the tag commands from a script file on the first "
+	  "tag found and report round trip times", "script" },
+	{ "bench-count", 'i', 0, G_OPTION_ARG_INT, &opts.bench_count,
+	  "number of times the script is run; only relevant with -b", "100" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &opts.json,
+	  "print packets as JSON Lines, one object per LLCP PDU; "
+	  "only relevant with -n or -r", NULL },
 	{ NULL }
 };
 
@@ -624,6 +699,11 @@ static int nfctool_options_parse(int argc, char **argv)
 		}
 	}
 
+	if (opts.bench_script) {
+		opts.poll = true;
+		opts.poll_mode = POLLING_MODE_INITIATOR;
+	}
+
 	if (opts.enable_dev || opts.disable_dev)
 		opts.list = true;
 
@@ -631,9 +711,9 @@ static int nfctool_options_parse(int argc, char **argv)
 		opts.enable_dev = true;
 
 	opts.need_netlink = opts.list || opts.poll || opts.set_param ||
-			    opts.snl || opts.fw_filename;
+			    opts.snl || opts.fw_filename || opts.fw_manifest;
 
-	if (!opts.need_netlink && !opts.sniff) {
+	if (!opts.need_netlink && !opts.sniff && !opts.read_pcap_filename) {
 		printf("%s", g_option_context_get_help(context, TRUE, NULL));
 
 		goto exit;
@@ -647,6 +727,30 @@ static int nfctool_options_parse(int argc, char **argv)
 		goto exit;
 	}
 
+	if (opts.capture_only && (!opts.sniff || !opts.pcap_filename)) {
+		print_error("Capture only mode needs -n and -f options");
+
+		goto exit;
+	}
+
+	if (opts.bench_script && opts.bench_count <= 0) {
+		print_error("Invalid benchmark count %d", opts.bench_count);
+
+		goto exit;
+	}
+
+	if (opts.json && opts.summary) {
+		print_error("-j and --summary can't be combined");
+
+		goto exit;
+	}
+
+	if (opts.read_pcap_filename && (opts.sniff || opts.need_netlink)) {
+		print_error("-r can't be combined with device options");
+
+		goto exit;
+	}
+
 done:
 	err = 0;
 
@@ -678,9 +782,18 @@ static void nfctool_options_cleanup(void)
 	if (opts.pcap_filename)
 		g_free(opts.pcap_filename);
 
+	if (opts.read_pcap_filename)
+		g_free(opts.read_pcap_filename);
+
+	if (opts.bench_script)
+		g_free(opts.bench_script);
+
 	if (opts.fw_filename != NULL)
 		g_free(opts.fw_filename);
 
+	if (opts.fw_manifest)
+		g_free(opts.fw_manifest);
+
 	g_slist_free_full(opts.snl_list, g_free);
 }
 
@@ -707,6 +820,28 @@ int main(int argc, char **argv)
 	if (opts.show_version)
 		goto done;
 
+	/*
+	 * Decoders print field by field, let them fill one large buffer
+	 * which the sniffer flushes once per packet.
+	 */
+	if (opts.read_pcap_filename ||
+			(opts.sniff && !opts.need_netlink && !opts.capture_only))
+		setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+	if (opts.read_pcap_filename) {
+		err = replay_run();
+		if (err)
+			goto exit_err;
+
+		goto done;
+	}
+
+	if (opts.bench_script) {
+		err = bench_init(opts.bench_script);
+		if (err)
+			goto exit_err;
+	}
+
 	adapter_init();
 
 	if (opts.need_netlink) {
@@ -719,8 +854,8 @@ int main(int argc, char **argv)
 			goto exit_err;
 	}
 
-	if (opts.fw_filename) {
-		err = nfctool_fw_download(opts.fw_filename);
+	if (opts.fw_filename || opts.fw_manifest) {
+		err = nfctool_fw_download();
 		if (err)
 			goto exit_err;
 
@@ -765,7 +900,8 @@ int main(int argc, char **argv)
 		nfctool_snl();
 
 start_loop:
-	if (opts.poll || opts.sniff || opts.snl || opts.fw_filename)
+	if (opts.poll || opts.sniff || opts.snl || opts.fw_filename ||
+							opts.fw_manifest)
 		nfctool_main_loop_start();
 
 done:
@@ -780,6 +916,10 @@ exit_err:
 
 	sniffer_cleanup();
 
+	bench_cleanup();
+
+	fw_cleanup();
+
 	nfctool_options_cleanup();
 
 	if (err)
@@ -68,6 +68,7 @@ struct nfctool_options {
 	gboolean enable_dev;
 	gboolean disable_dev;
 	gchar *fw_filename;
+	gchar *fw_manifest;
 	gboolean set_param;
 	gint32 lto;
 	gint32 rw;
@@ -82,6 +83,13 @@ struct nfctool_options {
 	guint8 snep_sap;
 	guint8 handover_sap;
 	gchar *pcap_filename;
+	gboolean capture_only;
+	gchar *read_pcap_filename;
+	guint8 summary;
+	gboolean stats;
+	gboolean json;
+	gchar *bench_script;
+	gint32 bench_count;
 };
 
 struct nfc_snl {
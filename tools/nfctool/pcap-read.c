@@ -0,0 +1,291 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "nfctool.h"
+#include "capture.h"
+#include "pcap-read.h"
+
+/*
+ * Capture file reader. The file is mapped and walked in place, both
+ * the pcap files written by -f and the pcapng files written by -c are
+ * supported, in either byte order.
+ */
+
+#define PCAP_MAGIC_USEC		0xa1b2c3d4
+#define PCAP_MAGIC_NSEC		0xa1b23c4d
+#define PCAP_HEADER_LEN		24
+#define PCAP_RECORD_LEN		16
+
+#define PCAPNG_BLOCK_SPB	0x00000003
+#define PCAPNG_MAX_INTERFACES	16
+
+#define LINKTYPE_NFC_LLCP	0xF5
+
+#define NSEC_PER_SEC		1000000000ULL
+
+struct pcap_interface {
+	guint16 linktype;
+	guint64 units;		/* timestamp units per second */
+};
+
+static guint32 get32(const guint8 *ptr, bool swap)
+{
+	guint32 val;
+
+	memcpy(&val, ptr, 4);
+
+	return swap ? GUINT32_SWAP_LE_BE(val) : val;
+}
+
+static guint16 get16(const guint8 *ptr, bool swap)
+{
+	guint16 val;
+
+	memcpy(&val, ptr, 2);
+
+	return swap ? GUINT16_SWAP_LE_BE(val) : val;
+}
+
+static guint64 to_nsec(guint64 ts, guint64 units)
+{
+	if (units == NSEC_PER_SEC)
+		return ts;
+
+	return (ts / units) * NSEC_PER_SEC +
+			(guint64) ((double) (ts % units) * NSEC_PER_SEC / units);
+}
+
+static int pcap_read(guint8 *map, gsize size, pcap_packet_cb cb)
+{
+	guint32 magic, incl_len, sec, frac;
+	guint64 units;
+	gsize offset;
+	bool swap;
+
+	magic = get32(map, false);
+
+	switch (magic) {
+	case PCAP_MAGIC_USEC:
+	case PCAP_MAGIC_NSEC:
+		swap = false;
+		break;
+	default:
+		swap = true;
+		magic = GUINT32_SWAP_LE_BE(magic);
+
+		if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC)
+			break;
+
+		print_error("Not a capture file");
+		return -EINVAL;
+	}
+
+	units = magic == PCAP_MAGIC_NSEC ? NSEC_PER_SEC : 1000000;
+
+	if (get32(map + 20, swap) != LINKTYPE_NFC_LLCP) {
+		print_error("Unsupported link type %u", get32(map + 20, swap));
+		return -EINVAL;
+	}
+
+	offset = PCAP_HEADER_LEN;
+
+	while (offset + PCAP_RECORD_LEN <= size) {
+		sec = get32(map + offset, swap);
+		frac = get32(map + offset + 4, swap);
+		incl_len = get32(map + offset + 8, swap);
+
+		if (incl_len > size - offset - PCAP_RECORD_LEN) {
+			print_error("Truncated record at offset %zu", offset);
+			break;
+		}
+
+		cb(map + offset + PCAP_RECORD_LEN, incl_len,
+				(guint64) sec * NSEC_PER_SEC +
+				(guint64) frac * (NSEC_PER_SEC / units));
+
+		offset += PCAP_RECORD_LEN + incl_len;
+	}
+
+	return 0;
+}
+
+static void pcapng_parse_idb(guint8 *block, guint32 len, bool swap,
+					struct pcap_interface *iface)
+{
+	guint16 code, opt_len;
+	guint32 offset;
+	guint8 tsresol;
+
+	iface->linktype = get16(block + 8, swap);
+	iface->units = 1000000;
+
+	/* Options, between the fixed fields and the trailing length */
+	for (offset = 16; offset + 4 <= len - 4;
+				offset += 4 + ((opt_len + 3) & ~3)) {
+		code = get16(block + offset, swap);
+		opt_len = get16(block + offset + 2, swap);
+
+		if (code == PCAPNG_OPT_END)
+			break;
+
+		if (code != PCAPNG_OPT_IF_TSRESOL || opt_len != 1)
+			continue;
+
+		tsresol = block[offset + 4];
+
+		if (tsresol & 0x80)
+			iface->units = 1ULL << MIN(tsresol & 0x7f, 63);
+		else
+			for (iface->units = 1; tsresol > 0; tsresol--)
+				iface->units *= 10;
+	}
+}
+
+static int pcapng_read(guint8 *map, gsize size, pcap_packet_cb cb,
+							guint64 *skipped)
+{
+	struct pcap_interface ifaces[PCAPNG_MAX_INTERFACES];
+	guint32 type, len, iface_id, caplen;
+	guint n_ifaces = 0;
+	guint64 ts;
+	gsize offset = 0;
+	bool swap = false;
+
+	while (offset + 12 <= size) {
+		type = get32(map + offset, swap);
+
+		/* New section, with its own byte order and interfaces */
+		if (type == PCAPNG_BLOCK_SHB) {
+			swap = get32(map + offset + 8, false) !=
+						PCAPNG_BYTE_ORDER_MAGIC;
+			n_ifaces = 0;
+		}
+
+		len = get32(map + offset + 4, swap);
+		if (len < 12 || len % 4 || len > size - offset) {
+			print_error("Invalid block at offset %zu", offset);
+			break;
+		}
+
+		switch (type) {
+		case PCAPNG_BLOCK_IDB:
+			if (len < 20 || n_ifaces == PCAPNG_MAX_INTERFACES)
+				break;
+
+			pcapng_parse_idb(map + offset, len, swap,
+							&ifaces[n_ifaces++]);
+			break;
+
+		case PCAPNG_BLOCK_EPB:
+			if (len < 32)
+				break;
+
+			iface_id = get32(map + offset + 8, swap);
+			caplen = get32(map + offset + 20, swap);
+
+			if (iface_id >= n_ifaces || caplen > len - 32 ||
+				ifaces[iface_id].linktype != LINKTYPE_NFC_LLCP) {
+				(*skipped)++;
+				break;
+			}
+
+			ts = (guint64) get32(map + offset + 12, swap) << 32 |
+					get32(map + offset + 16, swap);
+
+			cb(map + offset + 28, caplen,
+					to_nsec(ts, ifaces[iface_id].units));
+			break;
+
+		case PCAPNG_BLOCK_SPB:
+			/* No timestamp, nor interface id: the first one */
+			if (!n_ifaces ||
+				ifaces[0].linktype != LINKTYPE_NFC_LLCP) {
+				(*skipped)++;
+				break;
+			}
+
+			caplen = MIN(get32(map + offset + 8, swap), len - 16);
+
+			cb(map + offset + 12, caplen, 0);
+			break;
+		}
+
+		offset += len;
+	}
+
+	return 0;
+}
+
+int pcap_read_file(const char *filename, pcap_packet_cb cb,
+						guint64 *skipped)
+{
+	struct stat st;
+	guint8 *map;
+	int fd, err;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		err = errno;
+		print_error("Can't open file %s: %s", filename, strerror(err));
+		return -err;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	if (st.st_size < PCAP_HEADER_LEN) {
+		print_error("%s is not a capture file", filename);
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	err = -errno;
+
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return err;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	if (get32(map, false) == PCAPNG_BLOCK_SHB)
+		err = pcapng_read(map, st.st_size, cb, skipped);
+	else
+		err = pcap_read(map, st.st_size, cb);
+
+	munmap(map, st.st_size);
+
+	return err;
+}
@@ -0,0 +1,35 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __PCAP_READ_H
+#define __PCAP_READ_H
+
+/* Timestamps are in nanoseconds since the Epoch */
+typedef void (*pcap_packet_cb)(guint8 *data, guint32 len, guint64 timestamp);
+
+/*
+ * Call cb for each LLCP packet of a capture file. Packets of other link
+ * types are counted in skipped.
+ */
+int pcap_read_file(const char *filename, pcap_packet_cb cb,
+						guint64 *skipped);
+
+#endif /* __PCAP_READ_H */
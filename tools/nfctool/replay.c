@@ -0,0 +1,103 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/time.h>
+#include <glib.h>
+
+#include "nfctool.h"
+#include "sniffer.h"
+#include "llcp-decode.h"
+#include "pcap-read.h"
+#include "summary.h"
+#include "stats.h"
+#include "replay.h"
+
+/* Offline decoding of sniffer captures, see pcap-read.c */
+
+#define NSEC_PER_SEC		1000000000ULL
+
+static guint64 replay_packets;
+static guint64 replay_skipped;
+
+static void replay_packet(guint8 *data, guint32 len, guint64 timestamp)
+{
+	struct timeval tv;
+
+	replay_packets++;
+
+	if (opts.stats)
+		stats_packet(data, len, timestamp);
+
+	if (opts.summary) {
+		summary_packet(data, len, timestamp);
+		return;
+	}
+
+	tv.tv_sec = timestamp / NSEC_PER_SEC;
+	tv.tv_usec = (timestamp % NSEC_PER_SEC) / 1000;
+
+	llcp_print_pdu(data, len, &tv);
+}
+
+int replay_run(void)
+{
+	int err;
+
+	replay_packets = 0;
+	replay_skipped = 0;
+
+	if (opts.summary)
+		err = summary_init();
+	else
+		err = llcp_decode_init();
+	if (err)
+		return err;
+
+	if (opts.stats) {
+		err = stats_init();
+		if (err)
+			return err;
+	}
+
+	err = pcap_read_file(opts.read_pcap_filename, replay_packet,
+							&replay_skipped);
+	if (err)
+		return err;
+
+	if (opts.summary) {
+		summary_print(stdout);
+		summary_cleanup();
+	}
+
+	if (opts.stats) {
+		stats_print(stdout);
+		stats_cleanup();
+	}
+
+	printf("%" G_GUINT64_FORMAT " packets read", replay_packets);
+	if (replay_skipped)
+		printf(", %" G_GUINT64_FORMAT " skipped", replay_skipped);
+	printf("\n");
+
+	return 0;
+}
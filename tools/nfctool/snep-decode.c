@@ -32,22 +32,6 @@
 #include "ndef-decode.h"
 #include "snep-decode.h"
 
-#define SNEP_HEADER_LEN 6
-
-#define SNEP_REQUEST_CONTINUE	0x00
-#define SNEP_REQUEST_GET	0x01
-#define SNEP_REQUEST_PUT	0x02
-#define SNEP_REQUEST_REJECT	0x7f
-
-#define SNEP_RESPONSE_CONTINUE		0x80
-#define SNEP_RESPONSE_SUCCESS		0x81
-#define SNEP_RESPONSE_NOT_FOUND		0xc0
-#define SNEP_RESPONSE_EXCESS_DATA	0xc1
-#define SNEP_RESPONSE_BAD_REQUEST	0xc2
-#define SNEP_RESPONSE_NOT_IMPLEMENTED	0xe0
-#define SNEP_RESPONSE_UNSUPPORTED	0xe1
-#define SNEP_RESPONSE_REJECT		0xff
-
 #define snep_make_frag_index(idx, dir, lsap, rsap) \
 				((((idx) << 24) & 0xFF000000) |	\
 				(((dir)  << 16) & 0x00FF0000) |	\
@@ -368,6 +352,7 @@ void snep_decode_cleanup(void)
 {
 	if (snep_frag_hash)
 		g_hash_table_destroy(snep_frag_hash);
+	snep_frag_hash = NULL;
 }
 
 int snep_decode_init(void)
@@ -21,6 +21,22 @@
 #ifndef __SNEP_DECODE_H
 #define __SNEP_DECODE_H
 
+#define SNEP_HEADER_LEN 6
+
+#define SNEP_REQUEST_CONTINUE	0x00
+#define SNEP_REQUEST_GET	0x01
+#define SNEP_REQUEST_PUT	0x02
+#define SNEP_REQUEST_REJECT	0x7f
+
+#define SNEP_RESPONSE_CONTINUE		0x80
+#define SNEP_RESPONSE_SUCCESS		0x81
+#define SNEP_RESPONSE_NOT_FOUND		0xc0
+#define SNEP_RESPONSE_EXCESS_DATA	0xc1
+#define SNEP_RESPONSE_BAD_REQUEST	0xc2
+#define SNEP_RESPONSE_NOT_IMPLEMENTED	0xe0
+#define SNEP_RESPONSE_UNSUPPORTED	0xe1
+#define SNEP_RESPONSE_REJECT		0xff
+
 int snep_decode_init(void);
 
 void snep_decode_cleanup(void);
@@ -0,0 +1,141 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <glib.h>
+
+#include <near/nfc_copy.h>
+
+#include "sniffer.h"
+#include "snep-decode.h"
+#include "snep-track.h"
+
+/*
+ * SNEP message reassembly and request/response matching, shared by
+ * the summary and the per connection statistics. Only headers are
+ * looked at, payloads are skipped by length.
+ */
+
+static void snep_track_message(struct snep_track *track, guint8 code,
+					guint64 start, guint64 timestamp,
+					struct snep_track_event *event)
+{
+	if (code < SNEP_RESPONSE_CONTINUE) {
+		track->pending = true;
+		track->req_code = code;
+		track->req_start = start;
+		track->req_done = timestamp;
+
+		return;
+	}
+
+	if (!track->pending)
+		return;
+
+	track->pending = false;
+
+	event->flags |= SNEP_TRACK_RESPONSE;
+	event->req_code = track->req_code;
+	event->rsp_code = code;
+	event->req_start = track->req_start;
+	event->req_done = track->req_done;
+}
+
+void snep_track_packet(struct snep_track *track,
+				struct sniffer_packet *packet,
+				guint64 timestamp,
+				struct snep_track_event *event)
+{
+	struct snep_track_frag *frag = &track->frag[packet->direction];
+	guint8 *data = packet->llcp.data;
+	guint32 len = packet->llcp.data_len;
+	guint32 msg_len;
+	guint8 code;
+
+	memset(event, 0, sizeof(*event));
+
+	/* Continuation of a fragmented message */
+	if (frag->remaining) {
+		event->flags |= SNEP_TRACK_FRAGMENT;
+
+		frag->remaining -= MIN(len, frag->remaining);
+		if (frag->remaining)
+			return;
+
+		event->flags |= SNEP_TRACK_FRAG_DONE;
+		snep_track_message(track, frag->code, frag->start, timestamp,
+									event);
+
+		return;
+	}
+
+	if (len < SNEP_HEADER_LEN) {
+		event->flags |= SNEP_TRACK_INVALID;
+		return;
+	}
+
+	code = data[1];
+	msg_len = data[2] << 24 | data[3] << 16 | data[4] << 8 | data[5];
+
+	switch (code) {
+	case SNEP_REQUEST_CONTINUE:
+	case SNEP_RESPONSE_CONTINUE:
+		return;
+
+	case SNEP_REQUEST_REJECT:
+	case SNEP_RESPONSE_REJECT:
+		/* The peer gave up on the message it was sending us */
+		frag = &track->frag[!packet->direction];
+		if (frag->remaining) {
+			frag->remaining = 0;
+
+			event->flags |= SNEP_TRACK_FRAG_ABORT;
+			event->frag_code = frag->code;
+		}
+
+		if (code == SNEP_RESPONSE_REJECT)
+			snep_track_message(track, code, timestamp, timestamp,
+									event);
+		else
+			track->pending = false;
+
+		return;
+	}
+
+	/* A new request supersedes an unanswered one */
+	if (code < SNEP_RESPONSE_CONTINUE)
+		track->pending = false;
+
+	if (msg_len > len - SNEP_HEADER_LEN) {
+		frag->remaining = msg_len - (len - SNEP_HEADER_LEN);
+		frag->code = code;
+		frag->start = timestamp;
+
+		event->flags |= SNEP_TRACK_FRAGMENT | SNEP_TRACK_FRAG_START;
+
+		return;
+	}
+
+	snep_track_message(track, code, timestamp, timestamp, event);
+}
@@ -0,0 +1,68 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SNEP_TRACK_H
+#define __SNEP_TRACK_H
+
+/* Flags reported by snep_track_packet() */
+#define SNEP_TRACK_INVALID	0x01	/* Too short for a SNEP header */
+#define SNEP_TRACK_FRAGMENT	0x02	/* Part of a fragmented message */
+#define SNEP_TRACK_FRAG_START	0x04
+#define SNEP_TRACK_FRAG_DONE	0x08
+#define SNEP_TRACK_FRAG_ABORT	0x10	/* Peer rejected, see frag_code */
+#define SNEP_TRACK_RESPONSE	0x20	/* Final response to req_code */
+
+struct snep_track_frag {
+	guint32 remaining;
+	guint8 code;
+	guint64 start;
+};
+
+/* SNEP state of one LLCP connection */
+struct snep_track {
+	struct snep_track_frag frag[2];
+
+	/* Last complete request, waiting for its final response */
+	bool pending;
+	guint8 req_code;
+	guint64 req_start;
+	guint64 req_done;
+};
+
+struct snep_track_event {
+	guint flags;
+
+	/* Code of the aborted message */
+	guint8 frag_code;
+
+	/* Request and response of a SNEP_TRACK_RESPONSE */
+	guint8 req_code;
+	guint8 rsp_code;
+	guint64 req_start;
+	guint64 req_done;
+};
+
+void snep_track_packet(struct snep_track *track,
+				struct sniffer_packet *packet,
+				guint64 timestamp,
+				struct snep_track_event *event);
+
+#endif /* __SNEP_TRACK_H */
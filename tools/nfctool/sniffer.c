@@ -23,7 +23,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -38,8 +37,12 @@
 #include <near/nfc_copy.h>
 
 #include "nfctool.h"
-#include "llcp-decode.h"
 #include "sniffer.h"
+#include "llcp-decode.h"
+#include "capture.h"
+#include "summary.h"
+#include "stats.h"
+#include "filter.h"
 
 #define PCAP_MAGIC_NUMBER 0xa1b2c3d4
 #define PCAP_MAJOR_VER 2
@@ -148,34 +151,59 @@ static void pcap_file_cleanup(void)
 }
 
 
-#define LINE_SIZE (10 + 3 * 16 + 2 + 18 + 1)
 #define HUMAN_READABLE_OFFSET 55
 
+/* Indentation, offset, hex and ASCII columns, newline */
+#define LINE_SIZE (255 + HUMAN_READABLE_OFFSET + 4 + 1 + 16 + 2)
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static char *hex_put_offset(char *ptr, guint32 offset, guint8 digits)
+{
+	int i;
+
+	for (i = digits - 1; i >= 0; i--) {
+		ptr[i] = hex_digits[offset & 0xF];
+		offset >>= 4;
+	}
+
+	return ptr + digits;
+}
+
+/* Writes 2 * len upper case hex digits to dst, without a terminator */
+char *sniffer_hex_encode(char *dst, const guint8 *data, guint32 len)
+{
+	guint32 i;
+
+	for (i = 0; i < len; i++) {
+		*dst++ = hex_digits[data[i] >> 4];
+		*dst++ = hex_digits[data[i] & 0xF];
+	}
+
+	return dst;
+}
+
 /*
  * Dumps data in Hex+ASCII format as:
  *
  * 00000000: 01 01 43 20 30 70 72 6F 70 65 72 74 69 65 73 20  |..C 0properties |
  *
+ * Each line is built in place and written with a single call.
  */
 void sniffer_print_hexdump(FILE *file, guint8 *data, guint32 len,
 			   guint8 indent, bool print_len)
 {
-	guint8 digits;
-	guint32 offset;
-	guint32 total;
 	guint32 output_len;
+	guint32 offset;
+	guint32 count, i;
 	gchar line[LINE_SIZE];
-	gchar *hexa = NULL, *human = NULL;
+	gchar *ptr, *human;
 	guint8 offset_len;
 	guint8 human_offset;
 
 	if (len == 0)
 		return;
 
-	offset = 0;
-	digits = 0;
-	total = 0;
-
 	if (opts.snap_len && len > opts.snap_len)
 		output_len = opts.snap_len;
 	else
@@ -196,46 +224,39 @@ void sniffer_print_hexdump(FILE *file, guint8 *data, guint32 len,
 		fprintf(file, "Total length: %u bytes\n", len);
 	}
 
-	while (total < output_len) {
-		if (digits == 0) {
-			memset(line, ' ', human_offset);
-
-			if (offset_len == 8)
-				sprintf(line, "%08X: ", offset);
-			else
-				sprintf(line, "%04X: ", offset);
+	/* The indentation never changes, nor the column separators */
+	memset(line, ' ', indent + human_offset);
+	human = line + indent + human_offset;
+	*human++ = '|';
 
-			offset += 16;
+	for (offset = 0; offset < output_len; offset += 16) {
+		count = MIN(output_len - offset, 16);
 
-			hexa = line + offset_len + 2;
+		ptr = hex_put_offset(line + indent, offset, offset_len);
+		*ptr++ = ':';
+		*ptr++ = ' ';
 
-			human = line + human_offset;
-			*human++ = '|';
+		for (i = 0; i < count; i++) {
+			*ptr++ = hex_digits[data[offset + i] >> 4];
+			*ptr++ = hex_digits[data[offset + i] & 0xF];
+			*ptr++ = ' ';
 		}
 
-		sprintf(hexa, "%02hhX ", data[total]);
-		*human++ = isprint((int)data[total]) ? (char)data[total] : '.';
-		hexa += 3;
+		/* Blank out the end of a previous, longer line */
+		if (count < 16)
+			memset(ptr, ' ', (16 - count) * 3);
 
-		if (++digits >= 16) {
-			*hexa = ' ';
-			strcpy(human, "|");
-			if (indent)
-				fprintf(file, "%*c", indent, ' ');
-			fprintf(file, "%s\n", line);
+		ptr = human;
+		for (i = 0; i < count; i++) {
+			guint8 c = data[offset + i];
 
-			digits = 0;
+			*ptr++ = (c >= 0x20 && c < 0x7F) ? (char)c : '.';
 		}
 
-		total++;
-	}
+		*ptr++ = '|';
+		*ptr++ = '\n';
 
-	if ((output_len & 0xF) != 0) {
-		*hexa = ' ';
-		strcpy(human, "|");
-		if (indent)
-			fprintf(file, "%*c", indent, ' ');
-		fprintf(file, "%s\n", line);
+		fwrite(line, 1, ptr - line, file);
 	}
 
 	if (output_len != len) {
@@ -255,6 +276,7 @@ static gboolean gio_handler(GIOChannel *channel,
 	guint8 ctrl[CMSG_SPACE(sizeof(struct timeval))];
 	struct cmsghdr *cmsg;
 	struct timeval msg_timestamp;
+	guint64 timestamp;
 
 	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
 		print_error("Sniffer IO error 0x%x\n", cond);
@@ -291,10 +313,21 @@ static gboolean gio_handler(GIOChannel *channel,
 	else
 		gettimeofday(&msg_timestamp, NULL);
 
-	llcp_print_pdu(buffer, len, &msg_timestamp);
+	timestamp = (guint64) msg_timestamp.tv_sec * 1000000000ULL +
+					msg_timestamp.tv_usec * 1000ULL;
+
+	if (opts.stats)
+		stats_packet(buffer, len, timestamp);
+
+	if (opts.summary)
+		summary_packet(buffer, len, timestamp);
+	else
+		llcp_print_pdu(buffer, len, &msg_timestamp);
 
 	pcap_file_write_packet(buffer, len, &msg_timestamp);
 
+	fflush(stdout);
+
 	return TRUE;
 }
 
@@ -311,6 +344,14 @@ void sniffer_cleanup(void)
 
 	pcap_file_cleanup();
 
+	capture_cleanup();
+
+	summary_print(stdout);
+	summary_cleanup();
+
+	stats_print(stdout);
+	stats_cleanup();
+
 	llcp_decode_cleanup();
 }
 
@@ -330,10 +371,6 @@ int sniffer_init(void)
 		return -1;
 	}
 
-	err = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one));
-	if (err < 0)
-		print_error("setsockopt: %s", strerror(errno));
-
 	memset(&sockaddr, 0, sizeof(struct sockaddr_nfc_llcp));
 	sockaddr.sa_family = AF_NFC;
 	sockaddr.dev_idx = opts.adapter_idx;
@@ -347,6 +384,29 @@ int sniffer_init(void)
 		goto exit;
 	}
 
+	err = filter_attach(sock);
+	if (err) {
+		close(sock);
+		goto exit;
+	}
+
+	if (opts.capture_only) {
+		err = capture_init(sock, opts.pcap_filename);
+		if (err) {
+			close(sock);
+			goto exit;
+		}
+
+		printf("Start capture on nfc%u to %s\n\n", opts.adapter_idx,
+							opts.pcap_filename);
+
+		return 0;
+	}
+
+	err = setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one));
+	if (err < 0)
+		print_error("setsockopt: %s", strerror(errno));
+
 	gio_channel = g_io_channel_unix_new(sock);
 	g_io_channel_set_close_on_unref(gio_channel, TRUE);
 
@@ -365,11 +425,21 @@ int sniffer_init(void)
 			goto exit;
 	}
 
-	err = llcp_decode_init();
+	if (opts.summary)
+		err = summary_init();
+	else
+		err = llcp_decode_init();
 	if (err)
 		goto exit;
 
+	if (opts.stats) {
+		err = stats_init();
+		if (err)
+			goto exit;
+	}
+
 	printf("Start sniffer on nfc%u\n\n", opts.adapter_idx);
+	fflush(stdout);
 
 exit:
 	if (err)
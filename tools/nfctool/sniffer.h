@@ -59,6 +59,8 @@ int sniffer_init(void);
 
 void sniffer_cleanup(void);
 
+char *sniffer_hex_encode(char *dst, const guint8 *data, guint32 len);
+
 void sniffer_print_hexdump(FILE *file, guint8 *data, guint32 len,
 			   guint8 indent, bool print_len);
 
@@ -0,0 +1,540 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <glib.h>
+
+#include <near/nfc_copy.h>
+
+#include "nfctool.h"
+#include "sniffer.h"
+#include "snep-decode.h"
+#include "snep-track.h"
+#include "llcp-decode.h"
+#include "stats.h"
+
+/*
+ * Per connection LLCP analytics, meant for tuning the link and
+ * connection parameters (LTO, RW, MIUX) against a given peer.
+ * Connections are tracked from their CONNECT, or from their first
+ * I frame when the capture started after it.
+ */
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+#define conn_key(idx, lsap, rsap) \
+	GUINT_TO_POINTER(((idx) << 16) | ((lsap) << 8) | (rsap))
+
+/* CONNECTs are matched with their CC by the initiator's side and SAP */
+#define pending_key(idx, dir, sap) \
+	GUINT_TO_POINTER(((idx) << 16) | ((dir) << 8) | (sap))
+
+struct stats_params {
+	gchar *sn;
+	gint16 miux;
+	gint8 rw;
+	gint16 lto;
+};
+
+struct stats_pending {
+	guint64 timestamp;
+	struct stats_params params;
+};
+
+struct stats_dir {
+	guint64 i_frames;
+	guint64 i_bytes;
+	guint64 first_i;
+	guint64 last_i;
+	guint64 rr;
+	guint64 rnr;
+};
+
+struct stats_conn {
+	guint8 adapter_idx;
+	guint8 local_sap;
+	guint8 remote_sap;
+	gchar *sn;
+	bool closed;
+
+	/* Parameters from the CONNECT and CC, -1 when absent */
+	gint8 rw[2];
+	gint16 miux[2];
+	guint8 initiator;
+
+	bool connected;
+	guint64 connect_latency;
+
+	struct stats_dir dir[2];
+
+	struct snep_track snep;
+	guint32 puts;
+	guint32 puts_failed;
+	guint64 put_min;
+	guint64 put_max;
+	guint64 put_total;
+};
+
+static GHashTable *pending_hash;
+static GHashTable *conn_hash;
+static GSList *conn_list;
+
+static struct stats_params link_params[2];
+static guint64 frames;
+static guint64 symm_frames;
+
+static void free_pending(gpointer data)
+{
+	struct stats_pending *pending = data;
+
+	g_free(pending->params.sn);
+	g_free(pending);
+}
+
+static void free_conn(gpointer data)
+{
+	struct stats_conn *conn = data;
+
+	g_free(conn->sn);
+	g_free(conn);
+}
+
+static void stats_parse_params(struct sniffer_packet *packet,
+					struct stats_params *params)
+{
+	guint8 *param = packet->llcp.data;
+	guint32 rmng = packet->llcp.data_len;
+
+	while (rmng >= 3 && rmng >= 2u + param[1]) {
+		switch (param[0]) {
+		case LLCP_PARAM_MIUX:
+			if (param[1] == 2)
+				params->miux = ((param[2] & 0x07) << 8) |
+								param[3];
+			break;
+
+		case LLCP_PARAM_LTO:
+			if (param[1] == 1)
+				params->lto = param[2];
+			break;
+
+		case LLCP_PARAM_RW:
+			if (param[1] == 1)
+				params->rw = param[2] & 0x0F;
+			break;
+
+		case LLCP_PARAM_SN:
+			g_free(params->sn);
+			params->sn = g_strndup((gchar *)param + 2, param[1]);
+			break;
+		}
+
+		rmng -= 2 + param[1];
+		param += 2 + param[1];
+	}
+}
+
+static struct stats_conn *stats_new_conn(struct sniffer_packet *packet)
+{
+	struct stats_conn *conn;
+	gpointer key;
+
+	key = conn_key(packet->adapter_idx, packet->llcp.local_sap,
+						packet->llcp.remote_sap);
+
+	/* The SAP pair is being reused, keep the old one for the report */
+	conn = g_hash_table_lookup(conn_hash, key);
+	if (conn) {
+		conn->closed = true;
+		g_hash_table_remove(conn_hash, key);
+	}
+
+	conn = g_try_malloc0(sizeof(*conn));
+	if (!conn)
+		return NULL;
+
+	conn->adapter_idx = packet->adapter_idx;
+	conn->local_sap = packet->llcp.local_sap;
+	conn->remote_sap = packet->llcp.remote_sap;
+	conn->rw[0] = conn->rw[1] = -1;
+	conn->miux[0] = conn->miux[1] = -1;
+
+	g_hash_table_insert(conn_hash, key, conn);
+	conn_list = g_slist_prepend(conn_list, conn);
+
+	return conn;
+}
+
+static struct stats_conn *stats_get_conn(struct sniffer_packet *packet)
+{
+	struct stats_conn *conn;
+
+	conn = g_hash_table_lookup(conn_hash,
+				conn_key(packet->adapter_idx,
+					packet->llcp.local_sap,
+					packet->llcp.remote_sap));
+	if (conn)
+		return conn;
+
+	return stats_new_conn(packet);
+}
+
+static void stats_connect(struct sniffer_packet *packet, guint64 timestamp)
+{
+	struct stats_pending *pending;
+	guint8 sap;
+
+	pending = g_try_malloc0(sizeof(*pending));
+	if (!pending)
+		return;
+
+	pending->timestamp = timestamp;
+	pending->params.rw = -1;
+	pending->params.miux = -1;
+
+	stats_parse_params(packet, &pending->params);
+
+	if (packet->direction == NFC_DIRECTION_TX)
+		sap = packet->llcp.local_sap;
+	else
+		sap = packet->llcp.remote_sap;
+
+	g_hash_table_replace(pending_hash,
+			pending_key(packet->adapter_idx, packet->direction, sap),
+			pending);
+}
+
+static void stats_cc(struct sniffer_packet *packet, guint64 timestamp)
+{
+	struct stats_pending *pending;
+	struct stats_params params = { NULL, -1, -1, -1 };
+	struct stats_conn *conn;
+	gpointer key;
+	guint8 dir, sap;
+
+	/* The CONNECT went the other way */
+	dir = !packet->direction;
+
+	if (dir == NFC_DIRECTION_TX)
+		sap = packet->llcp.local_sap;
+	else
+		sap = packet->llcp.remote_sap;
+
+	key = pending_key(packet->adapter_idx, dir, sap);
+
+	conn = stats_new_conn(packet);
+	if (!conn)
+		return;
+
+	conn->connected = true;
+	conn->initiator = dir;
+
+	stats_parse_params(packet, &params);
+	conn->rw[packet->direction] = params.rw;
+	conn->miux[packet->direction] = params.miux;
+	g_free(params.sn);
+
+	pending = g_hash_table_lookup(pending_hash, key);
+	if (!pending)
+		return;
+
+	conn->connect_latency = timestamp - pending->timestamp;
+	conn->rw[dir] = pending->params.rw;
+	conn->miux[dir] = pending->params.miux;
+	conn->sn = pending->params.sn;
+	pending->params.sn = NULL;
+
+	g_hash_table_remove(pending_hash, key);
+}
+
+static void stats_snep(struct stats_conn *conn, struct sniffer_packet *packet,
+							guint64 timestamp)
+{
+	struct snep_track_event event;
+	guint64 delta;
+
+	snep_track_packet(&conn->snep, packet, timestamp, &event);
+
+	if (event.flags & SNEP_TRACK_FRAG_ABORT &&
+				event.frag_code == SNEP_REQUEST_PUT)
+		conn->puts_failed++;
+
+	if (!(event.flags & SNEP_TRACK_RESPONSE) ||
+				event.req_code != SNEP_REQUEST_PUT)
+		return;
+
+	if (event.rsp_code != SNEP_RESPONSE_SUCCESS) {
+		conn->puts_failed++;
+		return;
+	}
+
+	/* From the first PUT fragment to the final response */
+	delta = timestamp - event.req_start;
+	if (!conn->puts || delta < conn->put_min)
+		conn->put_min = delta;
+	if (delta > conn->put_max)
+		conn->put_max = delta;
+	conn->put_total += delta;
+	conn->puts++;
+}
+
+static void stats_agf_pdu(guint8 *data, guint32 len, gpointer user_data)
+{
+	guint64 *timestamp = user_data;
+
+	stats_packet(data, len, *timestamp);
+}
+
+void stats_packet(guint8 *data, guint32 len, guint64 timestamp)
+{
+	struct sniffer_packet packet;
+	struct stats_conn *conn;
+	struct stats_dir *dir;
+
+	if (llcp_decode_packet(data, len, &packet))
+		return;
+
+	frames++;
+
+	switch (packet.llcp.ptype) {
+	case LLCP_PTYPE_SYMM:
+		symm_frames++;
+		break;
+
+	case LLCP_PTYPE_PAX:
+		stats_parse_params(&packet, &link_params[packet.direction]);
+		break;
+
+	case LLCP_PTYPE_AGF:
+		llcp_decode_agf(&packet, stats_agf_pdu, &timestamp);
+		break;
+
+	case LLCP_PTYPE_CONNECT:
+		stats_connect(&packet, timestamp);
+		break;
+
+	case LLCP_PTYPE_CC:
+		stats_cc(&packet, timestamp);
+		break;
+
+	case LLCP_PTYPE_DISC:
+	case LLCP_PTYPE_DM:
+		conn = g_hash_table_lookup(conn_hash,
+					conn_key(packet.adapter_idx,
+						packet.llcp.local_sap,
+						packet.llcp.remote_sap));
+		if (!conn)
+			break;
+
+		conn->closed = true;
+		g_hash_table_remove(conn_hash,
+					conn_key(packet.adapter_idx,
+						packet.llcp.local_sap,
+						packet.llcp.remote_sap));
+		break;
+
+	case LLCP_PTYPE_I:
+	case LLCP_PTYPE_RR:
+	case LLCP_PTYPE_RNR:
+		conn = stats_get_conn(&packet);
+		if (!conn)
+			break;
+
+		dir = &conn->dir[packet.direction];
+
+		if (packet.llcp.ptype == LLCP_PTYPE_RR) {
+			dir->rr++;
+			break;
+		}
+
+		if (packet.llcp.ptype == LLCP_PTYPE_RNR) {
+			dir->rnr++;
+			break;
+		}
+
+		if (!dir->i_frames)
+			dir->first_i = timestamp;
+		dir->last_i = timestamp;
+		dir->i_frames++;
+		dir->i_bytes += packet.llcp.data_len;
+
+		if (packet.llcp.local_sap == opts.snep_sap ||
+				packet.llcp.remote_sap == opts.snep_sap)
+			stats_snep(conn, &packet, timestamp);
+		break;
+	}
+}
+
+static void stats_print_dir(FILE *file, const char *name,
+					struct stats_dir *dir)
+{
+	guint64 duration;
+
+	fprintf(file, "    %s: %" G_GUINT64_FORMAT " I (%" G_GUINT64_FORMAT
+			" bytes), %" G_GUINT64_FORMAT " RR, %"
+			G_GUINT64_FORMAT " RNR", name, dir->i_frames,
+			dir->i_bytes, dir->rr, dir->rnr);
+
+	duration = dir->last_i - dir->first_i;
+
+	if (dir->i_frames > 1 && duration)
+		fprintf(file, ", %.1f kB/s",
+				(double) (dir->i_bytes * NSEC_PER_SEC) /
+				duration / 1000.0);
+
+	fprintf(file, "\n");
+}
+
+static void stats_print_param(FILE *file, const char *name, gint value)
+{
+	if (value < 0)
+		fprintf(file, " %s -", name);
+	else
+		fprintf(file, " %s %d", name, value);
+}
+
+static void stats_print_conn(FILE *file, struct stats_conn *conn)
+{
+	int i;
+
+	fprintf(file, "  nfc%d local:0x%02x remote:0x%02x %s%s\n",
+			conn->adapter_idx, conn->local_sap, conn->remote_sap,
+			conn->sn ? conn->sn : "", conn->closed ? "" : " (open)");
+
+	if (conn->connected) {
+		fprintf(file, "    connect: %s",
+			conn->initiator == NFC_DIRECTION_TX ? "local" : "remote");
+
+		if (conn->connect_latency)
+			fprintf(file, ", CONNECT->CC %.1f ms",
+				conn->connect_latency / 1000000.0);
+
+		for (i = 0; i < 2; i++) {
+			fprintf(file, ",%s", i == NFC_DIRECTION_RX ?
+							" rx" : " tx");
+			stats_print_param(file, "RW", conn->rw[i]);
+			stats_print_param(file, "MIUX", conn->miux[i]);
+		}
+
+		fprintf(file, "\n");
+	}
+
+	stats_print_dir(file, "rx", &conn->dir[NFC_DIRECTION_RX]);
+	stats_print_dir(file, "tx", &conn->dir[NFC_DIRECTION_TX]);
+
+	if (!conn->puts && !conn->puts_failed)
+		return;
+
+	fprintf(file, "    SNEP PUT: %u ok, %u failed", conn->puts,
+							conn->puts_failed);
+	if (conn->puts)
+		fprintf(file, ", min %.1f avg %.1f max %.1f ms",
+				conn->put_min / 1000000.0,
+				conn->put_total / 1000000.0 / conn->puts,
+				conn->put_max / 1000000.0);
+	fprintf(file, "\n");
+}
+
+void stats_print(FILE *file)
+{
+	GSList *list;
+	int i;
+
+	if (!conn_hash)
+		return;
+
+	fprintf(file, "LLCP link: %" G_GUINT64_FORMAT " frames, %"
+			G_GUINT64_FORMAT " SYMM", frames, symm_frames);
+	if (frames)
+		fprintf(file, " (%.1f%%)", 100.0 * symm_frames / frames);
+	fprintf(file, "\n");
+
+	for (i = 0; i < 2; i++) {
+		fprintf(file, "  %s PAX:", i == NFC_DIRECTION_RX ?
+							"rx" : "tx");
+		stats_print_param(file, "LTO", link_params[i].lto);
+		stats_print_param(file, "MIUX", link_params[i].miux);
+		fprintf(file, "\n");
+	}
+
+	fprintf(file, "\nConnections:\n");
+
+	/* In order of appearance */
+	conn_list = g_slist_reverse(conn_list);
+
+	for (list = conn_list; list; list = list->next)
+		stats_print_conn(file, list->data);
+
+	conn_list = g_slist_reverse(conn_list);
+
+	fprintf(file, "\n");
+}
+
+void stats_cleanup(void)
+{
+	int i;
+
+	if (pending_hash)
+		g_hash_table_destroy(pending_hash);
+	pending_hash = NULL;
+
+	if (conn_hash)
+		g_hash_table_destroy(conn_hash);
+	conn_hash = NULL;
+
+	g_slist_free_full(conn_list, free_conn);
+	conn_list = NULL;
+
+	for (i = 0; i < 2; i++) {
+		g_free(link_params[i].sn);
+		link_params[i].sn = NULL;
+	}
+}
+
+int stats_init(void)
+{
+	int i;
+
+	frames = 0;
+	symm_frames = 0;
+
+	for (i = 0; i < 2; i++) {
+		link_params[i].sn = NULL;
+		link_params[i].miux = -1;
+		link_params[i].rw = -1;
+		link_params[i].lto = -1;
+	}
+
+	pending_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+							NULL, free_pending);
+	conn_hash = g_hash_table_new(g_direct_hash, g_direct_equal);
+	if (!pending_hash || !conn_hash) {
+		stats_cleanup();
+		return -ENOMEM;
+	}
+
+	return 0;
+}
@@ -0,0 +1,353 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <glib.h>
+
+#include <near/nfc_copy.h>
+
+#include "nfctool.h"
+#include "sniffer.h"
+#include "snep-decode.h"
+#include "snep-track.h"
+#include "llcp-decode.h"
+#include "summary.h"
+
+/*
+ * Summary modes: packets are only decoded, never printed, and
+ * accounted into a few tables dumped at the end. This is what makes
+ * replaying very large captures practical.
+ */
+
+#define SAP_MAX		64
+#define PTYPE_MAX	16
+#define REQUEST_MAX	0x80
+
+#define conn_key(idx, lsap, rsap) \
+	GUINT_TO_POINTER(((idx) << 16) | ((lsap) << 8) | (rsap))
+
+struct summary_counter {
+	guint64 frames;
+	guint64 bytes;
+};
+
+static struct summary_counter sap_stats[2][SAP_MAX][SAP_MAX];
+static struct summary_counter ptype_stats[PTYPE_MAX];
+static struct summary_counter total;
+static guint64 errors;
+
+static GHashTable *conn_hash;
+static GArray *latencies[REQUEST_MAX];
+
+static struct {
+	guint64 started;
+	guint64 completed;
+	guint64 aborted;
+	guint64 fragments;
+	guint64 bytes;
+} frag_stats;
+
+static const char *snep_code_name(guint8 code)
+{
+	switch (code) {
+	case SNEP_REQUEST_GET:
+		return "GET";
+	case SNEP_REQUEST_PUT:
+		return "PUT";
+	}
+
+	return "other";
+}
+
+static struct snep_track *summary_get_conn(struct sniffer_packet *packet)
+{
+	struct snep_track *conn;
+	gpointer key;
+
+	key = conn_key(packet->adapter_idx, packet->llcp.local_sap,
+						packet->llcp.remote_sap);
+
+	conn = g_hash_table_lookup(conn_hash, key);
+	if (conn)
+		return conn;
+
+	conn = g_try_malloc0(sizeof(*conn));
+	if (!conn)
+		return NULL;
+
+	g_hash_table_insert(conn_hash, key, conn);
+
+	return conn;
+}
+
+static void summary_latency(guint8 code, guint64 start, guint64 end)
+{
+	guint64 delta;
+
+	if (end < start)
+		return;
+
+	code &= REQUEST_MAX - 1;
+
+	if (!latencies[code])
+		latencies[code] = g_array_new(FALSE, FALSE, sizeof(guint64));
+
+	delta = end - start;
+	g_array_append_val(latencies[code], delta);
+}
+
+static void summary_snep(struct sniffer_packet *packet, guint64 timestamp)
+{
+	struct snep_track *conn;
+	struct snep_track_event event;
+
+	conn = summary_get_conn(packet);
+	if (!conn)
+		return;
+
+	snep_track_packet(conn, packet, timestamp, &event);
+
+	if (event.flags & SNEP_TRACK_INVALID)
+		errors++;
+
+	if (event.flags & SNEP_TRACK_FRAGMENT) {
+		frag_stats.fragments++;
+		frag_stats.bytes += packet->llcp.data_len;
+	}
+
+	if (event.flags & SNEP_TRACK_FRAG_START)
+		frag_stats.started++;
+
+	if (event.flags & SNEP_TRACK_FRAG_DONE)
+		frag_stats.completed++;
+
+	if (event.flags & SNEP_TRACK_FRAG_ABORT)
+		frag_stats.aborted++;
+
+	if (event.flags & SNEP_TRACK_RESPONSE &&
+				event.rsp_code != SNEP_RESPONSE_REJECT)
+		summary_latency(event.req_code, event.req_done, timestamp);
+}
+
+static void summary_agf_pdu(guint8 *data, guint32 len, gpointer user_data)
+{
+	guint64 *timestamp = user_data;
+
+	summary_packet(data, len, *timestamp);
+}
+
+void summary_packet(guint8 *data, guint32 len, guint64 timestamp)
+{
+	struct sniffer_packet packet;
+	struct summary_counter *counter;
+
+	if (llcp_decode_packet(data, len, &packet)) {
+		errors++;
+		return;
+	}
+
+	total.frames++;
+	total.bytes += len;
+
+	ptype_stats[packet.llcp.ptype].frames++;
+	ptype_stats[packet.llcp.ptype].bytes += packet.llcp.data_len;
+
+	counter = &sap_stats[packet.direction][packet.llcp.local_sap]
+						[packet.llcp.remote_sap];
+	counter->frames++;
+	counter->bytes += packet.llcp.data_len;
+
+	switch (packet.llcp.ptype) {
+	case LLCP_PTYPE_AGF:
+		if (llcp_decode_agf(&packet, summary_agf_pdu, &timestamp))
+			errors++;
+		break;
+
+	case LLCP_PTYPE_I:
+		if (opts.summary & (SUMMARY_SNEP | SUMMARY_FRAG) &&
+				(packet.llcp.local_sap == opts.snep_sap ||
+				packet.llcp.remote_sap == opts.snep_sap))
+			summary_snep(&packet, timestamp);
+		break;
+
+	case LLCP_PTYPE_DISC:
+	case LLCP_PTYPE_DM:
+		g_hash_table_remove(conn_hash,
+				conn_key(packet.adapter_idx,
+					packet.llcp.local_sap,
+					packet.llcp.remote_sap));
+		break;
+	}
+}
+
+static gint compare_u64(gconstpointer a, gconstpointer b)
+{
+	guint64 val_a = *(const guint64 *) a;
+	guint64 val_b = *(const guint64 *) b;
+
+	return val_a < val_b ? -1 : val_a > val_b;
+}
+
+static double percentile(GArray *samples, guint pct)
+{
+	guint idx = (samples->len - 1) * pct / 100;
+
+	return g_array_index(samples, guint64, idx) / 1000.0;
+}
+
+static void summary_print_sap(FILE *file)
+{
+	int dir, lsap, rsap, ptype;
+	struct summary_counter *counter;
+
+	fprintf(file, "Frames by type:\n");
+
+	for (ptype = 0; ptype < PTYPE_MAX; ptype++) {
+		if (!ptype_stats[ptype].frames)
+			continue;
+
+		fprintf(file, "  %-8s %12" G_GUINT64_FORMAT " frames %14"
+				G_GUINT64_FORMAT " bytes\n",
+				llcp_ptype_name(ptype),
+				ptype_stats[ptype].frames,
+				ptype_stats[ptype].bytes);
+	}
+
+	fprintf(file, "\nInformation bytes by SAP:\n");
+	fprintf(file, "  dir local remote %12s %14s\n", "frames", "bytes");
+
+	for (dir = 0; dir < 2; dir++)
+		for (lsap = 0; lsap < SAP_MAX; lsap++)
+			for (rsap = 0; rsap < SAP_MAX; rsap++) {
+				counter = &sap_stats[dir][lsap][rsap];
+				if (!counter->frames)
+					continue;
+
+				fprintf(file, "  %s   0x%02x  0x%02x   %12"
+					G_GUINT64_FORMAT " %14"
+					G_GUINT64_FORMAT "\n",
+					dir == NFC_DIRECTION_RX ? "rx" : "tx",
+					lsap, rsap, counter->frames,
+					counter->bytes);
+			}
+
+	fprintf(file, "\n");
+}
+
+static void summary_print_snep(FILE *file)
+{
+	GArray *samples;
+	guint64 sum;
+	guint code, i;
+
+	fprintf(file, "SNEP request latencies (usec):\n");
+	fprintf(file, "  %-6s %8s %10s %10s %10s %10s %10s\n", "code",
+			"count", "min", "avg", "p50", "p95", "max");
+
+	for (code = 0; code < REQUEST_MAX; code++) {
+		samples = latencies[code];
+		if (!samples || !samples->len)
+			continue;
+
+		g_array_sort(samples, compare_u64);
+
+		for (sum = 0, i = 0; i < samples->len; i++)
+			sum += g_array_index(samples, guint64, i);
+
+		fprintf(file, "  %-6s %8u %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				snep_code_name(code), samples->len,
+				percentile(samples, 0),
+				sum / 1000.0 / samples->len,
+				percentile(samples, 50),
+				percentile(samples, 95),
+				percentile(samples, 100));
+	}
+
+	fprintf(file, "\n");
+}
+
+static void summary_print_frag(FILE *file)
+{
+	fprintf(file, "SNEP fragmentation:\n");
+	fprintf(file, "  messages %" G_GUINT64_FORMAT " started, %"
+			G_GUINT64_FORMAT " completed, %" G_GUINT64_FORMAT
+			" aborted\n", frag_stats.started,
+			frag_stats.completed, frag_stats.aborted);
+	fprintf(file, "  fragments %" G_GUINT64_FORMAT ", %"
+			G_GUINT64_FORMAT " bytes\n",
+			frag_stats.fragments, frag_stats.bytes);
+
+	fprintf(file, "\n");
+}
+
+void summary_print(FILE *file)
+{
+	if (!conn_hash)
+		return;
+
+	fprintf(file, "%" G_GUINT64_FORMAT " LLCP frames, %" G_GUINT64_FORMAT
+			" bytes, %" G_GUINT64_FORMAT " undecodable\n\n",
+			total.frames, total.bytes, errors);
+
+	if (opts.summary & SUMMARY_SAP)
+		summary_print_sap(file);
+
+	if (opts.summary & SUMMARY_SNEP)
+		summary_print_snep(file);
+
+	if (opts.summary & SUMMARY_FRAG)
+		summary_print_frag(file);
+}
+
+void summary_cleanup(void)
+{
+	int i;
+
+	if (conn_hash)
+		g_hash_table_destroy(conn_hash);
+	conn_hash = NULL;
+
+	for (i = 0; i < REQUEST_MAX; i++) {
+		if (latencies[i])
+			g_array_free(latencies[i], TRUE);
+		latencies[i] = NULL;
+	}
+}
+
+int summary_init(void)
+{
+	memset(sap_stats, 0, sizeof(sap_stats));
+	memset(ptype_stats, 0, sizeof(ptype_stats));
+	memset(&total, 0, sizeof(total));
+	memset(&frag_stats, 0, sizeof(frag_stats));
+	errors = 0;
+
+	conn_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+							NULL, g_free);
+	if (!conn_hash)
+		return -ENOMEM;
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ *
+ *  Near Field Communication nfctool
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __SUMMARY_H
+#define __SUMMARY_H
+
+#define SUMMARY_SAP	0x01
+#define SUMMARY_SNEP	0x02
+#define SUMMARY_FRAG	0x04
+#define SUMMARY_ALL	(SUMMARY_SAP | SUMMARY_SNEP | SUMMARY_FRAG)
+
+int summary_init(void);
+
+void summary_cleanup(void);
+
+void summary_packet(guint8 *data, guint32 len, guint64 timestamp);
+
+void summary_print(FILE *file);
+
+#endif /* __SUMMARY_H */
@@ -0,0 +1,477 @@
+/*
+ *  seeld - Secure Element Manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <se/seel.h>
+
+#define TEST_STORAGE_DIR  STORAGEDIR "/se"
+#define TEST_STORAGE_FILE TEST_STORAGE_DIR "/ace"
+
+#define INS_SELECT_FILE 0xA4
+#define INS_GET_GP_DATA 0xCA
+
+/* Any non NULL pointer will do, ace.c only uses it as a key */
+static uint8_t test_se_data;
+#define TEST_SE ((struct seel_se *) &test_se_data)
+
+static uint8_t cplc_a[] = { 0x47, 0x90, 0x50, 0x40, 0x47, 0x91, 0x81, 0x02 };
+static uint8_t cplc_b[] = { 0x47, 0x90, 0x50, 0x40, 0x47, 0x91, 0x81, 0x03 };
+
+static uint8_t tag_1[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 };
+static uint8_t tag_2[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x09 };
+#define TAG_1_HEX "0102030405060708"
+#define TAG_2_HEX "0102030405060709"
+
+/* One generic REF-AR-DO, APDU access always or never granted */
+static uint8_t rules_allow[] = {
+	0xE2, 0x07, 0xE1, 0x00, 0xE3, 0x03, 0xD0, 0x01, 0x01
+};
+static uint8_t rules_deny[] = {
+	0xE2, 0x07, 0xE1, 0x00, 0xE3, 0x03, 0xD0, 0x01, 0x00
+};
+#define RULES_ALLOW_HEX "e207e100e303d00101"
+#define RULES_DENY_HEX  "e207e100e303d00100"
+
+static uint8_t test_aid[] = { 0xA0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10 };
+static uint8_t test_hash[20] = { 0xAB };
+static uint8_t test_apdu[] = { 0x00, 0xB0, 0x00, 0x00 };
+
+/* What the fake card answers */
+static uint8_t *card_cplc;
+static size_t card_cplc_len;
+static uint8_t *card_tag;
+static uint8_t *card_rules;
+static size_t card_rules_len;
+
+static guint n_get_all;
+
+struct test_io {
+	struct seel_apdu *apdu;
+	transceive_cb_t cb;
+	void *context;
+};
+
+static GQueue *pending_io;
+
+static GSList *test_hashes;
+static struct seel_ace_cache *test_cache;
+
+/* Daemon side stubs */
+int __seel_se_queue_io(struct seel_se *se, struct seel_apdu *apdu,
+					transceive_cb_t cb, void *context)
+{
+	struct test_io *io;
+
+	g_assert(se == TEST_SE);
+
+	io = g_try_malloc0(sizeof(struct test_io));
+	g_assert(io);
+
+	io->apdu = apdu;
+	io->cb = cb;
+	io->context = context;
+
+	g_queue_push_tail(pending_io, io);
+
+	return 0;
+}
+
+uint8_t __seel_se_get_type(struct seel_se *se)
+{
+	return SEEL_SE_EMULATOR;
+}
+
+struct seel_se *__seel_channel_get_se(struct seel_channel *channel)
+{
+	return TEST_SE;
+}
+
+bool __seel_channel_is_basic(struct seel_channel *channel)
+{
+	return false;
+}
+
+uint8_t *__seel_channel_get_aid(struct seel_channel *channel,
+							size_t *aid_len)
+{
+	*aid_len = sizeof(test_aid);
+
+	return test_aid;
+}
+
+struct seel_ace_cache *__seel_channel_get_ace_cache(
+					struct seel_channel *channel)
+{
+	return test_cache;
+}
+
+bool __seel_cert_lookup(const char *owner, const GSList **hashes)
+{
+	*hashes = test_hashes;
+
+	return true;
+}
+
+static size_t card_respond(uint8_t *cmd, size_t cmd_len, uint8_t *rsp)
+{
+	size_t len = 0;
+
+	g_assert_cmpuint(cmd_len, >=, 4);
+
+	if (cmd[1] == INS_SELECT_FILE)
+		goto done;
+
+	g_assert_cmpuint(cmd[1], ==, INS_GET_GP_DATA);
+
+	switch (cmd[2] << 8 | cmd[3]) {
+	case 0x9F7F:
+		if (!card_cplc_len) {
+			/* Referenced data not found */
+			rsp[0] = 0x6A;
+			rsp[1] = 0x88;
+			return 2;
+		}
+
+		rsp[len++] = 0x9F;
+		rsp[len++] = 0x7F;
+		rsp[len++] = card_cplc_len;
+		memcpy(rsp + len, card_cplc, card_cplc_len);
+		len += card_cplc_len;
+		break;
+
+	case 0xDF20:
+		rsp[len++] = 0xDF;
+		rsp[len++] = 0x20;
+		rsp[len++] = 0x08;
+		memcpy(rsp + len, card_tag, 8);
+		len += 8;
+		break;
+
+	case 0xFF40:
+		n_get_all++;
+
+		rsp[len++] = 0xFF;
+		rsp[len++] = 0x40;
+		rsp[len++] = card_rules_len;
+		memcpy(rsp + len, card_rules, card_rules_len);
+		len += card_rules_len;
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+done:
+	rsp[len++] = 0x90;
+	rsp[len++] = 0x00;
+
+	return len;
+}
+
+/* Answers the queued APDUs, including the ones queued on the way */
+static void run_io(void)
+{
+	struct test_io *io;
+	uint8_t rsp[64];
+	size_t len;
+	int err;
+
+	while ((io = g_queue_pop_head(pending_io))) {
+		len = card_respond(__seel_apdu_data(io->apdu),
+				__seel_apdu_length(io->apdu), rsp);
+		err = __seel_apdu_resp_status(rsp, len);
+
+		io->cb(io->context, rsp, len, err);
+
+		__seel_apdu_free(io->apdu);
+		g_free(io);
+	}
+}
+
+/* One seeld run: the SE shows up and its rules get loaded */
+static void ace_session(void)
+{
+	__seel_ace_init();
+
+	__seel_ace_add(TEST_SE);
+	run_io();
+}
+
+static void ace_session_end(void)
+{
+	__seel_ace_cleanup();
+}
+
+static bool ace_allowed(void)
+{
+	bool allowed;
+
+	test_cache = __seel_ace_cache_new();
+	g_assert(test_cache);
+
+	allowed = __seel_ace_apdu_allowed(NULL, ":1.42", test_apdu,
+							sizeof(test_apdu));
+
+	__seel_ace_cache_free(test_cache);
+	test_cache = NULL;
+
+	return allowed;
+}
+
+static char *storage_group(uint8_t *cplc, size_t cplc_len)
+{
+	char *hash, *group;
+
+	hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, cplc, cplc_len);
+	group = g_strdup_printf("Card %s", hash);
+	g_free(hash);
+
+	return group;
+}
+
+static char *storage_get(uint8_t *cplc, size_t cplc_len, const char *key)
+{
+	GKeyFile *keyfile;
+	char *group, *value;
+
+	keyfile = g_key_file_new();
+	g_assert(g_key_file_load_from_file(keyfile, TEST_STORAGE_FILE,
+								0, NULL));
+
+	group = storage_group(cplc, cplc_len);
+	value = g_key_file_get_string(keyfile, group, key, NULL);
+
+	g_free(group);
+	g_key_file_free(keyfile);
+
+	return value;
+}
+
+static void storage_assert(uint8_t *cplc, size_t cplc_len,
+					const char *tag, const char *rules)
+{
+	char *value;
+
+	value = storage_get(cplc, cplc_len, "RefreshTag");
+	g_assert_cmpstr(value, ==, tag);
+	g_free(value);
+
+	value = storage_get(cplc, cplc_len, "Rules");
+	g_assert_cmpstr(value, ==, rules);
+	g_free(value);
+}
+
+static void storage_remove(void)
+{
+	unlink(TEST_STORAGE_FILE);
+	rmdir(TEST_STORAGE_DIR);
+	rmdir(STORAGEDIR);
+}
+
+static void test_ace_setup(void)
+{
+	storage_remove();
+
+	card_cplc = cplc_a;
+	card_cplc_len = sizeof(cplc_a);
+	card_tag = tag_1;
+	card_rules = rules_allow;
+	card_rules_len = sizeof(rules_allow);
+
+	n_get_all = 0;
+
+	pending_io = g_queue_new();
+	test_hashes = g_slist_append(NULL, test_hash);
+}
+
+static void test_ace_teardown(void)
+{
+	g_assert(g_queue_is_empty(pending_io));
+	g_queue_free(pending_io);
+	pending_io = NULL;
+
+	g_slist_free(test_hashes);
+	test_hashes = NULL;
+
+	storage_remove();
+}
+
+static void test_ace_storage_store(void)
+{
+	test_ace_setup();
+
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 1);
+	g_assert(ace_allowed());
+	storage_assert(cplc_a, sizeof(cplc_a), TAG_1_HEX, RULES_ALLOW_HEX);
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+static void test_ace_storage_restore(void)
+{
+	test_ace_setup();
+
+	ace_session();
+	ace_session_end();
+
+	/* Stale card side rules tell the stored ones apart */
+	card_rules = rules_deny;
+
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 1);
+	g_assert(ace_allowed());
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+static void test_ace_storage_other_card(void)
+{
+	test_ace_setup();
+
+	ace_session();
+	ace_session_end();
+
+	/* A different card coming with the same refresh tag */
+	card_cplc = cplc_b;
+	card_rules = rules_deny;
+
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 2);
+	g_assert(!ace_allowed());
+	storage_assert(cplc_a, sizeof(cplc_a), TAG_1_HEX, RULES_ALLOW_HEX);
+	storage_assert(cplc_b, sizeof(cplc_b), TAG_1_HEX, RULES_DENY_HEX);
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+static void test_ace_storage_new_tag(void)
+{
+	test_ace_setup();
+
+	ace_session();
+	ace_session_end();
+
+	card_tag = tag_2;
+	card_rules = rules_deny;
+
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 2);
+	g_assert(!ace_allowed());
+	storage_assert(cplc_a, sizeof(cplc_a), TAG_2_HEX, RULES_DENY_HEX);
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+static void test_ace_storage_no_cplc(void)
+{
+	test_ace_setup();
+
+	card_cplc_len = 0;
+
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 1);
+	g_assert(ace_allowed());
+	g_assert(!g_file_test(TEST_STORAGE_FILE, G_FILE_TEST_EXISTS));
+
+	ace_session_end();
+
+	/* Nothing to restore from */
+	ace_session();
+
+	g_assert_cmpuint(n_get_all, ==, 2);
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+static void test_ace_storage_corrupted(void)
+{
+	char *group, *data;
+
+	test_ace_setup();
+
+	ace_session();
+	ace_session_end();
+
+	group = storage_group(cplc_a, sizeof(cplc_a));
+	data = g_strdup_printf("[%s]\nRefreshTag=%s\nRules=e207e1zz\n",
+							group, TAG_1_HEX);
+	g_assert(g_file_set_contents(TEST_STORAGE_FILE, data, -1, NULL));
+	g_free(data);
+	g_free(group);
+
+	ace_session();
+
+	/* Fetched again, and the storage repaired */
+	g_assert_cmpuint(n_get_all, ==, 2);
+	g_assert(ace_allowed());
+	storage_assert(cplc_a, sizeof(cplc_a), TAG_1_HEX, RULES_ALLOW_HEX);
+
+	ace_session_end();
+	test_ace_teardown();
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	g_test_init(&argc, &argv, NULL);
+
+	__seel_apdu_init();
+
+	g_test_add_func("/testACE-storage/Test rules stored",
+				test_ace_storage_store);
+	g_test_add_func("/testACE-storage/Test rules restored",
+				test_ace_storage_restore);
+	g_test_add_func("/testACE-storage/Test other card",
+				test_ace_storage_other_card);
+	g_test_add_func("/testACE-storage/Test new refresh tag",
+				test_ace_storage_new_tag);
+	g_test_add_func("/testACE-storage/Test no CPLC",
+				test_ace_storage_no_cplc);
+	g_test_add_func("/testACE-storage/Test corrupted storage",
+				test_ace_storage_corrupted);
+
+	err = g_test_run();
+
+	__seel_apdu_cleanup();
+
+	return err;
+}
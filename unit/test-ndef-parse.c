@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <glib.h>
 #include <glib/gprintf.h>
@@ -298,6 +299,96 @@ static void test_ndef_ho_hs_bt(void)
 	g_assert_cmpstr(record->type, ==, BT_MIME_STRING_2_1);
 }
 
+/* Offset of the configuration record of ho_hs_bt */
+#define HO_HS_BT_CFG_OFFSET	15
+
+static int ho_scan(struct near_ndef_ho_scan *ho, uint8_t *data, size_t len)
+{
+	memset(ho, 0, sizeof(*ho));
+	ho->records_left = -1;
+
+	return near_ndef_scan_handover(ho, data, len);
+}
+
+static void test_ndef_ho_scan(void)
+{
+	struct near_ndef_ho_scan ho;
+
+	g_assert_cmpint(ho_scan(&ho, ho_hs_bt, sizeof(ho_hs_bt)), ==, 1);
+
+	g_assert_cmpuint(ho.scan, ==, sizeof(ho_hs_bt));
+	g_assert_cmpuint(ho.cfg_count, ==, 1);
+	g_assert_cmpuint(ho.cfg_offsets[0], ==, HO_HS_BT_CFG_OFFSET);
+
+	g_free(ho.cfg_offsets);
+}
+
+static void test_ndef_ho_scan_fragmented(void)
+{
+	struct near_ndef_ho_scan ho;
+	size_t len;
+
+	g_assert_cmpint(ho_scan(&ho, ho_hs_bt, 0), ==, 0);
+
+	/* One byte at a time, the message is only complete at the end */
+	for (len = 1; len < sizeof(ho_hs_bt); len++)
+		g_assert_cmpint(near_ndef_scan_handover(&ho, ho_hs_bt, len),
+									==, 0);
+
+	g_assert_cmpint(near_ndef_scan_handover(&ho, ho_hs_bt, len), ==, 1);
+
+	g_assert_cmpuint(ho.scan, ==, sizeof(ho_hs_bt));
+	g_assert_cmpuint(ho.cfg_count, ==, 1);
+	g_assert_cmpuint(ho.cfg_offsets[0], ==, HO_HS_BT_CFG_OFFSET);
+
+	g_free(ho.cfg_offsets);
+}
+
+static void test_ndef_ho_scan_trailing(void)
+{
+	struct near_ndef_ho_scan ho;
+	uint8_t *data;
+
+	data = g_malloc0(sizeof(ho_hs_bt) + 1);
+	memcpy(data, ho_hs_bt, sizeof(ho_hs_bt));
+
+	g_assert_cmpint(ho_scan(&ho, data, sizeof(ho_hs_bt) + 1), ==,
+								-EBADMSG);
+
+	g_free(ho.cfg_offsets);
+	g_free(data);
+}
+
+static void test_ndef_ho_mb_me(void)
+{
+	size_t cfg_offset = HO_HS_BT_CFG_OFFSET;
+	uint8_t data[sizeof(ho_hs_bt)];
+
+	/* Second record with MB set */
+	memcpy(data, ho_hs_bt, sizeof(data));
+	data[cfg_offset] |= 0x80;
+	g_assert_cmpint(near_ndef_process_handover(data, sizeof(data),
+					&cfg_offset, 1, NULL), ==, -EINVAL);
+
+	/* First record without MB */
+	memcpy(data, ho_hs_bt, sizeof(data));
+	data[0] &= ~0x80;
+	g_assert_cmpint(near_ndef_process_handover(data, sizeof(data),
+					&cfg_offset, 1, NULL), ==, -EINVAL);
+
+	/* Last record without ME */
+	memcpy(data, ho_hs_bt, sizeof(data));
+	data[cfg_offset] &= ~0x40;
+	g_assert_cmpint(near_ndef_process_handover(data, sizeof(data),
+					&cfg_offset, 1, NULL), ==, -EINVAL);
+
+	/* Handover record with ME, carriers following */
+	memcpy(data, ho_hs_bt, sizeof(data));
+	data[0] |= 0x40;
+	g_assert_cmpint(near_ndef_process_handover(data, sizeof(data),
+					&cfg_offset, 1, NULL), ==, -EINVAL);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -313,6 +404,14 @@ int main(int argc, char **argv)
 							test_ndef_aar);
 	g_test_add_func("/testNDEF-parse/Test Handover Select NDEF",
 							test_ndef_ho_hs_bt);
+	g_test_add_func("/testNDEF-parse/Test Handover message scan",
+							test_ndef_ho_scan);
+	g_test_add_func("/testNDEF-parse/Test fragmented Handover message",
+						test_ndef_ho_scan_fragmented);
+	g_test_add_func("/testNDEF-parse/Test Handover trailing bytes",
+						test_ndef_ho_scan_trailing);
+	g_test_add_func("/testNDEF-parse/Test Handover MB/ME bits",
+							test_ndef_ho_mb_me);
 
 	return g_test_run();
 }
@@ -0,0 +1,333 @@
+/*
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gprintf.h>
+
+#include "tools/nfctool/pcap-read.h"
+
+#define LINKTYPE_NFC_LLCP	0xF5
+#define LINKTYPE_ETHERNET	0x01
+
+#define NSEC_PER_SEC		1000000000ULL
+
+struct test_packet {
+	guint32 len;
+	guint8 data[4];
+	guint64 timestamp;
+};
+
+static struct test_packet packets[8];
+static guint n_packets;
+
+static void test_packet_cb(guint8 *data, guint32 len, guint64 timestamp)
+{
+	struct test_packet *packet;
+
+	g_assert_cmpuint(n_packets, <, G_N_ELEMENTS(packets));
+
+	packet = &packets[n_packets++];
+	packet->len = len;
+	packet->timestamp = timestamp;
+	memcpy(packet->data, data, MIN(len, sizeof(packet->data)));
+}
+
+static void put32(GByteArray *buf, guint32 val, bool swap)
+{
+	if (swap)
+		val = GUINT32_SWAP_LE_BE(val);
+
+	g_byte_array_append(buf, (guint8 *) &val, 4);
+}
+
+static void put16(GByteArray *buf, guint16 val, bool swap)
+{
+	if (swap)
+		val = GUINT16_SWAP_LE_BE(val);
+
+	g_byte_array_append(buf, (guint8 *) &val, 2);
+}
+
+static void put_pcap_header(GByteArray *buf, guint32 magic, bool swap)
+{
+	put32(buf, magic, swap);
+	put16(buf, 2, swap);
+	put16(buf, 4, swap);
+	put32(buf, 0, swap);
+	put32(buf, 0, swap);
+	put32(buf, 0xffff, swap);
+	put32(buf, LINKTYPE_NFC_LLCP, swap);
+}
+
+static void put_pcap_record(GByteArray *buf, guint32 sec, guint32 frac,
+				const guint8 *data, guint32 len, bool swap)
+{
+	put32(buf, sec, swap);
+	put32(buf, frac, swap);
+	put32(buf, len, swap);
+	put32(buf, len, swap);
+	g_byte_array_append(buf, data, len);
+}
+
+/* Read the capture in buf from a temporary file */
+static int read_capture(GByteArray *buf, guint64 *skipped)
+{
+	GError *error = NULL;
+	gchar *path;
+	int fd, err;
+
+	fd = g_file_open_tmp("test-pcap-XXXXXX", &path, &error);
+	g_assert_no_error(error);
+
+	g_assert_cmpint(write(fd, buf->data, buf->len), ==, buf->len);
+	close(fd);
+
+	n_packets = 0;
+	*skipped = 0;
+
+	err = pcap_read_file(path, test_packet_cb, skipped);
+
+	unlink(path);
+	g_free(path);
+	g_byte_array_free(buf, TRUE);
+
+	return err;
+}
+
+static const guint8 symm[] = { 0x00, 0x00 };
+static const guint8 i_frame[] = { 0x13, 0x20, 0x00 };
+
+static void test_pcap_usec(void)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	put_pcap_header(buf, 0xa1b2c3d4, false);
+	put_pcap_record(buf, 1, 500, symm, sizeof(symm), false);
+	put_pcap_record(buf, 2, 0, i_frame, sizeof(i_frame), false);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, 0);
+
+	g_assert_cmpuint(n_packets, ==, 2);
+	g_assert_cmpuint(skipped, ==, 0);
+
+	g_assert_cmpuint(packets[0].len, ==, sizeof(symm));
+	g_assert_cmpuint(packets[0].timestamp, ==, NSEC_PER_SEC + 500000);
+	g_assert(!memcmp(packets[0].data, symm, sizeof(symm)));
+
+	g_assert_cmpuint(packets[1].len, ==, sizeof(i_frame));
+	g_assert_cmpuint(packets[1].timestamp, ==, 2 * NSEC_PER_SEC);
+	g_assert(!memcmp(packets[1].data, i_frame, sizeof(i_frame)));
+}
+
+static void test_pcap_nsec_swapped(void)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	put_pcap_header(buf, 0xa1b23c4d, true);
+	put_pcap_record(buf, 2, 7, i_frame, sizeof(i_frame), true);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, 0);
+
+	g_assert_cmpuint(n_packets, ==, 1);
+	g_assert_cmpuint(packets[0].len, ==, sizeof(i_frame));
+	g_assert_cmpuint(packets[0].timestamp, ==, 2 * NSEC_PER_SEC + 7);
+}
+
+static void test_pcap_bad_magic(void)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	put_pcap_header(buf, 0x12345678, false);
+	put_pcap_record(buf, 1, 0, symm, sizeof(symm), false);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, -EINVAL);
+	g_assert_cmpuint(n_packets, ==, 0);
+}
+
+static void test_pcap_truncated(void)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	put_pcap_header(buf, 0xa1b2c3d4, false);
+	put_pcap_record(buf, 1, 0, symm, sizeof(symm), false);
+	put_pcap_record(buf, 2, 0, i_frame, sizeof(i_frame), false);
+
+	/* Cut the last byte of the second record */
+	g_byte_array_set_size(buf, buf->len - 1);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, 0);
+	g_assert_cmpuint(n_packets, ==, 1);
+	g_assert_cmpuint(packets[0].len, ==, sizeof(symm));
+}
+
+static void put_pcapng_shb(GByteArray *buf, bool swap)
+{
+	put32(buf, 0x0A0D0D0A, swap);
+	put32(buf, 28, swap);
+	put32(buf, 0x1A2B3C4D, swap);
+	put16(buf, 1, swap);
+	put16(buf, 0, swap);
+	put32(buf, 0xffffffff, swap);
+	put32(buf, 0xffffffff, swap);
+	put32(buf, 28, swap);
+}
+
+static void put_pcapng_idb(GByteArray *buf, guint16 linktype,
+					gint tsresol, bool swap)
+{
+	guint32 len = tsresol < 0 ? 20 : 32;
+	guint8 opt[4] = { tsresol };
+
+	put32(buf, 0x00000001, swap);
+	put32(buf, len, swap);
+	put16(buf, linktype, swap);
+	put16(buf, 0, swap);
+	put32(buf, 0xffff, swap);
+
+	if (tsresol >= 0) {
+		put16(buf, 9, swap);	/* if_tsresol */
+		put16(buf, 1, swap);
+		g_byte_array_append(buf, opt, sizeof(opt));
+		put16(buf, 0, swap);	/* opt_endofopt */
+		put16(buf, 0, swap);
+	}
+
+	put32(buf, len, swap);
+}
+
+static void put_pcapng_epb(GByteArray *buf, guint32 iface, guint64 ts,
+				const guint8 *data, guint32 len, bool swap)
+{
+	guint32 padded = (len + 3) & ~3;
+	guint8 pad[3] = { };
+
+	put32(buf, 0x00000006, swap);
+	put32(buf, 32 + padded, swap);
+	put32(buf, iface, swap);
+	put32(buf, ts >> 32, swap);
+	put32(buf, ts & 0xffffffff, swap);
+	put32(buf, len, swap);
+	put32(buf, len, swap);
+	g_byte_array_append(buf, data, len);
+	g_byte_array_append(buf, pad, padded - len);
+	put32(buf, 32 + padded, swap);
+}
+
+static void put_pcapng_spb(GByteArray *buf, const guint8 *data,
+						guint32 len, bool swap)
+{
+	guint32 padded = (len + 3) & ~3;
+	guint8 pad[3] = { };
+
+	put32(buf, 0x00000003, swap);
+	put32(buf, 16 + padded, swap);
+	put32(buf, len, swap);
+	g_byte_array_append(buf, data, len);
+	g_byte_array_append(buf, pad, padded - len);
+	put32(buf, 16 + padded, swap);
+}
+
+static void test_pcapng(bool swap)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	put_pcapng_shb(buf, swap);
+	put_pcapng_idb(buf, LINKTYPE_NFC_LLCP, 9, swap);
+	put_pcapng_idb(buf, LINKTYPE_ETHERNET, -1, swap);
+	put_pcapng_epb(buf, 0, 5 * NSEC_PER_SEC + 3, i_frame,
+						sizeof(i_frame), swap);
+	put_pcapng_epb(buf, 1, 6 * NSEC_PER_SEC, symm, sizeof(symm), swap);
+	put_pcapng_epb(buf, 2, 7 * NSEC_PER_SEC, symm, sizeof(symm), swap);
+	put_pcapng_spb(buf, symm, sizeof(symm), swap);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, 0);
+
+	/* Ethernet and unknown interface packets are skipped */
+	g_assert_cmpuint(n_packets, ==, 2);
+	g_assert_cmpuint(skipped, ==, 2);
+
+	g_assert_cmpuint(packets[0].len, ==, sizeof(i_frame));
+	g_assert_cmpuint(packets[0].timestamp, ==, 5 * NSEC_PER_SEC + 3);
+	g_assert(!memcmp(packets[0].data, i_frame, sizeof(i_frame)));
+
+	/* Simple packet blocks have no timestamp */
+	g_assert_cmpuint(packets[1].len, ==, sizeof(symm));
+	g_assert_cmpuint(packets[1].timestamp, ==, 0);
+}
+
+static void test_pcapng_native(void)
+{
+	test_pcapng(false);
+}
+
+static void test_pcapng_swapped(void)
+{
+	test_pcapng(true);
+}
+
+static void test_pcapng_usec(void)
+{
+	GByteArray *buf = g_byte_array_new();
+	guint64 skipped;
+
+	/* Default resolution, microseconds */
+	put_pcapng_shb(buf, false);
+	put_pcapng_idb(buf, LINKTYPE_NFC_LLCP, -1, false);
+	put_pcapng_epb(buf, 0, 1500000, symm, sizeof(symm), false);
+
+	g_assert_cmpint(read_capture(buf, &skipped), ==, 0);
+
+	g_assert_cmpuint(n_packets, ==, 1);
+	g_assert_cmpuint(packets[0].timestamp, ==, 1500000000ULL);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testPcap-read/Test pcap usec", test_pcap_usec);
+	g_test_add_func("/testPcap-read/Test pcap nsec swapped",
+						test_pcap_nsec_swapped);
+	g_test_add_func("/testPcap-read/Test pcap bad magic",
+						test_pcap_bad_magic);
+	g_test_add_func("/testPcap-read/Test pcap truncated record",
+						test_pcap_truncated);
+	g_test_add_func("/testPcap-read/Test pcapng", test_pcapng_native);
+	g_test_add_func("/testPcap-read/Test pcapng swapped",
+						test_pcapng_swapped);
+	g_test_add_func("/testPcap-read/Test pcapng usec", test_pcapng_usec);
+
+	return g_test_run();
+}
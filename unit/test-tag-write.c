@@ -0,0 +1,397 @@
+/*
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gprintf.h>
+
+#include <src/near.h>
+
+#define TEST_ADAPTER	0
+#define TEST_TARGET	1
+
+/* Fake tag driver, completing I/O on request */
+static near_tag_io_cb pending_write;
+static near_tag_io_cb pending_read;
+static int write_err;
+static guint n_writes;
+static guint n_reads;
+static guint8 written[16];
+
+/* Completions of the queued writes, in order */
+static int results[16];
+static guint n_results;
+
+static bool presence_started;
+
+static int test_driver_read(uint32_t adapter_idx, uint32_t target_idx,
+							near_tag_io_cb cb)
+{
+	g_assert(!pending_read);
+
+	pending_read = cb;
+	n_reads++;
+
+	return 0;
+}
+
+static int test_driver_write(uint32_t adapter_idx, uint32_t target_idx,
+					struct near_ndef_message *ndef,
+					near_tag_io_cb cb)
+{
+	/* Like the in-tree drivers, call back before returning an error */
+	if (write_err) {
+		cb(adapter_idx, target_idx, write_err);
+		return write_err;
+	}
+
+	/* One write at a time */
+	g_assert(!pending_write);
+	g_assert(!pending_read);
+	g_assert_cmpuint(n_writes, <, sizeof(written));
+
+	pending_write = cb;
+	written[n_writes++] = ndef->data[0];
+
+	return 0;
+}
+
+static struct near_tag_driver test_driver = {
+	.type		= NFC_PROTO_FELICA,
+	.priority	= NEAR_TAG_PRIORITY_DEFAULT,
+	.read		= test_driver_read,
+	.write		= test_driver_write,
+};
+
+/* The queue goes on from idle callbacks */
+static void run_idle(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void complete_write(int status)
+{
+	near_tag_io_cb cb = pending_write;
+
+	g_assert(cb);
+	pending_write = NULL;
+
+	cb(TEST_ADAPTER, TEST_TARGET, status);
+	run_idle();
+}
+
+static void complete_read(int status)
+{
+	near_tag_io_cb cb = pending_read;
+
+	g_assert(cb);
+	pending_read = NULL;
+
+	cb(TEST_ADAPTER, TEST_TARGET, status);
+	run_idle();
+}
+
+/* Daemon side stubs */
+struct near_adapter *__near_adapter_get(uint32_t idx)
+{
+	return NULL;
+}
+
+const char *__near_adapter_get_path(struct near_adapter *adapter)
+{
+	return NULL;
+}
+
+bool __near_adapter_is_constant_poll(struct near_adapter *adapter)
+{
+	return false;
+}
+
+int __near_adapter_start_poll(struct near_adapter *adapter)
+{
+	return 0;
+}
+
+void __near_adapter_start_check_presence(uint32_t adapter_idx,
+							uint32_t target_idx)
+{
+	presence_started = true;
+}
+
+void __near_adapter_stop_check_presence(uint32_t adapter_idx,
+							uint32_t target_idx)
+{
+	presence_started = false;
+}
+
+int near_adapter_disconnect(uint32_t idx)
+{
+	return 0;
+}
+
+int __near_netlink_activate_target(uint32_t idx, uint32_t target_idx,
+							uint32_t protocol)
+{
+	return 0;
+}
+
+int __near_netlink_deactivate_target(uint32_t idx, uint32_t target_idx)
+{
+	return 0;
+}
+
+void __near_ring_target_read(uint32_t adapter_idx, uint32_t target_idx,
+					GList *records)
+{
+}
+
+static void test_write_cb(uint32_t adapter_idx, uint32_t target_idx,
+								int status)
+{
+	g_assert_cmpuint(n_results, <, G_N_ELEMENTS(results));
+
+	results[n_results++] = status;
+}
+
+static struct near_tag *test_tag_setup(void)
+{
+	struct near_tag *tag;
+
+	pending_write = NULL;
+	pending_read = NULL;
+	write_err = 0;
+	n_writes = 0;
+	n_reads = 0;
+	n_results = 0;
+	presence_started = false;
+
+	__near_tag_init();
+	g_assert_cmpint(near_tag_driver_register(&test_driver), ==, 0);
+
+	tag = __near_tag_add(TEST_ADAPTER, TEST_TARGET, NFC_PROTO_FELICA_MASK,
+					0, 0, NULL, 0, 0, 0, NULL);
+	g_assert(tag);
+
+	return tag;
+}
+
+static void test_tag_teardown(struct near_tag *tag)
+{
+	if (tag)
+		__near_tag_remove(tag);
+
+	near_tag_driver_unregister(&test_driver);
+	__near_tag_cleanup();
+}
+
+static int queue_write(struct near_tag *tag, guint8 id)
+{
+	struct near_ndef_message *ndef;
+	int err;
+
+	ndef = g_new0(struct near_ndef_message, 1);
+	ndef->length = 4;
+	ndef->data = g_malloc0(ndef->length);
+	ndef->data[0] = id;
+
+	err = __near_tag_queue_write(tag, ndef, test_write_cb);
+	run_idle();
+
+	near_ndef_msg_free(ndef);
+
+	return err;
+}
+
+static void test_tag_write_order(void)
+{
+	struct near_tag *tag = test_tag_setup();
+	guint8 id;
+
+	for (id = 1; id <= 3; id++)
+		g_assert_cmpint(queue_write(tag, id), ==, 0);
+
+	/* Only the first write is started */
+	g_assert_cmpuint(n_writes, ==, 1);
+
+	for (id = 1; id <= 3; id++) {
+		g_assert_cmpuint(n_writes, ==, id);
+		g_assert_cmpuint(written[id - 1], ==, id);
+
+		complete_write(0);
+		g_assert_cmpuint(n_results, ==, id);
+		g_assert_cmpint(results[id - 1], ==, 0);
+
+		/* The tag is read back before the next write */
+		g_assert_cmpuint(n_reads, ==, id);
+		g_assert(!pending_write);
+
+		complete_read(0);
+	}
+
+	g_assert_cmpuint(n_writes, ==, 3);
+	g_assert(presence_started);
+
+	/* The queue is idle again, the next write starts right away */
+	g_assert_cmpint(queue_write(tag, 4), ==, 0);
+	g_assert_cmpuint(n_writes, ==, 4);
+
+	complete_write(0);
+	complete_read(0);
+
+	test_tag_teardown(tag);
+}
+
+static void test_tag_write_error(void)
+{
+	struct near_tag *tag = test_tag_setup();
+
+	g_assert_cmpint(queue_write(tag, 1), ==, 0);
+	g_assert_cmpint(queue_write(tag, 2), ==, 0);
+
+	/* A failed write is read back as well before the next one */
+	complete_write(-EIO);
+
+	g_assert_cmpuint(n_results, ==, 1);
+	g_assert_cmpint(results[0], ==, -EIO);
+	g_assert_cmpuint(n_reads, ==, 1);
+	g_assert_cmpuint(n_writes, ==, 1);
+
+	complete_read(0);
+	g_assert_cmpuint(n_writes, ==, 2);
+
+	complete_write(0);
+	complete_read(0);
+
+	g_assert_cmpuint(n_results, ==, 2);
+	g_assert_cmpint(results[1], ==, 0);
+
+	/* Writes failing right away are completed once, and read back */
+	write_err = -ENOSPC;
+	g_assert_cmpint(queue_write(tag, 3), ==, 0);
+	g_assert_cmpint(queue_write(tag, 4), ==, 0);
+
+	g_assert_cmpuint(n_results, ==, 3);
+	g_assert_cmpint(results[2], ==, -ENOSPC);
+	g_assert_cmpuint(n_reads, ==, 3);
+
+	complete_read(0);
+
+	g_assert_cmpuint(n_results, ==, 4);
+	g_assert_cmpint(results[3], ==, -ENOSPC);
+	g_assert_cmpuint(n_reads, ==, 4);
+
+	complete_read(0);
+
+	g_assert_cmpuint(n_results, ==, 4);
+	g_assert(presence_started);
+
+	test_tag_teardown(tag);
+}
+
+static void test_tag_write_depth(void)
+{
+	struct near_tag *tag = test_tag_setup();
+	guint8 id;
+
+	/* The first write is running, eight more can be queued */
+	for (id = 1; id <= 9; id++)
+		g_assert_cmpint(queue_write(tag, id), ==, 0);
+
+	g_assert_cmpint(queue_write(tag, 10), ==, -EBUSY);
+
+	g_assert_cmpuint(n_writes, ==, 1);
+	g_assert_cmpuint(n_results, ==, 0);
+
+	/* Removing the tag fails all of them */
+	test_tag_teardown(tag);
+
+	g_assert_cmpuint(n_results, ==, 9);
+	for (id = 0; id < 9; id++)
+		g_assert_cmpint(results[id], ==, -ENODEV);
+}
+
+static void test_tag_write_readonly(void)
+{
+	struct near_tag *tag = test_tag_setup();
+
+	near_tag_set_ro(tag, true);
+
+	g_assert_cmpint(queue_write(tag, 1), ==, -EACCES);
+	g_assert_cmpuint(n_writes, ==, 0);
+
+	test_tag_teardown(tag);
+}
+
+static void test_tag_write_no_driver(void)
+{
+	struct near_tag *tag = test_tag_setup();
+
+	g_assert_cmpint(queue_write(tag, 1), ==, 0);
+	g_assert_cmpint(queue_write(tag, 2), ==, 0);
+
+	/* The driver goes away while the first write is running */
+	near_tag_driver_unregister(&test_driver);
+
+	complete_write(0);
+
+	/* Nothing to read the tag back with, the queue is failed */
+	g_assert_cmpuint(n_reads, ==, 0);
+	g_assert_cmpuint(n_results, ==, 2);
+	g_assert_cmpint(results[0], ==, 0);
+	g_assert_cmpint(results[1], ==, -EOPNOTSUPP);
+	g_assert(presence_started);
+
+	/* And writes can be queued again */
+	g_assert_cmpint(near_tag_driver_register(&test_driver), ==, 0);
+	g_assert_cmpint(queue_write(tag, 3), ==, 0);
+	g_assert_cmpuint(n_writes, ==, 2);
+
+	complete_write(0);
+	complete_read(0);
+
+	test_tag_teardown(tag);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testTag-write/Test write order",
+						test_tag_write_order);
+	g_test_add_func("/testTag-write/Test write error",
+						test_tag_write_error);
+	g_test_add_func("/testTag-write/Test queue depth",
+						test_tag_write_depth);
+	g_test_add_func("/testTag-write/Test read only tag",
+						test_tag_write_readonly);
+	g_test_add_func("/testTag-write/Test driver removed",
+						test_tag_write_no_driver);
+
+	return g_test_run();
+}
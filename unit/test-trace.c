@@ -0,0 +1,311 @@
+/*
+ *  neard - Near Field Communication manager
+ *
+ *  Copyright (C) 2026  The neard contributors.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gprintf.h>
+
+#include <src/near.h>
+
+/* See doc/trace-api.txt for the file layout */
+#define TRACE_MAGIC		0x4e545243
+#define TRACE_HEADER_LEN	64
+#define TRACE_RECORD_LEN	48
+#define TRACE_SITE_LEN		16
+
+#define FIRST_FORMAT	"first %u"
+#define SECOND_FORMAT	"second %u %u"
+#define COUNT_FORMAT	"count %u"
+
+struct test_trace {
+	gchar *path;
+	gchar *data;
+	gsize size;
+	guint32 record_count;
+	guint32 site_count;
+	guint32 records_offset;
+	guint32 sites_offset;
+	guint64 head;
+};
+
+static guint16 get16(struct test_trace *trace, gsize offset)
+{
+	guint16 val;
+
+	g_assert_cmpuint(offset + 2, <=, trace->size);
+	memcpy(&val, trace->data + offset, 2);
+
+	return val;
+}
+
+static guint32 get32(struct test_trace *trace, gsize offset)
+{
+	guint32 val;
+
+	g_assert_cmpuint(offset + 4, <=, trace->size);
+	memcpy(&val, trace->data + offset, 4);
+
+	return val;
+}
+
+static guint64 get64(struct test_trace *trace, gsize offset)
+{
+	guint64 val;
+
+	g_assert_cmpuint(offset + 8, <=, trace->size);
+	memcpy(&val, trace->data + offset, 8);
+
+	return val;
+}
+
+static const char *get_string(struct test_trace *trace, gsize offset)
+{
+	g_assert_cmpuint(offset, <, trace->size);
+	g_assert(memchr(trace->data + offset, '\0', trace->size - offset));
+
+	return trace->data + offset;
+}
+
+static void trace_first(guint32 a)
+{
+	TRACE(FIRST_FORMAT, a);
+}
+
+static void trace_second(guint32 a, guint32 b)
+{
+	TRACE(SECOND_FORMAT, a, b);
+}
+
+static void trace_count(guint32 count)
+{
+	TRACE(COUNT_FORMAT, count);
+}
+
+static void test_trace_start(struct test_trace *trace)
+{
+	GError *error = NULL;
+	int fd;
+
+	memset(trace, 0, sizeof(*trace));
+
+	fd = g_file_open_tmp("test-trace-XXXXXX", &trace->path, &error);
+	g_assert_no_error(error);
+	close(fd);
+
+	g_assert_cmpint(__near_trace_init(trace->path), ==, 0);
+}
+
+/* Read the file back, as neard-trace would after a crash */
+static void test_trace_load(struct test_trace *trace)
+{
+	GError *error = NULL;
+
+	g_free(trace->data);
+
+	g_file_get_contents(trace->path, &trace->data, &trace->size, &error);
+	g_assert_no_error(error);
+
+	g_assert_cmpuint(trace->size, >=, TRACE_HEADER_LEN);
+	g_assert_cmpuint(get32(trace, 0), ==, TRACE_MAGIC);
+	g_assert_cmpuint(get16(trace, 4), ==, 1);
+	g_assert_cmpuint(get16(trace, 6), ==, TRACE_RECORD_LEN);
+
+	trace->record_count = get32(trace, 8);
+	trace->site_count = get32(trace, 12);
+	trace->records_offset = get32(trace, 16);
+	trace->sites_offset = get32(trace, 20);
+	trace->head = get64(trace, 24);
+
+	g_assert_cmpuint(trace->record_count, >, 0);
+	g_assert_cmpuint(trace->record_count &
+				(trace->record_count - 1), ==, 0);
+	g_assert_cmpuint(trace->records_offset, ==, TRACE_HEADER_LEN);
+	g_assert_cmpuint(trace->sites_offset, ==, trace->records_offset +
+			(gsize) trace->record_count * TRACE_RECORD_LEN);
+	g_assert_cmpuint(trace->sites_offset + (gsize) trace->site_count *
+				TRACE_SITE_LEN, <=, trace->size);
+}
+
+static void test_trace_stop(struct test_trace *trace)
+{
+	__near_trace_cleanup();
+
+	unlink(trace->path);
+	g_free(trace->path);
+	g_free(trace->data);
+}
+
+static gsize record_offset(struct test_trace *trace, guint64 n)
+{
+	return trace->records_offset +
+		(n & (trace->record_count - 1)) * TRACE_RECORD_LEN;
+}
+
+static const char *record_format(struct test_trace *trace, guint64 n)
+{
+	guint32 site;
+
+	site = get32(trace, record_offset(trace, n) + 8);
+	g_assert_cmpuint(site, <, trace->site_count);
+
+	return get_string(trace, get32(trace,
+			trace->sites_offset + site * TRACE_SITE_LEN + 12));
+}
+
+static guint64 record_arg(struct test_trace *trace, guint64 n, int i)
+{
+	return get64(trace, record_offset(trace, n) + 16 + i * 8);
+}
+
+static void test_trace_sites(void)
+{
+	struct test_trace trace;
+	gsize site;
+	const char *format;
+	guint found = 0;
+
+	test_trace_start(&trace);
+	test_trace_load(&trace);
+
+	g_assert_cmpuint(trace.head, ==, 0);
+	g_assert_cmpuint(trace.site_count, ==, 3);
+
+	for (site = trace.sites_offset; site < trace.sites_offset +
+			trace.site_count * TRACE_SITE_LEN;
+			site += TRACE_SITE_LEN) {
+		g_assert_cmpuint(get32(&trace, site), >, 0);
+		g_assert(g_str_has_suffix(get_string(&trace,
+				get32(&trace, site + 4)), "test-trace.c"));
+
+		format = get_string(&trace, get32(&trace, site + 12));
+
+		if (!strcmp(format, FIRST_FORMAT)) {
+			g_assert_cmpstr(get_string(&trace,
+					get32(&trace, site + 8)), ==,
+					"trace_first");
+			found++;
+		} else if (!strcmp(format, SECOND_FORMAT) ||
+					!strcmp(format, COUNT_FORMAT)) {
+			found++;
+		}
+	}
+
+	g_assert_cmpuint(found, ==, 3);
+
+	test_trace_stop(&trace);
+}
+
+static void test_trace_records(void)
+{
+	struct test_trace trace;
+
+	test_trace_start(&trace);
+
+	trace_first(42);
+	trace_second(1, 2);
+
+	test_trace_load(&trace);
+
+	g_assert_cmpuint(trace.head, ==, 2);
+
+	g_assert_cmpstr(record_format(&trace, 0), ==, FIRST_FORMAT);
+	g_assert_cmpuint(record_arg(&trace, 0, 0), ==, 42);
+	g_assert_cmpuint(record_arg(&trace, 0, 1), ==, 0);
+
+	g_assert_cmpstr(record_format(&trace, 1), ==, SECOND_FORMAT);
+	g_assert_cmpuint(record_arg(&trace, 1, 0), ==, 1);
+	g_assert_cmpuint(record_arg(&trace, 1, 1), ==, 2);
+	g_assert_cmpuint(record_arg(&trace, 1, 2), ==, 0);
+	g_assert_cmpuint(record_arg(&trace, 1, 3), ==, 0);
+
+	/* Timestamps */
+	g_assert_cmpuint(get64(&trace, record_offset(&trace, 0)), >, 0);
+	g_assert_cmpuint(get64(&trace, record_offset(&trace, 1)), >=,
+				get64(&trace, record_offset(&trace, 0)));
+
+	test_trace_stop(&trace);
+}
+
+static void test_trace_wrap(void)
+{
+	struct test_trace trace;
+	guint32 i, count;
+
+	test_trace_start(&trace);
+	test_trace_load(&trace);
+
+	count = trace.record_count + 3;
+
+	for (i = 0; i < count; i++)
+		trace_count(i);
+
+	test_trace_load(&trace);
+
+	g_assert_cmpuint(trace.head, ==, count);
+
+	/* The oldest records were overwritten */
+	g_assert_cmpuint(record_arg(&trace, 0, 0), ==, trace.record_count);
+	g_assert_cmpuint(record_arg(&trace, count - 1, 0), ==, count - 1);
+	g_assert_cmpuint(record_arg(&trace, count - trace.record_count, 0),
+						==, count - trace.record_count);
+
+	test_trace_stop(&trace);
+}
+
+static void test_trace_stopped(void)
+{
+	struct test_trace trace;
+
+	test_trace_start(&trace);
+
+	trace_first(1);
+
+	__near_trace_cleanup();
+
+	/* Nothing is recorded once the trace file is closed */
+	trace_first(2);
+
+	test_trace_load(&trace);
+	g_assert_cmpuint(trace.head, ==, 1);
+
+	unlink(trace.path);
+	g_free(trace.path);
+	g_free(trace.data);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testTrace/Test call sites", test_trace_sites);
+	g_test_add_func("/testTrace/Test records", test_trace_records);
+	g_test_add_func("/testTrace/Test ring wrap", test_trace_wrap);
+	g_test_add_func("/testTrace/Test stopped", test_trace_stopped);
+
+	return g_test_run();
+}